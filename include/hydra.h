@@ -102,9 +102,10 @@ HYDRA_EXPORT char *
     hydra_store_string (hydra_t *self, const char *subject, const char *parent_id, const char *mime_type, const char *content);
 
 //  *** Draft method, for development use, may change without warning ***
-//  Store a new post located in a file somewhere on disk. Returns post ID for
-//  the newly created post, or NULL if it was impossible to store the post.
-//  Caller must free post ID when finished with it.
+//  Store a new post located in a file somewhere on disk. The node copies the
+//  file into its store, so the caller may change or delete it afterwards.
+//  Returns post ID for the newly created post, or NULL if it was impossible
+//  to store the post. Caller must free post ID when finished with it.
 //  Caller owns return value and must destroy it when done.
 HYDRA_EXPORT char *
     hydra_store_file (hydra_t *self, const char *subject, const char *parent_id, const char *mime_type, const char *filename);
@@ -117,6 +118,30 @@ HYDRA_EXPORT char *
 HYDRA_EXPORT char *
     hydra_store_chunk (hydra_t *self, const char *subject, const char *parent_id, const char *mime_type, zchunk_t *chunk);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Write all posts this node holds, with their content, to the specified
+//  file as a single archive, which another node can import. Returns the
+//  number of posts written, or -1 if the archive could not be written.
+HYDRA_EXPORT int
+    hydra_export (hydra_t *self, const char *filename);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Store all posts from an archive written by hydra_export, with their
+//  content, skipping posts and content the node already has. This is the
+//  fast way to seed a new node. Returns the number of posts stored, or -1
+//  if the archive was missing or damaged.
+HYDRA_EXPORT int
+    hydra_import (hydra_t *self, const char *filename);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return a line that reports how the node's scrubber is doing: posts and
+//  bytes scrubbed, passes over the ledger, how far it is through this pass,
+//  posts quarantined as damaged, and bytes scrubbed per second it spent
+//  scrubbing. Caller must free returned string using zstr_free ().
+//  Caller owns return value and must destroy it when done.
+HYDRA_EXPORT char *
+    hydra_scrub_status (hydra_t *self);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Return the Hydra version for run-time API detection
 HYDRA_EXPORT void
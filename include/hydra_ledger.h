@@ -37,6 +37,21 @@ HYDRA_EXPORT void
 HYDRA_EXPORT size_t
     hydra_ledger_size (hydra_ledger_t *self);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Set the number of threads the ledger uses to decode posts when loading.
+//  Defaults to the number of CPU cores; 1 means load on the calling thread.
+HYDRA_EXPORT void
+    hydra_ledger_set_workers (hydra_ledger_t *self, size_t workers);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Set retention limits on the ledger: the maximum number of posts, total
+//  bytes of post content, and post age in seconds. Zero means no limit.
+//  When the ledger exceeds any limit it evicts its oldest posts, deleting
+//  their content, until it is within all limits again. It does not store
+//  posts older than the age limit. Defaults to no limits.
+HYDRA_EXPORT void
+    hydra_ledger_set_retention (hydra_ledger_t *self, size_t max_posts, size_t max_bytes, int64_t max_age);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Load the ledger data from disk, from the specified directory. Returns
 //  the number of posts loaded, or -1 if there was an error reading the
@@ -45,25 +60,225 @@ HYDRA_EXPORT int
     hydra_ledger_load (hydra_ledger_t *self);
 
 //  *** Draft method, for development use, may change without warning ***
-//  Save a post via the ledger. This saves the post to disk, adds the post
-//  to the ledger, and then destroys the post. Use in place of
-//  hydra_post_save to ensure post filenames are correctly generated.
+//  Save a post via the ledger. This saves the post content to disk, appends
+//  the post to the ledger journal, adds the post to the ledger, and then
+//  destroys the post. Returns 0 if OK, -1 if the post could not be saved.
+//  If the ledger already has the post, or evicted it, or the post is older
+//  than the retention age limit, does nothing except destroy it.
 HYDRA_EXPORT int
     hydra_ledger_store (hydra_ledger_t *self, hydra_post_t **post_p);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Start a batch of stores. Posts stored until the next hydra_ledger_commit
+//  are indexed and fetchable at once, but are written to disk together when
+//  you commit, which is much faster than storing them one by one.
+HYDRA_EXPORT void
+    hydra_ledger_begin (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  End a batch of stores, writing all posts stored since hydra_ledger_begin
+//  to disk. If the ledger is durable, does not return until the disk has
+//  them. Returns 0 if OK, -1 if the posts could not be written, in which
+//  case the ledger no longer serves them.
+HYDRA_EXPORT int
+    hydra_ledger_commit (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Set whether the ledger waits until the disk has each post, or each batch
+//  of posts, before it reports the post as stored. This is safer if the
+//  system crashes, and slower. Defaults to false, in which case posts reach
+//  the disk when the operating system decides.
+HYDRA_EXPORT void
+    hydra_ledger_set_durable (hydra_ledger_t *self, bool durable);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Return post at specified index; if the index does not refer to a valid
-//  post, returns NULL.
+//  post, or the post is quarantined, returns NULL. Recently fetched posts
+//  come from a cache, so do not touch the disk.
 //  Caller owns return value and must destroy it when done.
 HYDRA_EXPORT hydra_post_t *
     hydra_ledger_fetch (hydra_ledger_t *self, int index);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Return number of fetches served from the ledger's post cache
+HYDRA_EXPORT size_t
+    hydra_ledger_cache_hits (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return number of fetches that had to read the post from disk
+HYDRA_EXPORT size_t
+    hydra_ledger_cache_misses (hydra_ledger_t *self);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Lookup post in ledger and return post index (0 .. size - 1); if the post
 //  does not exist, returns -1.
 HYDRA_EXPORT int
     hydra_ledger_index (hydra_ledger_t *self, const char *post_id);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Return true if the ledger held the post and evicted it under its
+//  retention limits. The ledger will not store such a post again, so peers
+//  should not send it.
+HYDRA_EXPORT bool
+    hydra_ledger_evicted (hydra_ledger_t *self, const char *post_id);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return false if the ledger definitely does not hold the post, or true if
+//  it probably does. This is faster than hydra_ledger_index, and almost
+//  always right; a few posts in a thousand may give a false "true".
+HYDRA_EXPORT bool
+    hydra_ledger_may_contain (hydra_ledger_t *self, const char *post_id);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return true if the ledger holds content with the specified digest, as
+//  40 hex characters, whether or not a post uses it. Use this to avoid
+//  fetching or writing content we already have.
+HYDRA_EXPORT bool
+    hydra_ledger_has_blob (hydra_ledger_t *self, const char *digest);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the number of posts with timestamps from since up to, but not
+//  including, until, in seconds since the epoch.
+HYDRA_EXPORT size_t
+    hydra_ledger_range_size (hydra_ledger_t *self, int64_t since, int64_t until);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Page through the posts with timestamps from since up to, but not
+//  including, until, in seconds since the epoch, oldest first. Skips the
+//  first offset posts in the range, and stores the indexes of at most limit
+//  posts after that into the indexes array. Returns the number of indexes
+//  stored. Posts with the same timestamp come in the order we stored them.
+HYDRA_EXPORT size_t
+    hydra_ledger_range (hydra_ledger_t *self, int64_t since, int64_t until, size_t offset, int *indexes, size_t limit);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Page through the replies to the specified post, oldest first. Skips the
+//  first offset replies, and stores the indexes of at most limit replies
+//  after that into the indexes array. Returns the number of indexes stored.
+//  The ledger does not need to hold the post itself.
+HYDRA_EXPORT size_t
+    hydra_ledger_children (hydra_ledger_t *self, const char *post_id, size_t offset, int *indexes, size_t limit);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Page through the thread that starts at the specified post: the post, if
+//  the ledger holds it, then each of its replies followed by the replies to
+//  that reply, and so on, oldest first, as a threaded view shows them. Skips
+//  the first offset posts, and stores the indexes of at most limit posts
+//  after that into the indexes array. Returns the number of indexes stored.
+HYDRA_EXPORT size_t
+    hydra_ledger_thread (hydra_ledger_t *self, const char *post_id, size_t offset, int *indexes, size_t limit);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the number of posts that match a query. A post matches if it has
+//  the specified MIME type, where "type/*" matches any subtype; content with
+//  the specified digest, as 40 hex characters; a content size from min_size
+//  to max_size bytes; and a timestamp from since up to, but not including,
+//  until, in seconds since the epoch. Pass NULL or 0 for any of these to
+//  match all posts.
+HYDRA_EXPORT size_t
+    hydra_ledger_query_size (hydra_ledger_t *self, const char *mime_type, const char *digest, size_t min_size, size_t max_size, int64_t since, int64_t until);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Page through the posts that match a query, in the order we stored them.
+//  The query is as for hydra_ledger_query_size. Skips the first offset
+//  posts that match, and stores the indexes of at most limit posts after
+//  that into the indexes array. Returns the number of indexes stored.
+HYDRA_EXPORT size_t
+    hydra_ledger_query (hydra_ledger_t *self, const char *mime_type, const char *digest, size_t min_size, size_t max_size, int64_t since, int64_t until, size_t offset, int *indexes, size_t limit);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Search the posts for the words in the query, in their subject and in
+//  their content if that is plain text, and page through the posts that
+//  hold every word, best match first. Skips the first offset posts found,
+//  and stores the indexes of at most limit posts after that into the
+//  indexes array. Returns the number of indexes stored. Searching does not
+//  read the posts; the first search in a session loads the word index.
+HYDRA_EXPORT size_t
+    hydra_ledger_search (hydra_ledger_t *self, const char *query, size_t offset, int *indexes, size_t limit);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Move the content of posts older than min_age seconds out of their blob
+//  files and into a new pack file, if there are at least min_blobs such
+//  blobs. Packs up to 64MB of content per call, so call this from time to
+//  time to compact the ledger bit by bit. Fetched posts read their content
+//  from packs or blob files as needed. Returns the number of blobs packed,
+//  or -1 if the pack could not be written.
+HYDRA_EXPORT int
+    hydra_ledger_compact (hydra_ledger_t *self, int64_t min_age, size_t min_blobs);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Scrub the next posts in the ledger, reading about max_bytes bytes from
+//  disk, and carry on from there next time; call this from time to time to
+//  check the whole ledger bit by bit. We check each post's metadata against
+//  its post ID, and its content against its digest, and quarantine damaged
+//  posts so we no longer fetch or export them. Stops at the end of each
+//  pass over the ledger. Returns the number of bytes read.
+HYDRA_EXPORT size_t
+    hydra_ledger_scrub (hydra_ledger_t *self, size_t max_bytes);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the index of the next post the scrubber will check, which tells
+//  how far it is through the current pass over the ledger
+HYDRA_EXPORT size_t
+    hydra_ledger_scrub_cursor (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the number of posts scrubbed
+HYDRA_EXPORT size_t
+    hydra_ledger_scrub_posts (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the number of bytes read while scrubbing
+HYDRA_EXPORT size_t
+    hydra_ledger_scrub_bytes (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the number of passes the scrubber has finished over the ledger
+HYDRA_EXPORT size_t
+    hydra_ledger_scrub_passes (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the number of posts in the ledger that are quarantined
+HYDRA_EXPORT size_t
+    hydra_ledger_quarantined (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Write all posts in the ledger, oldest first, with their content, to the
+//  specified file as a single archive that hydra_ledger_import can read.
+//  Skips quarantined posts, and posts whose content is missing or damaged.
+//  Returns the number of posts exported, or -1 if the archive could not be
+//  written.
+HYDRA_EXPORT int
+    hydra_ledger_export (hydra_ledger_t *self, const char *filename);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Store all posts from an archive written by hydra_ledger_export, with
+//  their content, as one batch. This is much faster than receiving the
+//  posts from a peer. Does not store posts the ledger already has, or
+//  evicted, or that are older than the retention age limit, and does not
+//  write content the ledger already holds. Returns the number of posts
+//  stored, or -1 if the archive was missing or damaged; posts read before
+//  the damage stay stored.
+HYDRA_EXPORT int
+    hydra_ledger_import (hydra_ledger_t *self, const char *filename);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Save the ledger index to disk, so that the next load only has to replay
+//  posts stored after this point. Call this before destroying a ledger you
+//  have stored posts into. The saved index keeps the IDs of evicted posts,
+//  so the ledger goes on refusing them. Returns 0 if OK, -1 if the index
+//  could not be saved.
+HYDRA_EXPORT int
+    hydra_ledger_checkpoint (hydra_ledger_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the number of posts added to the ledger since its index was last
+//  saved, including posts replayed at load and posts evicted since. Unlike
+//  the ledger size, this goes on counting when retention caps the ledger,
+//  so use it to decide when to checkpoint.
+HYDRA_EXPORT size_t
+    hydra_ledger_unsaved (hydra_ledger_t *self);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Self test of this class
 HYDRA_EXPORT void
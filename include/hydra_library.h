@@ -80,6 +80,8 @@ typedef struct _hydra_post_t hydra_post_t;
 #define HYDRA_POST_T_DEFINED
 typedef struct _hydra_ledger_t hydra_ledger_t;
 #define HYDRA_LEDGER_T_DEFINED
+typedef struct _hydra_post_reader_t hydra_post_reader_t;
+#define HYDRA_POST_READER_T_DEFINED
 #endif // HYDRA_BUILD_DRAFT_API
 
 
@@ -90,6 +92,7 @@ typedef struct _hydra_ledger_t hydra_ledger_t;
 #include "hydra_client.h"
 #include "hydra_post.h"
 #include "hydra_ledger.h"
+#include "hydra_post_reader.h"
 #endif // HYDRA_BUILD_DRAFT_API
 
 #ifdef HYDRA_BUILD_DRAFT_API
@@ -33,11 +33,21 @@ HYDRA_EXPORT void
     hydra_post_destroy (hydra_post_t **self_p);
 
 //  *** Draft method, for development use, may change without warning ***
-//  Recalculate the post ID based on subject, timestamp, parent id, MIME
-//  type, and content digest, and return post ID to caller.
+//  Return the post ID, which is the SHA1 digest of the subject, timestamp,
+//  parent id, MIME type, and content digest. We calculate the ID when first
+//  asked, and again only after a change to any of these fields. A post
+//  unpacked from the ledger keeps the ID it was packed with; use
+//  hydra_post_verify_ident to check that against the fields.
 HYDRA_EXPORT const char *
     hydra_post_ident (hydra_post_t *self);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Check the post ID against the post fields, calculating it again. Returns
+//  0 if OK, -1 if the post holds a post ID that does not match its fields.
+//  Use this on posts from any source you do not trust.
+HYDRA_EXPORT int
+    hydra_post_verify_ident (hydra_post_t *self);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Return the post subject, if set
 HYDRA_EXPORT const char *
@@ -73,9 +83,24 @@ HYDRA_EXPORT const char *
 HYDRA_EXPORT size_t
     hydra_post_content_size (hydra_post_t *self);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Return the name of the file that holds the post content: its pack file
+//  if the content is packed, else its location. Returns NULL if the post
+//  holds its content in memory, or has none.
+HYDRA_EXPORT const char *
+    hydra_post_content_file (hydra_post_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the offset of the post content in the file that holds it, which
+//  is zero unless the content is packed.
+HYDRA_EXPORT size_t
+    hydra_post_content_offset (hydra_post_t *self);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Return the post content as a string. Returns NULL if the MIME type is
 //  not "text/plain". The caller must destroy the string when finished with it.
+//  This reads all the content into memory; to read large content a window
+//  at a time, use hydra_post_reader.
 //  Caller owns return value and must destroy it when done.
 HYDRA_EXPORT char *
     hydra_post_content (hydra_post_t *self);
@@ -110,6 +135,22 @@ HYDRA_EXPORT void
 HYDRA_EXPORT int
     hydra_post_set_file (hydra_post_t *self, const char *location);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Copy the specified file into the blob store, and set the post content to
+//  the copy. Unlike hydra_post_set_file, the post then owns its content, and
+//  the application may change or delete the file. We hash the file as we
+//  copy it, so read it only once, and hash large files on a second thread.
+//  Returns 0 if OK, -1 if the file was unreadable or could not be copied.
+HYDRA_EXPORT int
+    hydra_post_import_file (hydra_post_t *self, const char *location);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Set the post content location to the specified file, which already holds
+//  the post content, without reading it. Any content held in memory or in a
+//  pack is dropped. Note: for internal use only.
+HYDRA_EXPORT void
+    hydra_post_set_location (hydra_post_t *self, const char *location);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Save the post to disk under the specified filename. Returns 0 if OK, -1
 //  if the file could not be created. Posts are always stored in the "posts"
@@ -126,6 +167,37 @@ HYDRA_EXPORT int
 HYDRA_EXPORT hydra_post_t *
     hydra_post_load (const char *filename);
 
+//  *** Draft method, for development use, may change without warning ***
+//  Save the post content to disk, if it is held in memory, in the blobs
+//  subdirectory, and set the location property to point to it. Returns 0
+//  if OK, -1 if the blob could not be written. Does nothing if the content
+//  was already saved or points to an existing file. We write the blob in
+//  posts/staging and then rename it, so a blob is always complete.
+HYDRA_EXPORT int
+    hydra_post_save_content (hydra_post_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Check that the post content on disk is complete and matches the post
+//  digest. Returns 0 if OK, or if the content is held in memory or there is
+//  none; -1 if the content file is missing or damaged.
+HYDRA_EXPORT int
+    hydra_post_verify_content (hydra_post_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Pack the post metadata into a binary chunk, for storage in the ledger
+//  journal. The post content must already be saved to disk. Returns a new
+//  chunk which the caller must destroy.
+//  Caller owns return value and must destroy it when done.
+HYDRA_EXPORT zchunk_t *
+    hydra_post_pack (hydra_post_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Create a new post from a chunk produced by hydra_post_pack. Returns NULL
+//  if the chunk is not a valid packed post.
+//  Caller owns return value and must destroy it when done.
+HYDRA_EXPORT hydra_post_t *
+    hydra_post_unpack (zchunk_t *chunk);
+
 //  *** Draft method, for development use, may change without warning ***
 //  Fetch a chunk of content for the post. The caller specifies the size and
 //  offset of the chunk. A size of 0 means all content, which will fail if
@@ -0,0 +1,92 @@
+/*  =========================================================================
+    hydra_post_reader - read post content a window at a time
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __HYDRA_POST_READER_H_INCLUDED__
+#define __HYDRA_POST_READER_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @warning THE FOLLOWING @INTERFACE BLOCK IS AUTO-GENERATED BY ZPROJECT
+//  @warning Please edit the model at "api/hydra_post_reader.xml" to make changes.
+//  @interface
+//  This API is a draft, and may change without notice.
+#ifdef HYDRA_BUILD_DRAFT_API
+//  *** Draft method, for development use, may change without warning ***
+//  Create a reader for the post content, returning at most window_size
+//  bytes at a time; zero means 64KB. Reads from the post's blob file, or
+//  pack file, or from memory if the post holds its content there. Returns
+//  NULL if the content file is missing or too short.
+HYDRA_EXPORT hydra_post_reader_t *
+    hydra_post_reader_new (hydra_post_t *post, size_t window_size);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Destroy the reader
+HYDRA_EXPORT void
+    hydra_post_reader_destroy (hydra_post_reader_t **self_p);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the size of the content
+HYDRA_EXPORT size_t
+    hydra_post_reader_size (hydra_post_reader_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return the offset in the content of the next window we'll read
+HYDRA_EXPORT size_t
+    hydra_post_reader_tell (hydra_post_reader_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Move to the specified offset in the content, so the next window starts
+//  there. Returns 0 if OK, -1 if the offset is past the end of the content.
+HYDRA_EXPORT int
+    hydra_post_reader_seek (hydra_post_reader_t *self, size_t offset);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Read the next window of content. Returns NULL at the end of the content,
+//  or if the content file could not be read.
+//  Caller owns return value and must destroy it when done.
+HYDRA_EXPORT zchunk_t *
+    hydra_post_reader_read (hydra_post_reader_t *self);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Read size bytes of content starting at the specified offset, and leave
+//  the reader after them. A size of 0 means the rest of the content. We
+//  never read past the end of the content, so at the end this returns an
+//  empty chunk. Returns NULL if the content file could not be read.
+//  Caller owns return value and must destroy it when done.
+HYDRA_EXPORT zchunk_t *
+    hydra_post_reader_fetch (hydra_post_reader_t *self, size_t size, size_t offset);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Return a view of size bytes of content starting at the specified offset,
+//  and leave the reader after them, as hydra_post_reader_fetch does. Where
+//  the content is mapped, the view points into the mapping rather than
+//  holding a copy; it stays valid after the reader is destroyed, and you
+//  must not modify it. Otherwise returns a copy.
+//  Caller owns return value and must destroy it when done.
+HYDRA_EXPORT zchunk_t *
+    hydra_post_reader_view (hydra_post_reader_t *self, size_t size, size_t offset);
+
+//  *** Draft method, for development use, may change without warning ***
+//  Self test of this class
+HYDRA_EXPORT void
+    hydra_post_reader_test (bool verbose);
+
+#endif // HYDRA_BUILD_DRAFT_API
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -220,9 +220,10 @@ hydra_store_string (hydra_t *self, const char *subject, const char *parent_id,
 
 
 //  --------------------------------------------------------------------------
-//  Store a new post located in a file somewhere on disk. Returns post ID for
-//  the newly created post, or NULL if it was impossible to store the post.
-//  Caller must free post ID when finished with it.
+//  Store a new post located in a file somewhere on disk. The node copies the
+//  file into its store, so the caller may change or delete it afterwards.
+//  Returns post ID for the newly created post, or NULL if it was impossible
+//  to store the post. Caller must free post ID when finished with it.
 
 char *
 hydra_store_file (hydra_t *self, const char *subject, const char *parent_id,
@@ -232,6 +233,8 @@ hydra_store_file (hydra_t *self, const char *subject, const char *parent_id,
     zsock_send (self->actor, "ssssss", "POST", subject, parent_id, mime_type,
                 "file", filename);
     zsock_recv (self->actor, "s", &post_id);
+    if (post_id && *post_id == 0)
+        zstr_free (&post_id);
     return post_id;
 }
 
@@ -254,6 +257,58 @@ hydra_store_chunk (hydra_t *self, const char *subject, const char *parent_id,
 }
 
 
+//  --------------------------------------------------------------------------
+//  Write all posts this node holds, with their content, to the specified
+//  file as a single archive, which another node can import. Returns the
+//  number of posts written, or -1 if the archive could not be written.
+
+int
+hydra_export (hydra_t *self, const char *filename)
+{
+    assert (self);
+    assert (filename);
+    int posts;
+    zsock_send (self->actor, "ss", "EXPORT", filename);
+    zsock_recv (self->actor, "i", &posts);
+    return posts;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Store all posts from an archive written by hydra_export, with their
+//  content, skipping posts and content the node already has. This is the
+//  fast way to seed a new node. Returns the number of posts stored, or -1
+//  if the archive was missing or damaged.
+
+int
+hydra_import (hydra_t *self, const char *filename)
+{
+    assert (self);
+    assert (filename);
+    int posts;
+    zsock_send (self->actor, "ss", "IMPORT", filename);
+    zsock_recv (self->actor, "i", &posts);
+    return posts;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return a line that reports how the node's scrubber is doing: posts and
+//  bytes scrubbed, passes over the ledger, how far it is through this pass,
+//  posts quarantined as damaged, and bytes scrubbed per second it spent
+//  scrubbing. Caller must free returned string using zstr_free ().
+
+char *
+hydra_scrub_status (hydra_t *self)
+{
+    assert (self);
+    char *status;
+    zsock_send (self->actor, "ss", "GET", "SCRUB");
+    zsock_recv (self->actor, "s", &status);
+    return status;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return the Hydra version for run-time API detection
 
@@ -370,6 +425,14 @@ s_self_get_property (self_t *self, zmsg_t *request)
         zstr_free (&nickname);
     }
     else
+    if (streq (name, "SCRUB")) {
+        char *status;
+        zsock_send (self->server, "s", "SCRUB");
+        zsock_recv (self->server, "s", &status);
+        zsock_send (self->pipe, "s", status);
+        zstr_free (&status);
+    }
+    else
     if (streq (name, "STATUS"))
         zsock_send (self->pipe, "i", self->status);
     else
@@ -459,6 +522,20 @@ s_self_post (self_t *self, zmsg_t *request)
 }
 
 
+//  The server reads and writes archives using its own ledger
+
+static void
+s_self_archive (self_t *self, const char *command, zmsg_t *request)
+{
+    char *filename = zmsg_popstr (request);
+    int posts;
+    zsock_send (self->server, "ss", command, filename);
+    zsock_recv (self->server, "i", &posts);
+    zsock_send (self->pipe, "i", posts);
+    zstr_free (&filename);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Handle a command from calling application
 
@@ -486,6 +563,9 @@ s_self_handle_pipe (self_t *self)
     if (streq (command, "POST"))
         s_self_post (self, request);
     else
+    if (streq (command, "EXPORT") || streq (command, "IMPORT"))
+        s_self_archive (self, command, request);
+    else
     if (streq (command, "$TERM"))
         self->terminated = true;
     else {
@@ -607,6 +687,15 @@ hydra_test (bool verbose)
     
     hydra_post_t *post = hydra_fetch (self);
     assert (post == NULL);
+
+    //  Export our posts, then import them again, which stores nothing new
+    assert (hydra_export (self, "test.archive") > 0);
+    assert (hydra_import (self, "test.archive") == 0);
+    zsys_file_delete ("test.archive");
+
+    char *status = hydra_scrub_status (self);
+    assert (status);
+    zstr_free (&status);
     hydra_destroy (&self);
     //  @end
 
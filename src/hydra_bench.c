@@ -0,0 +1,896 @@
+/*  =========================================================================
+    hydra_bench - performance benchmarks
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of the Hydra Project
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+/*
+@header
+    Hydra_bench measures the cost of ledger and post operations as the
+    ledger grows. It works in a scratch directory which it deletes when
+    done, and prints one line of results per ledger size.
+@discuss
+    Ledger sizes default to 1000, 10000 and 100000 posts; you can pass
+    your own sizes after the benchmark name. Benchmarks that take other
+    sizes, such as file sizes in MB, have their own defaults.
+@end
+*/
+
+#include "hydra_classes.h"
+
+#define BENCH_DIR       ".hydra_bench"
+#define SAMPLE_SIZE     10000       //  Lookups timed per ledger size
+
+typedef struct {
+    const char *name;
+    const char *description;
+    void (*bench) (size_t *sizes, bool verbose);
+    const size_t *sizes;        //  Default sizes, if not ledger sizes
+} bench_item_t;
+
+
+//  --------------------------------------------------------------------------
+//  Create and enter a clean scratch directory for one benchmark run
+
+static void
+s_scratch_enter (void)
+{
+    zsys_dir_create (BENCH_DIR);
+    zsys_dir_change (BENCH_DIR);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Leave and delete the scratch directory
+
+static void
+s_scratch_leave (void)
+{
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (BENCH_DIR, NULL);
+    if (dir) {
+        zdir_remove (dir, true);
+        zdir_destroy (&dir);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Store posts into the ledger until it holds target posts, saving each
+//  new post ID into the idents array
+
+static void
+s_ledger_grow (hydra_ledger_t *ledger, char **idents, size_t target)
+{
+    while (hydra_ledger_size (ledger) < target) {
+        size_t post_nbr = hydra_ledger_size (ledger);
+        char *subject = zsys_sprintf ("Benchmark post %zu", post_nbr);
+        hydra_post_t *post = hydra_post_new (subject);
+        hydra_post_set_content (post, subject);
+        idents [post_nbr] = strdup (hydra_post_ident (post));
+        hydra_ledger_store (ledger, &post);
+        zstr_free (&subject);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Time hydra_ledger_index over a random sample of known post IDs at each
+//  ledger size, and then over post IDs the ledger does not have. The cost
+//  per lookup should stay flat as the ledger grows, and misses should be
+//  cheaper than hits.
+
+static void
+s_bench_index (size_t *sizes, bool verbose)
+{
+    size_t max_size = 0;
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++)
+        if (max_size < sizes [size_nbr])
+            max_size = sizes [size_nbr];
+
+    s_scratch_enter ();
+    char **idents = (char **) zmalloc (sizeof (char *) * max_size);
+    hydra_ledger_t *ledger = hydra_ledger_new ();
+
+    //  Post IDs we will never store, as hex digests
+    char **unknown = (char **) zmalloc (sizeof (char *) * SAMPLE_SIZE);
+    uint lookup_nbr;
+    for (lookup_nbr = 0; lookup_nbr < SAMPLE_SIZE; lookup_nbr++) {
+        unknown [lookup_nbr] = (char *) zmalloc (41);
+        uint char_nbr;
+        for (char_nbr = 0; char_nbr < 40; char_nbr++)
+            unknown [lookup_nbr][char_nbr] = "0123456789ABCDEF" [randof (16)];
+    }
+    printf ("%10s %12s %14s %14s\n", "posts", "lookups", "nsec/lookup", "nsec/miss");
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        s_ledger_grow (ledger, idents, size);
+
+        int64_t start = zclock_usecs ();
+        for (lookup_nbr = 0; lookup_nbr < SAMPLE_SIZE; lookup_nbr++) {
+            size_t position = randof (size);
+            int index = hydra_ledger_index (ledger, idents [position]);
+            assert (index == (int) position);
+        }
+        int64_t elapsed = zclock_usecs () - start;
+
+        start = zclock_usecs ();
+        for (lookup_nbr = 0; lookup_nbr < SAMPLE_SIZE; lookup_nbr++) {
+            int index = hydra_ledger_index (ledger, unknown [lookup_nbr]);
+            assert (index == -1);
+        }
+        int64_t miss_elapsed = zclock_usecs () - start;
+        printf ("%10zu %12d %14.1f %14.1f\n", size, SAMPLE_SIZE,
+                (double) elapsed * 1000 / SAMPLE_SIZE,
+                (double) miss_elapsed * 1000 / SAMPLE_SIZE);
+    }
+    hydra_ledger_destroy (&ledger);
+    size_t post_nbr;
+    for (post_nbr = 0; post_nbr < max_size; post_nbr++)
+        free (idents [post_nbr]);
+    free (idents);
+    for (lookup_nbr = 0; lookup_nbr < SAMPLE_SIZE; lookup_nbr++)
+        free (unknown [lookup_nbr]);
+    free (unknown);
+    s_scratch_leave ();
+}
+
+
+//  --------------------------------------------------------------------------
+//  Time hydra_ledger_load at each ledger size, first from the index snapshot
+//  and then by replaying the whole journal. Loading from the snapshot should
+//  take about the same time at any size.
+
+static void
+s_bench_load (size_t *sizes, bool verbose)
+{
+    size_t max_size = 0;
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++)
+        if (max_size < sizes [size_nbr])
+            max_size = sizes [size_nbr];
+
+    s_scratch_enter ();
+    char **idents = (char **) zmalloc (sizeof (char *) * max_size);
+
+    printf ("%10s %16s %16s\n", "posts", "usec/snapshot", "usec/replay");
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        //  Only one ledger may hold the journal, so let go of it before we
+        //  time the loads
+        hydra_ledger_t *ledger = hydra_ledger_new ();
+        hydra_ledger_load (ledger);
+        s_ledger_grow (ledger, idents, size);
+        hydra_ledger_checkpoint (ledger);
+        hydra_ledger_destroy (&ledger);
+
+        hydra_ledger_t *loaded = hydra_ledger_new ();
+        int64_t start = zclock_usecs ();
+        hydra_ledger_load (loaded);
+        int64_t snapshot_usecs = zclock_usecs () - start;
+        assert (hydra_ledger_size (loaded) == size);
+        hydra_ledger_destroy (&loaded);
+
+        zsys_file_delete ("posts/index");
+        loaded = hydra_ledger_new ();
+        start = zclock_usecs ();
+        hydra_ledger_load (loaded);
+        int64_t replay_usecs = zclock_usecs () - start;
+        assert (hydra_ledger_size (loaded) == size);
+        hydra_ledger_destroy (&loaded);
+
+        printf ("%10zu %16ld %16ld\n", size, (long) snapshot_usecs, (long) replay_usecs);
+    }
+    size_t post_nbr;
+    for (post_nbr = 0; post_nbr < max_size; post_nbr++)
+        free (idents [post_nbr]);
+    free (idents);
+    s_scratch_leave ();
+}
+
+
+//  --------------------------------------------------------------------------
+//  Time hydra_ledger_fetch as several peers walk the newest posts, which is
+//  the common pattern during sync. Reports the fetch cache hit rate.
+
+#define HOT_POSTS       100         //  Newest posts that peers walk
+
+static void
+s_bench_fetch (size_t *sizes, bool verbose)
+{
+    size_t max_size = 0;
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++)
+        if (max_size < sizes [size_nbr])
+            max_size = sizes [size_nbr];
+
+    s_scratch_enter ();
+    char **idents = (char **) zmalloc (sizeof (char *) * max_size);
+    hydra_ledger_t *ledger = hydra_ledger_new ();
+
+    printf ("%10s %12s %14s %10s\n", "posts", "fetches", "nsec/fetch", "hit rate");
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        s_ledger_grow (ledger, idents, size);
+        size_t hits = hydra_ledger_cache_hits (ledger);
+        size_t misses = hydra_ledger_cache_misses (ledger);
+
+        int64_t start = zclock_usecs ();
+        uint fetch_nbr;
+        for (fetch_nbr = 0; fetch_nbr < SAMPLE_SIZE; fetch_nbr++) {
+            size_t hot_posts = size < HOT_POSTS? size: HOT_POSTS;
+            hydra_post_t *post = hydra_ledger_fetch (ledger,
+                (int) (size - 1 - fetch_nbr % hot_posts));
+            assert (post);
+            hydra_post_destroy (&post);
+        }
+        int64_t elapsed = zclock_usecs () - start;
+        hits = hydra_ledger_cache_hits (ledger) - hits;
+        misses = hydra_ledger_cache_misses (ledger) - misses;
+        printf ("%10zu %12d %14.1f %9.1f%%\n", size, SAMPLE_SIZE,
+                (double) elapsed * 1000 / SAMPLE_SIZE,
+                (double) hits * 100 / (hits + misses));
+    }
+    hydra_ledger_destroy (&ledger);
+    size_t post_nbr;
+    for (post_nbr = 0; post_nbr < max_size; post_nbr++)
+        free (idents [post_nbr]);
+    free (idents);
+    s_scratch_leave ();
+}
+
+
+//  --------------------------------------------------------------------------
+//  Time a full journal replay at each ledger size, on one thread and then
+//  with one worker per CPU core, and report the speedup.
+
+static void
+s_bench_replay (size_t *sizes, bool verbose)
+{
+    size_t max_size = 0;
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++)
+        if (max_size < sizes [size_nbr])
+            max_size = sizes [size_nbr];
+
+    s_scratch_enter ();
+    char **idents = (char **) zmalloc (sizeof (char *) * max_size);
+
+    printf ("%10s %14s %14s %10s\n", "posts", "usec/serial", "usec/parallel", "speedup");
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        hydra_ledger_t *ledger = hydra_ledger_new ();
+        hydra_ledger_load (ledger);
+        s_ledger_grow (ledger, idents, size);
+        hydra_ledger_destroy (&ledger);
+
+        hydra_ledger_t *loaded = hydra_ledger_new ();
+        hydra_ledger_set_workers (loaded, 1);
+        int64_t start = zclock_usecs ();
+        hydra_ledger_load (loaded);
+        int64_t serial_usecs = zclock_usecs () - start;
+        assert (hydra_ledger_size (loaded) == size);
+        hydra_ledger_destroy (&loaded);
+
+        loaded = hydra_ledger_new ();
+        start = zclock_usecs ();
+        hydra_ledger_load (loaded);
+        int64_t parallel_usecs = zclock_usecs () - start;
+        assert (hydra_ledger_size (loaded) == size);
+        //  Same posts in the same order as the serial load
+        size_t post_nbr;
+        for (post_nbr = 0; post_nbr < size; post_nbr += size / 100 + 1)
+            assert (hydra_ledger_index (loaded, idents [post_nbr]) == (int) post_nbr);
+        hydra_ledger_destroy (&loaded);
+
+        printf ("%10zu %14ld %14ld %9.2fx\n", size, (long) serial_usecs,
+                (long) parallel_usecs, (double) serial_usecs / parallel_usecs);
+    }
+    size_t post_nbr;
+    for (post_nbr = 0; post_nbr < max_size; post_nbr++)
+        free (idents [post_nbr]);
+    free (idents);
+    s_scratch_leave ();
+}
+
+
+//  --------------------------------------------------------------------------
+//  Time hydra_ledger_store for each ledger size's worth of posts, storing
+//  them one at a time and then in batches, first without and then with the
+//  durable policy. Reports the cost per post.
+
+#define STORE_BATCH     256         //  Posts per batch, as server sink
+
+static int64_t
+s_store_posts (size_t count, bool durable, bool batched)
+{
+    s_scratch_enter ();
+    hydra_ledger_t *ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    hydra_ledger_set_durable (ledger, durable);
+    int64_t start = zclock_usecs ();
+    size_t post_nbr;
+    for (post_nbr = 0; post_nbr < count; post_nbr++) {
+        if (batched && post_nbr % STORE_BATCH == 0)
+            hydra_ledger_begin (ledger);
+        char *subject = zsys_sprintf ("Benchmark post %zu", post_nbr);
+        hydra_post_t *post = hydra_post_new (subject);
+        hydra_post_set_content (post, subject);
+        hydra_ledger_store (ledger, &post);
+        zstr_free (&subject);
+        if (batched && (post_nbr % STORE_BATCH == STORE_BATCH - 1 || post_nbr == count - 1))
+            hydra_ledger_commit (ledger);
+    }
+    int64_t elapsed = zclock_usecs () - start;
+    hydra_ledger_destroy (&ledger);
+    s_scratch_leave ();
+    return elapsed;
+}
+
+static void
+s_bench_store (size_t *sizes, bool verbose)
+{
+    printf ("%10s %12s %12s %12s %12s\n", "posts",
+            "usec/single", "usec/batch", "usec/sync1", "usec/syncN");
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        printf ("%10zu %12.1f %12.1f %12.1f %12.1f\n", size,
+                (double) s_store_posts (size, false, false) / size,
+                (double) s_store_posts (size, false, true) / size,
+                (double) s_store_posts (size, true, false) / size,
+                (double) s_store_posts (size, true, true) / size);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Time reading the content of a random sample of posts, in usecs per post
+
+static int64_t
+s_read_content (hydra_ledger_t *ledger)
+{
+    size_t size = hydra_ledger_size (ledger);
+    int64_t start = zclock_usecs ();
+    uint read_nbr;
+    for (read_nbr = 0; read_nbr < SAMPLE_SIZE; read_nbr++) {
+        hydra_post_t *post = hydra_ledger_fetch (ledger, randof (size));
+        zchunk_t *chunk = hydra_post_fetch (post, 0, 0);
+        assert (chunk);
+        zchunk_destroy (&chunk);
+        hydra_post_destroy (&post);
+    }
+    return zclock_usecs () - start;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Time creating blob files and then opening a random sample of them, with
+//  all blobs in one directory as older nodes kept them, and spread over 256
+//  directories as we keep them now. Then time the ledger itself: storing
+//  posts, loading a ledger whose blobs are in the old layout, which moves
+//  them, loading it again once moved, and reading content. Sizes default
+//  to 10k, 100k and 1M posts.
+
+static int64_t
+s_layout_create (char **digests, size_t size, bool sharded)
+{
+    int64_t start = zclock_usecs ();
+    size_t blob_nbr;
+    for (blob_nbr = 0; blob_nbr < size; blob_nbr++) {
+        const char *digest = digests [blob_nbr];
+        char *filename = sharded
+            ? zsys_sprintf ("blobs/%.2s/%s", digest, digest)
+            : zsys_sprintf ("blobs/%s", digest);
+        FILE *handle = fopen (filename, "wb");
+        if (!handle) {
+            zsys_dir_create ("blobs/%.2s", digest);
+            handle = fopen (filename, "wb");
+        }
+        assert (handle);
+        fwrite (digest, 1, 40, handle);
+        fclose (handle);
+        zstr_free (&filename);
+    }
+    return zclock_usecs () - start;
+}
+
+static int64_t
+s_layout_open (char **digests, size_t size, bool sharded)
+{
+    int64_t start = zclock_usecs ();
+    uint open_nbr;
+    for (open_nbr = 0; open_nbr < SAMPLE_SIZE; open_nbr++) {
+        const char *digest = digests [randof (size)];
+        char *filename = sharded
+            ? zsys_sprintf ("blobs/%.2s/%s", digest, digest)
+            : zsys_sprintf ("blobs/%s", digest);
+        FILE *handle = fopen (filename, "rb");
+        assert (handle);
+        char buffer [40];
+        size_t bytes = fread (buffer, 1, 40, handle);
+        assert (bytes == 40);
+        fclose (handle);
+        zstr_free (&filename);
+    }
+    return zclock_usecs () - start;
+}
+
+//  Store posts through the ledger, move their blobs back into one directory
+//  as an older node held them, and time the load that migrates them. All
+//  results are in usecs per post.
+
+static void
+s_layout_ledger (size_t size, double *results)
+{
+    hydra_ledger_t *ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    int64_t start = zclock_usecs ();
+    size_t post_nbr;
+    for (post_nbr = 0; post_nbr < size; post_nbr++) {
+        char *subject = zsys_sprintf ("Benchmark post %zu", post_nbr);
+        hydra_post_t *post = hydra_post_new (subject);
+        hydra_post_set_content (post, subject);
+        hydra_ledger_store (ledger, &post);
+        zstr_free (&subject);
+    }
+    results [0] = (double) (zclock_usecs () - start) / size;
+    for (post_nbr = 0; post_nbr < size; post_nbr++) {
+        hydra_post_t *post = hydra_ledger_fetch (ledger, post_nbr);
+        const char *digest = hydra_post_digest (post);
+        char *sharded = zsys_sprintf ("posts/blobs/%.2s/%s", digest, digest);
+        char *flat = zsys_sprintf ("posts/blobs/%s", digest);
+        rename (sharded, flat);
+        zstr_free (&sharded);
+        zstr_free (&flat);
+        hydra_post_destroy (&post);
+    }
+    hydra_ledger_destroy (&ledger);
+    zsys_file_delete ("posts/blobs/layout");
+
+    ledger = hydra_ledger_new ();
+    start = zclock_usecs ();
+    hydra_ledger_load (ledger);
+    results [1] = (double) (zclock_usecs () - start) / size;
+    assert (hydra_ledger_size (ledger) == size);
+    hydra_ledger_destroy (&ledger);
+
+    ledger = hydra_ledger_new ();
+    start = zclock_usecs ();
+    hydra_ledger_load (ledger);
+    results [2] = (double) (zclock_usecs () - start) / size;
+    results [3] = (double) s_read_content (ledger) / SAMPLE_SIZE;
+    hydra_ledger_destroy (&ledger);
+}
+
+static void
+s_bench_layout (size_t *sizes, bool verbose)
+{
+    printf ("%10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "usec per",
+            "flat", "tree", "flat", "tree", "ledger", "ledger", "ledger", "ledger");
+    printf ("%10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "post",
+            "new", "new", "open", "open", "store", "migrate", "load", "read");
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        char **digests = (char **) zmalloc (sizeof (char *) * size);
+        size_t blob_nbr;
+        for (blob_nbr = 0; blob_nbr < size; blob_nbr++) {
+            digests [blob_nbr] = (char *) zmalloc (41);
+            uint char_nbr;
+            for (char_nbr = 0; char_nbr < 40; char_nbr++)
+                digests [blob_nbr][char_nbr] = "0123456789ABCDEF" [randof (16)];
+        }
+        double results [8];
+        uint layout;
+        for (layout = 0; layout < 2; layout++) {
+            s_scratch_enter ();
+            zsys_dir_create ("blobs");
+            results [layout] = (double) s_layout_create (digests, size, layout) / size;
+            results [layout + 2] = (double) s_layout_open (digests, size, layout) / SAMPLE_SIZE;
+            s_scratch_leave ();
+        }
+        s_scratch_enter ();
+        s_layout_ledger (size, results + 4);
+        s_scratch_leave ();
+        printf ("%10zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", size,
+                results [0], results [1], results [2], results [3],
+                results [4], results [5], results [6], results [7]);
+        for (blob_nbr = 0; blob_nbr < size; blob_nbr++)
+            free (digests [blob_nbr]);
+        free (digests);
+    }
+}
+
+static const size_t
+s_layout_sizes [] = { 10000, 100000, 1000000, 0 };
+
+
+//  Count the files the ledger uses
+
+static size_t
+s_count_files (void)
+{
+    zdir_t *dir = zdir_new ("posts", NULL);
+    size_t files = dir? zdir_count (dir): 0;
+    zdir_destroy (&dir);
+    return files;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Compact a ledger of posts into packs, and compare the files on disk and
+//  the time to read post content before and after.
+
+static void
+s_bench_pack (size_t *sizes, bool verbose)
+{
+    printf ("%10s %10s %10s %12s %12s %12s\n", "posts", "files", "packed",
+            "usec/pack", "usec/loose", "usec/packed");
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        s_scratch_enter ();
+        char **idents = (char **) zmalloc (sizeof (char *) * size);
+        hydra_ledger_t *ledger = hydra_ledger_new ();
+        s_ledger_grow (ledger, idents, size);
+        size_t loose_files = s_count_files ();
+        double loose = (double) s_read_content (ledger) / SAMPLE_SIZE;
+
+        int64_t start = zclock_usecs ();
+        while (hydra_ledger_compact (ledger, 0, 1) > 0) ;
+        double pack = (double) (zclock_usecs () - start) / size;
+        double packed = (double) s_read_content (ledger) / SAMPLE_SIZE;
+        printf ("%10zu %10zu %10zu %12.1f %12.1f %12.1f\n", size,
+                loose_files, s_count_files (), pack, loose, packed);
+
+        hydra_ledger_destroy (&ledger);
+        size_t post_nbr;
+        for (post_nbr = 0; post_nbr < size; post_nbr++)
+            free (idents [post_nbr]);
+        free (idents);
+        s_scratch_leave ();
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Time asking for each post's ID, against calculating it from the fields,
+//  and then storing the posts and loading them again by replaying the
+//  journal. Before we memoized post IDs, every ask was a SHA1. Loads on one
+//  thread, so the load time is comparable across hosts.
+
+static void
+s_bench_ident (size_t *sizes, bool verbose)
+{
+    printf ("%10s %12s %12s %12s %12s\n", "posts",
+            "nsec/sha1", "nsec/ask", "usec/store", "usec/load");
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        s_scratch_enter ();
+        hydra_post_t **posts = (hydra_post_t **) zmalloc (sizeof (hydra_post_t *) * size);
+        size_t post_nbr;
+        for (post_nbr = 0; post_nbr < size; post_nbr++) {
+            char *subject = zsys_sprintf ("Benchmark post %zu", post_nbr);
+            posts [post_nbr] = hydra_post_new (subject);
+            hydra_post_set_content (posts [post_nbr], subject);
+            zstr_free (&subject);
+        }
+        //  Verifying always calculates the ID; asking again then reuses it
+        int64_t start = zclock_usecs ();
+        for (post_nbr = 0; post_nbr < size; post_nbr++)
+            hydra_post_verify_ident (posts [post_nbr]);
+        int64_t sha1_usecs = zclock_usecs () - start;
+        start = zclock_usecs ();
+        for (post_nbr = 0; post_nbr < size; post_nbr++)
+            assert (hydra_post_ident (posts [post_nbr]));
+        int64_t ask_usecs = zclock_usecs () - start;
+
+        hydra_ledger_t *ledger = hydra_ledger_new ();
+        hydra_ledger_load (ledger);
+        start = zclock_usecs ();
+        for (post_nbr = 0; post_nbr < size; post_nbr++)
+            hydra_ledger_store (ledger, &posts [post_nbr]);
+        int64_t store_usecs = zclock_usecs () - start;
+        hydra_ledger_destroy (&ledger);
+        free (posts);
+
+        ledger = hydra_ledger_new ();
+        hydra_ledger_set_workers (ledger, 1);
+        start = zclock_usecs ();
+        hydra_ledger_load (ledger);
+        int64_t load_usecs = zclock_usecs () - start;
+        assert (hydra_ledger_size (ledger) == size);
+        hydra_ledger_destroy (&ledger);
+        s_scratch_leave ();
+
+        printf ("%10zu %12.1f %12.1f %12.2f %12.2f\n", size,
+                1000.0 * sha1_usecs / size, 1000.0 * ask_usecs / size,
+                (double) store_usecs / size, (double) load_usecs / size);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Pull a large post in small chunks, as a client does, first opening the
+//  content for each chunk with hydra_post_fetch, and then through a post
+//  reader that keeps it open, as the server's view cache does. Each ledger
+//  size is the number of chunks we pull; we wrap around the post when we
+//  reach its end.
+
+#define CHUNK_POST_SIZE     (16 * 1024 * 1024)
+#define CHUNK_SIZE          4096
+
+static void
+s_bench_chunks (size_t *sizes, bool verbose)
+{
+    printf ("%10s %12s %12s %12s %12s\n", "chunks",
+            "usec/open", "usec/view", "MB/s open", "MB/s view");
+    s_scratch_enter ();
+    byte *content = (byte *) malloc (CHUNK_POST_SIZE);
+    size_t byte_nbr;
+    for (byte_nbr = 0; byte_nbr < CHUNK_POST_SIZE; byte_nbr++)
+        content [byte_nbr] = (byte) byte_nbr;
+    hydra_post_t *post = hydra_post_new ("Chunked post");
+    hydra_post_set_data (post, content, CHUNK_POST_SIZE);
+    free (content);
+    int rc = hydra_post_save_content (post);
+    assert (rc == 0);
+
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        size_t chunk_nbr;
+        int64_t start = zclock_usecs ();
+        for (chunk_nbr = 0; chunk_nbr < size; chunk_nbr++) {
+            size_t offset = chunk_nbr * CHUNK_SIZE % CHUNK_POST_SIZE;
+            zchunk_t *chunk = hydra_post_fetch (post, CHUNK_SIZE, offset);
+            assert (chunk && zchunk_size (chunk) == CHUNK_SIZE);
+            zchunk_destroy (&chunk);
+        }
+        double opened = (double) (zclock_usecs () - start) / size;
+
+        start = zclock_usecs ();
+        hydra_post_reader_t *reader = hydra_post_reader_new (post, 0);
+        assert (reader);
+        for (chunk_nbr = 0; chunk_nbr < size; chunk_nbr++) {
+            size_t offset = chunk_nbr * CHUNK_SIZE % CHUNK_POST_SIZE;
+            zchunk_t *chunk = hydra_post_reader_fetch (reader, CHUNK_SIZE, offset);
+            assert (chunk && zchunk_size (chunk) == CHUNK_SIZE);
+            zchunk_destroy (&chunk);
+        }
+        hydra_post_reader_destroy (&reader);
+        double viewed = (double) (zclock_usecs () - start) / size;
+
+        printf ("%10zu %12.2f %12.2f %12.1f %12.1f\n", size, opened, viewed,
+                CHUNK_SIZE / opened, CHUNK_SIZE / viewed);
+    }
+    hydra_post_destroy (&post);
+    s_scratch_leave ();
+}
+
+
+//  --------------------------------------------------------------------------
+//  Send a large post as CHUNK OK messages over inproc, as the server does,
+//  and receive each one. First we copy each chunk out of the mapped content
+//  and the codec copies it again into the frame; then we send views of the
+//  mapped content, which the codec copies just once. Each ledger size is
+//  the number of chunks we send; we wrap around the post at its end.
+//  Reports throughput, and process CPU time per GB sent.
+
+#define SEND_POST_SIZE      (64 * 1024 * 1024)
+#define SEND_CHUNK_SIZE     (1024 * 1024)
+
+static double
+s_send_chunks (hydra_post_reader_t *reader, bool view, size_t chunks,
+               zsock_t *source, zsock_t *sink, double *cpu_per_gb)
+{
+    hydra_proto_t *message = hydra_proto_new ();
+    hydra_proto_set_id (message, HYDRA_PROTO_CHUNK_OK);
+    int64_t start = zclock_usecs ();
+    clock_t cpu_start = clock ();
+    size_t chunk_nbr;
+    for (chunk_nbr = 0; chunk_nbr < chunks; chunk_nbr++) {
+        size_t offset = chunk_nbr * SEND_CHUNK_SIZE % SEND_POST_SIZE;
+        zchunk_t *chunk = view
+            ? hydra_post_reader_view (reader, SEND_CHUNK_SIZE, offset)
+            : hydra_post_reader_fetch (reader, SEND_CHUNK_SIZE, offset);
+        assert (chunk && zchunk_size (chunk) == SEND_CHUNK_SIZE);
+        hydra_proto_set_offset (message, offset);
+        hydra_proto_set_content (message, &chunk);
+        hydra_proto_send (message, source);
+        zframe_t *frame = zframe_recv (sink);
+        assert (frame);
+        zframe_destroy (&frame);
+    }
+    double cpu = (double) (clock () - cpu_start) / CLOCKS_PER_SEC;
+    double usecs = (double) (zclock_usecs () - start);
+    hydra_proto_destroy (&message);
+
+    double bytes = (double) chunks * SEND_CHUNK_SIZE;
+    *cpu_per_gb = cpu / (bytes / (1024.0 * 1024 * 1024));
+    return bytes / usecs;           //  Bytes per usec is MB/s
+}
+
+static void
+s_bench_send (size_t *sizes, bool verbose)
+{
+    printf ("%10s %12s %12s %12s %12s\n", "chunks",
+            "MB/s copy", "MB/s view", "cpu/GB copy", "cpu/GB view");
+    s_scratch_enter ();
+    byte *content = (byte *) malloc (SEND_POST_SIZE);
+    size_t byte_nbr;
+    for (byte_nbr = 0; byte_nbr < SEND_POST_SIZE; byte_nbr++)
+        content [byte_nbr] = (byte) byte_nbr;
+    hydra_post_t *post = hydra_post_new ("Sent post");
+    hydra_post_set_data (post, content, SEND_POST_SIZE);
+    free (content);
+    int rc = hydra_post_save_content (post);
+    assert (rc == 0);
+    hydra_post_reader_t *reader = hydra_post_reader_new (post, 0);
+    assert (reader);
+    zsock_t *sink = zsock_new_pair ("@inproc://hydra-bench-send");
+    zsock_t *source = zsock_new_pair (">inproc://hydra-bench-send");
+    assert (sink && source);
+
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr];
+        double copy_cpu, view_cpu;
+        double copy_rate = s_send_chunks (reader, false, size, source, sink, &copy_cpu);
+        double view_rate = s_send_chunks (reader, true, size, source, sink, &view_cpu);
+        printf ("%10zu %12.1f %12.1f %12.3f %12.3f\n", size,
+                copy_rate, view_rate, copy_cpu, view_cpu);
+    }
+    zsock_destroy (&source);
+    zsock_destroy (&sink);
+    hydra_post_reader_destroy (&reader);
+    hydra_post_destroy (&post);
+    s_scratch_leave ();
+}
+
+
+//  --------------------------------------------------------------------------
+//  Bring a large file into the blob store two ways: hash it by pointing a
+//  post at it and then import it, which reads the file twice; and import it
+//  straight away, hashing as we copy. Each size is the file size in MB. The
+//  import hashes files of 4MB and more on a second thread, so small sizes
+//  show the serial import and large sizes the threaded one.
+
+static const size_t
+s_import_sizes [] = { 1, 16, 256, 0 };
+
+static double
+s_import_rate (const char *filename, size_t size, bool hash_first)
+{
+    int64_t start = zclock_usecs ();
+    hydra_post_t *post = hydra_post_new ("Imported post");
+    if (hash_first) {
+        int rc = hydra_post_set_file (post, filename);
+        assert (rc == 0);
+    }
+    int rc = hydra_post_import_file (post, filename);
+    assert (rc == 0);
+    assert (hydra_post_content_size (post) == size);
+    double rate = (double) size / (zclock_usecs () - start);
+
+    //  Drop the blob so the next run writes it again
+    zsys_file_delete (hydra_post_location (post));
+    hydra_post_destroy (&post);
+    return rate;
+}
+
+static void
+s_bench_import (size_t *sizes, bool verbose)
+{
+    printf ("%10s %14s %14s\n", "MB", "MB/s hash+copy", "MB/s import");
+    s_scratch_enter ();
+    byte *block = (byte *) malloc (65536);
+    uint size_nbr;
+    for (size_nbr = 0; sizes [size_nbr]; size_nbr++) {
+        size_t size = sizes [size_nbr] * 1024 * 1024;
+        FILE *output = fopen ("import.data", "wb");
+        assert (output);
+        size_t block_nbr;
+        for (block_nbr = 0; block_nbr < size / 65536; block_nbr++) {
+            size_t byte_nbr;
+            for (byte_nbr = 0; byte_nbr < 65536; byte_nbr++)
+                block [byte_nbr] = (byte) (byte_nbr * 7 + block_nbr);
+            size_t written = fwrite (block, 1, 65536, output);
+            assert (written == 65536);
+        }
+        fclose (output);
+        double hash_first = s_import_rate ("import.data", size, true);
+        double import = s_import_rate ("import.data", size, false);
+        printf ("%10zu %14.1f %14.1f\n", sizes [size_nbr], hash_first, import);
+        zsys_file_delete ("import.data");
+    }
+    free (block);
+    s_scratch_leave ();
+}
+
+static bench_item_t
+all_benches [] = {
+    { "index", "hydra_ledger_index lookup time vs. ledger size",
+      s_bench_index, NULL },
+    { "load", "hydra_ledger_load time, from snapshot and from journal",
+      s_bench_load, NULL },
+    { "fetch", "hydra_ledger_fetch time and cache hit rate on newest posts",
+      s_bench_fetch, NULL },
+    { "replay", "hydra_ledger_load journal replay, serial vs. parallel",
+      s_bench_replay, NULL },
+    { "store", "hydra_ledger_store time per post, single vs. batched",
+      s_bench_store, NULL },
+    { "layout", "blob and ledger times, flat vs. sharded, and migration",
+      s_bench_layout, s_layout_sizes },
+    { "pack", "files and content read time, before and after compaction",
+      s_bench_pack, NULL },
+    { "ident", "post ID asks vs. SHA1s, then store and load times",
+      s_bench_ident, NULL },
+    { "chunks", "content chunk fetch time, opening per chunk vs. open views",
+      s_bench_chunks, NULL },
+    { "send", "CHUNK OK throughput and CPU per GB, copied vs. viewed content",
+      s_bench_send, NULL },
+    { "import", "file import rate in MB, hash then copy vs. one pass",
+      s_bench_import, s_import_sizes },
+    { NULL, NULL, NULL, NULL }  //  Sentinel
+};
+
+
+int main (int argc, char *argv [])
+{
+    bool verbose = false;
+    int argn = 1;
+    if (argn < argc && streq (argv [argn], "-v")) {
+        verbose = true;
+        argn++;
+    }
+    if (argn >= argc || streq (argv [argn], "-h")) {
+        puts ("syntax: hydra_bench [-v] benchmark [ledger-size ...]");
+        bench_item_t *item;
+        for (item = all_benches; item->name; item++)
+            printf (" %-10s = %s\n", item->name, item->description);
+        return 0;
+    }
+    bench_item_t *item;
+    for (item = all_benches; item->name; item++)
+        if (streq (argv [argn], item->name))
+            break;
+    if (!item->name) {
+        puts ("Invalid benchmark, run hydra_bench -h to see benchmarks");
+        return 1;
+    }
+    argn++;
+
+    //  Remaining arguments are ledger sizes, or whatever sizes the benchmark
+    //  works with; zero-terminated list
+    size_t sizes [16] = { 1000, 10000, 100000, 0 };
+    if (argn < argc) {
+        uint size_nbr = 0;
+        while (argn < argc && size_nbr < 15)
+            sizes [size_nbr++] = atol (argv [argn++]);
+        sizes [size_nbr] = 0;
+    }
+    else
+    if (item->sizes) {
+        uint size_nbr = 0;
+        while (item->sizes [size_nbr] && size_nbr < 15) {
+            sizes [size_nbr] = item->sizes [size_nbr];
+            size_nbr++;
+        }
+        sizes [size_nbr] = 0;
+    }
+    //  The ledger logs every post it stores, which would swamp the timings
+    if (!verbose)
+        zsys_set_logstream (NULL);
+    printf ("Running hydra benchmark '%s'...\n", item->name);
+    item->bench (sizes, verbose);
+    return 0;
+}
@@ -0,0 +1,506 @@
+/*  =========================================================================
+    hydra_blobs - content-addressed store of post content
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The blob store holds post content in posts/blobs, one file per distinct
+    content, named by its SHA1 digest. Posts with the same content share a
+    blob, so storing a post whose content we already hold writes nothing.
+@discuss
+    Blobs are spread over 256 directories named by the first two hex digits
+    of their digest, so no directory gets very large. We write each blob in
+    posts/staging and rename it into place, so a blob is either complete or
+    absent, and we never write a blob that already exists.
+
+    The store counts the posts using each blob, so that we delete a blob
+    only when the last post using it goes. The counts live in memory; the
+    ledger builds them from its posts the first time it needs them.
+    Content files outside posts/blobs belong to the application, and the
+    store neither counts nor deletes them.
+
+    To import a file we copy it into posts/staging, hashing each block as
+    we copy it, and name the blob when we reach the end, so we read the
+    file only once. SHA1 has to run over the content in order, so we can't
+    split the hash across cores; for a large file, a worker thread hashes
+    each block while we read and write the next, and the import takes as
+    long as the slower of the two rather than both.
+@end
+*/
+
+#include "hydra_classes.h"
+
+#define BLOBS_DIR       "posts/blobs/"
+#define BLOB_FILE       BLOBS_DIR "%.2s/%s"
+#define STAGING_DIR     "posts/staging"
+#define DIGEST_SIZE     40          //  SHA1 digest as text string
+#define COPY_BLOCK      65536       //  Bytes copied at once from a stream
+#define IMPORT_BLOCK    1048576     //  Bytes per block when hashing in parallel
+#define IMPORT_BLOCKS   4           //  Blocks in flight when hashing in parallel
+
+//  Structure of our class
+
+struct _hydra_blobs_t {
+    zhashx_t *refs;             //  Posts using each blob, by digest
+};
+
+
+//  --------------------------------------------------------------------------
+//  Create a new blob store, holding no references. Tell it about the posts
+//  that use each blob with hydra_blobs_ref.
+
+hydra_blobs_t *
+hydra_blobs_new (void)
+{
+    hydra_blobs_t *self = (hydra_blobs_t *) zmalloc (sizeof (hydra_blobs_t));
+    if (self)
+        self->refs = zhashx_new ();
+    if (!self->refs)
+        hydra_blobs_destroy (&self);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy the blob store. Does not touch the blobs on disk.
+
+void
+hydra_blobs_destroy (hydra_blobs_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        hydra_blobs_t *self = *self_p;
+        zhashx_destroy (&self->refs);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return true if the store has the blob with the specified content digest,
+//  as 40 hex characters. Looks for the blob on disk, as posts may still use
+//  a blob that the ledger moved aside as damaged.
+
+bool
+hydra_blobs_has (hydra_blobs_t *self, const char *digest)
+{
+    assert (self);
+    assert (digest);
+    char *location = hydra_blobs_location (digest);
+    bool exists = zsys_file_exists (location);
+    zstr_free (&location);
+    return exists;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add a reference to the blob with the specified digest
+
+void
+hydra_blobs_ref (hydra_blobs_t *self, const char *digest)
+{
+    assert (self);
+    assert (digest);
+    size_t refs = (size_t) zhashx_lookup (self->refs, digest);
+    if (refs)
+        zhashx_update (self->refs, digest, (void *) (refs + 1));
+    else
+        zhashx_insert (self->refs, digest, (void *) (size_t) 1);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Drop a reference to the blob with the specified digest, and delete the
+//  blob if that was the last one. Returns the references left.
+
+size_t
+hydra_blobs_unref (hydra_blobs_t *self, const char *digest)
+{
+    assert (self);
+    assert (digest);
+    size_t refs = (size_t) zhashx_lookup (self->refs, digest);
+    if (refs > 1) {
+        zhashx_update (self->refs, digest, (void *) (refs - 1));
+        return refs - 1;
+    }
+    zhashx_delete (self->refs, digest);
+    char *location = hydra_blobs_location (digest);
+    zsys_file_delete (location);
+    zstr_free (&location);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of references to the blob with the specified digest
+
+size_t
+hydra_blobs_refs (hydra_blobs_t *self, const char *digest)
+{
+    assert (self);
+    assert (digest);
+    return (size_t) zhashx_lookup (self->refs, digest);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of blobs with at least one reference
+
+size_t
+hydra_blobs_size (hydra_blobs_t *self)
+{
+    assert (self);
+    return zhashx_size (self->refs);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Move a fully written blob from posts/staging into place. Returns 0 if
+//  OK, -1 if that failed, in which case deletes the staged file.
+
+static int
+s_publish_blob (const char *staged, const char *digest)
+{
+    char *location = hydra_blobs_location (digest);
+    int rc = hydra_util_file_rename (staged, location);
+    //  The blob's directory may not exist yet
+    if (rc && errno == ENOENT) {
+        zsys_dir_create (BLOBS_DIR "%.2s", digest);
+        rc = hydra_util_file_rename (staged, location);
+    }
+    if (rc)
+        remove (staged);
+    zstr_free (&location);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Write content to disk as the blob with the specified digest, unless that
+//  blob already exists. The blob is written in posts/staging and renamed
+//  into place, so it is either complete or absent. Returns 0 if the blob is
+//  now on disk, -1 if it could not be written.
+
+int
+hydra_blobs_insert (const char *digest, zchunk_t *content)
+{
+    assert (digest);
+    assert (content);
+    char *location = hydra_blobs_location (digest);
+    bool exists = zsys_file_exists (location);
+    zstr_free (&location);
+    if (exists)
+        return 0;
+
+    zsys_dir_create (STAGING_DIR);
+    char *staged = zsys_sprintf (STAGING_DIR "/%s", digest);
+    FILE *output = fopen (staged, "wb");
+    int rc = output? zchunk_write (content, output): -1;
+    if (output && fclose (output))
+        rc = -1;
+    if (rc == 0)
+        rc = s_publish_blob (staged, digest);
+    else
+        remove (staged);
+    zstr_free (&staged);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Copy the next size bytes of the input stream into the blob with the
+//  specified digest, checking the content against the digest as we go.
+//  The blob is written in posts/staging and renamed into place, replacing
+//  any blob already there. Returns 0 if OK, -1 if the input was short or
+//  did not match the digest, or the blob could not be written.
+
+int
+hydra_blobs_copy (const char *digest, FILE *input, size_t size)
+{
+    assert (digest);
+    assert (input);
+    zsys_dir_create (STAGING_DIR);
+    char *staged = zsys_sprintf (STAGING_DIR "/%s", digest);
+    FILE *output = fopen (staged, "wb");
+    int rc = output? 0: -1;
+    zdigest_t *check = zdigest_new ();
+    byte *buffer = (byte *) malloc (COPY_BLOCK);
+    while (rc == 0 && size) {
+        size_t bytes = fread (buffer, 1, size < COPY_BLOCK? size: COPY_BLOCK, input);
+        if (bytes == 0
+        ||  fwrite (buffer, 1, bytes, output) != bytes)
+            rc = -1;
+        zdigest_update (check, buffer, bytes);
+        size -= bytes;
+    }
+    if (rc == 0 && strcmp (zdigest_string (check), digest))
+        rc = -1;
+    free (buffer);
+    zdigest_destroy (&check);
+    if (output && fclose (output))
+        rc = -1;
+    if (rc == 0)
+        rc = s_publish_blob (staged, digest);
+    else
+        remove (staged);
+    zstr_free (&staged);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Hash worker for parallel imports. Hashes each block we send it, in
+//  order, and signals when done with it, until we send an empty block.
+
+static void
+s_import_hasher (zsock_t *pipe, void *args)
+{
+    zdigest_t *digest = (zdigest_t *) args;
+    zsock_signal (pipe, 0);
+    while (true) {
+        void *block;
+        uint64_t size;
+        if (zsock_recv (pipe, "p8", &block, &size) || size == 0)
+            break;
+        zdigest_update (digest, (byte *) block, (size_t) size);
+        zsock_signal (pipe, 0);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Copy the rest of the input stream into the store as a new blob, hashing
+//  it as we go, so we read the input only once. If parallel, hashes on a
+//  worker thread while we copy, which is faster for large inputs. Stores
+//  the content size in *size_p. Returns the digest of the blob, or NULL if
+//  the input could not be read or the blob could not be written. If the
+//  store already has the blob, we drop the copy. The caller must free the
+//  returned string.
+
+char *
+hydra_blobs_import (FILE *input, bool parallel, size_t *size_p)
+{
+    assert (input);
+    assert (size_p);
+    zsys_dir_create (STAGING_DIR);
+    zuuid_t *uuid = zuuid_new ();
+    char *staged = zsys_sprintf (STAGING_DIR "/%s", zuuid_str (uuid));
+    zuuid_destroy (&uuid);
+    FILE *output = fopen (staged, "wb");
+    int rc = output? 0: -1;
+    zdigest_t *digest = zdigest_new ();
+    zactor_t *hasher = parallel? zactor_new (s_import_hasher, digest): NULL;
+
+    //  The hasher may still be reading a block, so we cycle through a few
+    //  and wait for it before reusing one
+    size_t block_size = hasher? IMPORT_BLOCK: COPY_BLOCK;
+    size_t blocks = hasher? IMPORT_BLOCKS: 1;
+    byte *buffer = (byte *) malloc (block_size * blocks);
+    size_t block_nbr = 0;
+    size_t in_flight = 0;
+    *size_p = 0;
+    while (rc == 0) {
+        byte *block = buffer + block_nbr * block_size;
+        if (in_flight == blocks) {
+            zsock_wait (hasher);
+            in_flight--;
+        }
+        size_t bytes = fread (block, 1, block_size, input);
+        if (bytes == 0)
+            break;
+        if (fwrite (block, 1, bytes, output) != bytes)
+            rc = -1;
+        if (hasher) {
+            zsock_send (hasher, "p8", block, (uint64_t) bytes);
+            in_flight++;
+        }
+        else
+            zdigest_update (digest, block, bytes);
+        *size_p += bytes;
+        block_nbr = (block_nbr + 1) % blocks;
+    }
+    if (ferror (input))
+        rc = -1;
+    if (hasher) {
+        while (in_flight--)
+            zsock_wait (hasher);
+        zsock_send (hasher, "p8", NULL, (uint64_t) 0);
+        zactor_destroy (&hasher);
+    }
+    free (buffer);
+    if (output && fclose (output))
+        rc = -1;
+
+    char *result = NULL;
+    if (rc == 0) {
+        result = strdup (zdigest_string (digest));
+        char *location = hydra_blobs_location (result);
+        if (zsys_file_exists (location))
+            remove (staged);
+        else
+        if (s_publish_blob (staged, result))
+            zstr_free (&result);
+        zstr_free (&location);
+    }
+    else
+        remove (staged);
+    zdigest_destroy (&digest);
+    zstr_free (&staged);
+    return result;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the filename of the blob with the specified digest. The caller
+//  must free the returned string.
+
+char *
+hydra_blobs_location (const char *digest)
+{
+    assert (digest);
+    return zsys_sprintf (BLOB_FILE, digest, digest);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the digest of the blob at the specified location, or NULL if the
+//  location is not a blob in the store. The digest points into the location.
+
+const char *
+hydra_blobs_digest (const char *location)
+{
+    if (!location || strncmp (location, BLOBS_DIR, strlen (BLOBS_DIR)))
+        return NULL;
+    const char *digest = location + strlen (BLOBS_DIR) + 3;
+    if (strlen (location) != strlen (BLOBS_DIR) + 3 + DIGEST_SIZE
+    ||  strncmp (location + strlen (BLOBS_DIR), digest, 2)
+    ||  digest [-1] != '/')
+        return NULL;
+    return digest;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+hydra_blobs_test (bool verbose)
+{
+    printf (" * hydra_blobs: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zsys_dir_create (".hydra_test");
+    zsys_dir_change (".hydra_test");
+
+    const char *digest = "2AAE6C35C94FCFB415DBE95F408B9CE91EE846ED";
+    char *location = hydra_blobs_location (digest);
+    assert (streq (location, "posts/blobs/2A/2AAE6C35C94FCFB415DBE95F408B9CE91EE846ED"));
+    assert (hydra_blobs_digest (location) == location + 15);
+    assert (hydra_blobs_digest ("posts/blobs/2AAE6C35C94FCFB415DBE95F408B9CE91EE846ED") == NULL);
+    assert (hydra_blobs_digest ("photos/holiday.jpg") == NULL);
+    assert (hydra_blobs_digest (NULL) == NULL);
+
+    hydra_blobs_t *blobs = hydra_blobs_new ();
+    assert (blobs);
+    assert (!hydra_blobs_has (blobs, digest));
+
+    //  Insert the blob and check it is there
+    zchunk_t *content = zchunk_new ("hello world", 11);
+    assert (hydra_blobs_insert (digest, content) == 0);
+    zchunk_destroy (&content);
+    assert (zsys_file_exists (location));
+    assert (hydra_blobs_has (blobs, digest));
+    hydra_blobs_ref (blobs, digest);
+
+    //  Inserting the same blob again does not write it, so leaves a file
+    //  we changed on disk as it was
+    FILE *handle = fopen (location, "ab");
+    assert (handle);
+    fputs ("!", handle);
+    fclose (handle);
+    content = zchunk_new ("hello world", 11);
+    assert (hydra_blobs_insert (digest, content) == 0);
+    zchunk_destroy (&content);
+    zfile_t *file = zfile_new (NULL, location);
+    assert (zfile_cursize (file) == 12);
+    zfile_destroy (&file);
+    hydra_blobs_ref (blobs, digest);
+    assert (hydra_blobs_refs (blobs, digest) == 2);
+    assert (hydra_blobs_size (blobs) == 1);
+
+    //  The blob goes when its last reference does
+    assert (hydra_blobs_unref (blobs, digest) == 1);
+    assert (zsys_file_exists (location));
+    assert (hydra_blobs_unref (blobs, digest) == 0);
+    assert (!zsys_file_exists (location));
+    assert (!hydra_blobs_has (blobs, digest));
+    assert (hydra_blobs_size (blobs) == 0);
+
+    //  Copy the blob from a stream, which must hold the right content
+    handle = fopen ("stream", "w+b");
+    assert (handle);
+    fputs ("hello world!", handle);
+    rewind (handle);
+    assert (hydra_blobs_copy (digest, handle, 11) == 0);
+    assert (fgetc (handle) == '!');
+    assert (zsys_file_exists (location));
+    rewind (handle);
+    assert (hydra_blobs_copy ("0000000000000000000000000000000000000000", handle, 11) == -1);
+    rewind (handle);
+    assert (hydra_blobs_copy (digest, handle, 20) == -1);
+    fclose (handle);
+    assert (!zsys_file_exists ("posts/staging/0000000000000000000000000000000000000000"));
+    assert (!zsys_file_exists ("posts/blobs/00/0000000000000000000000000000000000000000"));
+
+    //  Import a stream as a new blob, hashing it as we copy it, serially
+    //  and in parallel; importing content we have already drops the copy
+    handle = fopen ("stream", "w+b");
+    assert (handle);
+    size_t byte_nbr;
+    for (byte_nbr = 0; byte_nbr < 3 * 1048576 + 100; byte_nbr++)
+        fputc ((byte) (byte_nbr * 7), handle);
+    rewind (handle);
+    size_t size;
+    char *imported = hydra_blobs_import (handle, false, &size);
+    assert (imported);
+    assert (size == 3 * 1048576 + 100);
+    char *imported_location = hydra_blobs_location (imported);
+    assert (zsys_file_size (imported_location) == (ssize_t) size);
+    rewind (handle);
+    char *parallel = hydra_blobs_import (handle, true, &size);
+    assert (parallel);
+    assert (streq (parallel, imported));
+    assert (size == 3 * 1048576 + 100);
+    fclose (handle);
+    zdir_t *staging = zdir_new ("posts/staging", NULL);
+    assert (staging);
+    assert (zdir_count (staging) == 0);
+    zdir_destroy (&staging);
+    zstr_free (&imported_location);
+    zstr_free (&imported);
+    zstr_free (&parallel);
+
+    zstr_free (&location);
+    hydra_blobs_destroy (&blobs);
+
+    //  Delete the test directory
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (".hydra_test", NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,97 @@
+/*  =========================================================================
+    hydra_blobs - content-addressed store of post content
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef HYDRA_BLOBS_H_INCLUDED
+#define HYDRA_BLOBS_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new blob store, holding no references. Tell it about the posts
+//  that use each blob with hydra_blobs_ref.
+HYDRA_PRIVATE hydra_blobs_t *
+    hydra_blobs_new (void);
+
+//  Destroy the blob store. Does not touch the blobs on disk.
+HYDRA_PRIVATE void
+    hydra_blobs_destroy (hydra_blobs_t **self_p);
+
+//  Return true if the store has the blob with the specified content digest,
+//  as 40 hex characters. Looks for the blob on disk, as posts may still use
+//  a blob that the ledger moved aside as damaged.
+HYDRA_PRIVATE bool
+    hydra_blobs_has (hydra_blobs_t *self, const char *digest);
+
+//  Add a reference to the blob with the specified digest
+HYDRA_PRIVATE void
+    hydra_blobs_ref (hydra_blobs_t *self, const char *digest);
+
+//  Drop a reference to the blob with the specified digest, and delete the
+//  blob if that was the last one. Returns the references left.
+HYDRA_PRIVATE size_t
+    hydra_blobs_unref (hydra_blobs_t *self, const char *digest);
+
+//  Return the number of references to the blob with the specified digest
+HYDRA_PRIVATE size_t
+    hydra_blobs_refs (hydra_blobs_t *self, const char *digest);
+
+//  Return the number of blobs with at least one reference
+HYDRA_PRIVATE size_t
+    hydra_blobs_size (hydra_blobs_t *self);
+
+//  Write content to disk as the blob with the specified digest, unless that
+//  blob already exists. The blob is written in posts/staging and renamed
+//  into place, so it is either complete or absent. Returns 0 if the blob is
+//  now on disk, -1 if it could not be written.
+HYDRA_PRIVATE int
+    hydra_blobs_insert (const char *digest, zchunk_t *content);
+
+//  Copy the next size bytes of the input stream into the blob with the
+//  specified digest, checking the content against the digest as we go.
+//  The blob is written in posts/staging and renamed into place, replacing
+//  any blob already there. Returns 0 if OK, -1 if the input was short or
+//  did not match the digest, or the blob could not be written.
+HYDRA_PRIVATE int
+    hydra_blobs_copy (const char *digest, FILE *input, size_t size);
+
+//  Copy the rest of the input stream into the store as a new blob, hashing
+//  it as we go, so we read the input only once. If parallel, hashes on a
+//  worker thread while we copy, which is faster for large inputs. Stores
+//  the content size in *size_p. Returns the digest of the blob, or NULL if
+//  the input could not be read or the blob could not be written. If the
+//  store already has the blob, we drop the copy. The caller must free the
+//  returned string.
+HYDRA_PRIVATE char *
+    hydra_blobs_import (FILE *input, bool parallel, size_t *size_p);
+
+//  Return the filename of the blob with the specified digest. The caller
+//  must free the returned string.
+HYDRA_PRIVATE char *
+    hydra_blobs_location (const char *digest);
+
+//  Return the digest of the blob at the specified location, or NULL if the
+//  location is not a blob in the store. The digest points into the location.
+HYDRA_PRIVATE const char *
+    hydra_blobs_digest (const char *location);
+
+//  Self test of this class
+HYDRA_PRIVATE void
+    hydra_blobs_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
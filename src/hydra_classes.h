@@ -26,8 +26,50 @@
 //  Extra headers
 
 //  Opaque class structures to allow forward references
+#ifndef HYDRA_UTIL_T_DEFINED
+typedef struct _hydra_util_t hydra_util_t;
+#define HYDRA_UTIL_T_DEFINED
+#endif
+
+#ifndef HYDRA_JOURNAL_T_DEFINED
+typedef struct _hydra_journal_t hydra_journal_t;
+#define HYDRA_JOURNAL_T_DEFINED
+#endif
+
+#ifndef HYDRA_SNAPSHOT_T_DEFINED
+typedef struct _hydra_snapshot_t hydra_snapshot_t;
+#define HYDRA_SNAPSHOT_T_DEFINED
+#endif
+
+#ifndef HYDRA_BLOBS_T_DEFINED
+typedef struct _hydra_blobs_t hydra_blobs_t;
+#define HYDRA_BLOBS_T_DEFINED
+#endif
+
+#ifndef HYDRA_PACK_T_DEFINED
+typedef struct _hydra_pack_t hydra_pack_t;
+#define HYDRA_PACK_T_DEFINED
+#endif
+
+#ifndef HYDRA_WORDS_T_DEFINED
+typedef struct _hydra_words_t hydra_words_t;
+#define HYDRA_WORDS_T_DEFINED
+#endif
+
+#ifndef HYDRA_VIEWS_T_DEFINED
+typedef struct _hydra_views_t hydra_views_t;
+#define HYDRA_VIEWS_T_DEFINED
+#endif
 
 //  Internal API
+#include "hydra_util.h"
+#include "hydra_journal.h"
+#include "hydra_snapshot.h"
+#include "hydra_blobs.h"
+#include "hydra_pack.h"
+#include "hydra_words.h"
+#include "hydra_views.h"
+#include "hydra_post_private.h"
 
 
 //  *** To avoid double-definitions, only define if building without draft ***
@@ -47,6 +47,7 @@ typedef struct {
     const char *newest;         //  Newest post from peer
     size_t chunk_offset;        //  For fetching post content in chunks
     zsock_t *sink;              //  Where we send posts to be stored
+    zsock_t *lookup;            //  Where we ask if we already have a post
     size_t received;            //  Number of posts received
 } client_t;
 
@@ -56,6 +57,9 @@ typedef struct {
 //  Maximum size of chunks we fetch, 1MB seems fair over WiFi
 #define CHUNK_SIZE 1024 * 1024 * 10
 
+//  How long we wait for the server to answer a ledger lookup, in msecs
+#define LOOKUP_TIMEOUT 1000
+
 //  Allocate properties and structures for a new client instance.
 //  Return 0 if OK, -1 if failed
 
@@ -74,6 +78,12 @@ client_initialize (client_t *self)
     int rc = zsock_connect (self->sink, "inproc://%s", self->identity);
     assert (rc == 0);
 
+    //  Create and connect lookup socket, to query the server's ledger
+    self->lookup = zsock_new (ZMQ_DEALER);
+    zsock_set_rcvtimeo (self->lookup, LOOKUP_TIMEOUT);
+    rc = zsock_connect (self->lookup, "inproc://%s-ledger", self->identity);
+    assert (rc == 0);
+
     //  We'll ping the server once per second
     self->heartbeat_timer = 1000;
     
@@ -89,6 +99,7 @@ client_terminate (client_t *self)
     zconfig_destroy (&self->peer_config);
     hydra_post_destroy (&self->post);
     zsock_destroy (&self->sink);
+    zsock_destroy (&self->lookup);
 }
 
 
@@ -276,14 +287,27 @@ use_this_post_as_newest (client_t *self)
 static void
 skip_post_if_duplicate (client_t *self)
 {
-    //  What's the resolution here? Could we use a ledger actor and talk to
-    //  it directly via dealer-router?
-    //  This is the most brute-force solution I could think of
-    hydra_ledger_t *ledger = hydra_ledger_new ();
-    hydra_ledger_load (ledger);
-    if (hydra_ledger_index (ledger, hydra_proto_ident (self->message)) >= 0)
-        engine_set_exception (self, duplicate_event);
-    hydra_ledger_destroy (&ledger);
+    //  Ask the server, which holds the node's one live ledger. If it does
+    //  not answer in time we fetch the post anyway; storing a duplicate is
+    //  harmless. We match replies on post ID to discard any late answer to
+    //  an earlier lookup.
+    const char *post_ident = hydra_proto_ident (self->message);
+    zsock_send (self->lookup, "ss", "INDEX", post_ident);
+    while (true) {
+        char *reply_ident;
+        int index;
+        if (zsock_recv (self->lookup, "si", &reply_ident, &index))
+            break;              //  Timed out, or interrupted
+        bool matched = streq (reply_ident, post_ident);
+        zstr_free (&reply_ident);
+        if (matched) {
+            //  We skip posts we hold, and posts we evicted (-2), which the
+            //  ledger would refuse anyway
+            if (index != -1)
+                engine_set_exception (self, duplicate_event);
+            break;
+        }
+    }
 }
 
 
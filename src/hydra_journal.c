@@ -0,0 +1,607 @@
+/*  =========================================================================
+    hydra_journal - append-only journal of ledger records
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    A journal is a single file of variable-sized binary records, which we
+    only ever append to. The ledger uses it to hold post metadata, so a
+    node with many posts needs one file and one sequential read at startup,
+    instead of one file and one parse per post.
+@discuss
+    The file starts with an 8-byte header, "HYDRA" + 'J' + a 2-byte format
+    version. Each record is a 4-byte payload size, a 4-byte CRC-32 of the
+    payload, and the payload, with numbers in network byte order. A record
+    is identified by its offset in the file.
+
+    When we replay the journal and hit a record that is truncated or fails
+    its checksum, and it is the last record in the file, we assume a crash
+    cut the last write short. We stop the replay there, and truncate the
+    file at that point before the next append, so new records follow the
+    last good one. A journal that is only read, never appended to, is never
+    modified.
+
+    A damaged record with good records after it is not a torn write, and we
+    must not cut those records off. If its size leads to a good record, we
+    skip it and replay on. If not, we cannot tell where the next record
+    starts, so we stop the replay there and refuse to append until someone
+    repairs the file.
+@end
+*/
+
+#include "hydra_classes.h"
+#if !defined (__WINDOWS__)
+#   include <sys/file.h>
+#endif
+
+#define JOURNAL_HEADER      "HYDRAJ\x00\x01"
+#define JOURNAL_HEADER_SIZE 8
+#define RECORD_HEADER_SIZE  8
+#define RECORD_MAX_SIZE     (16 * 1024 * 1024)
+
+//  Structure of our class
+
+struct _hydra_journal_t {
+    char *filename;             //  Journal filename
+    FILE *handle;               //  Open file handle, read and write
+    int64_t size;               //  Current file size, i.e. append offset
+    int64_t cursor;             //  Offset of next record to replay
+    int64_t current;            //  Offset of last record replayed
+    bool damaged;               //  Damaged tail must be cut before append
+    int64_t broken;             //  Offset of damage we cannot skip, or 0
+    bool buffered;              //  Hold appends until next flush or sync
+    bool appending;             //  File position is at end of last append
+};
+
+
+//  --------------------------------------------------------------------------
+//  CRC-32 (IEEE 802.3) over a block of data, table-driven
+
+static uint32_t s_crc_table [256];
+
+static void
+s_crc_table_init (void)
+{
+    if (s_crc_table [1])
+        return;                 //  Already initialized
+    uint32_t value;
+    for (value = 0; value < 256; value++) {
+        uint32_t crc = value;
+        int bit;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 1)? 0xEDB88320 ^ (crc >> 1): crc >> 1;
+        s_crc_table [value] = crc;
+    }
+}
+
+uint32_t
+hydra_journal_checksum (const byte *data, size_t size)
+{
+    s_crc_table_init ();
+    uint32_t crc = 0xFFFFFFFF;
+    while (size--)
+        crc = s_crc_table [(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Truncate the journal file at the specified offset
+
+static int
+s_journal_truncate (hydra_journal_t *self, int64_t offset)
+{
+    fflush (self->handle);
+    self->appending = false;
+#if defined (__WINDOWS__)
+    int rc = _chsize_s (_fileno (self->handle), offset);
+#else
+    int rc = ftruncate (fileno (self->handle), (off_t) offset);
+#endif
+    if (rc == 0)
+        self->size = offset;
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new journal instance, opening or creating the specified file.
+//  Returns NULL if the file could not be opened, is not a journal, or is
+//  already open in another journal instance.
+
+hydra_journal_t *
+hydra_journal_new (const char *filename)
+{
+    assert (filename);
+    FILE *handle = fopen (filename, "r+b");
+    if (!handle)
+        handle = fopen (filename, "w+b");
+    if (!handle)
+        return NULL;
+#if !defined (__WINDOWS__)
+    //  Only one journal instance may own the file, across processes and
+    //  within one process, as two appenders would corrupt it
+    if (flock (fileno (handle), LOCK_EX | LOCK_NB)) {
+        zsys_error ("hydra_journal: %s is in use", filename);
+        fclose (handle);
+        return NULL;
+    }
+#endif
+    hydra_journal_t *self = (hydra_journal_t *) zmalloc (sizeof (hydra_journal_t));
+    self->filename = strdup (filename);
+    self->handle = handle;
+    fseek (self->handle, 0, SEEK_END);
+    self->size = ftell (self->handle);
+
+    if (self->size == 0) {
+        //  New journal, so write header
+        if (fwrite (JOURNAL_HEADER, 1, JOURNAL_HEADER_SIZE, self->handle) != JOURNAL_HEADER_SIZE
+        ||  hydra_journal_sync (self))
+            hydra_journal_destroy (&self);
+        else
+            self->size = JOURNAL_HEADER_SIZE;
+    }
+    else {
+        char header [JOURNAL_HEADER_SIZE];
+        fseek (self->handle, 0, SEEK_SET);
+        if (fread (header, 1, JOURNAL_HEADER_SIZE, self->handle) != JOURNAL_HEADER_SIZE
+        ||  memcmp (header, JOURNAL_HEADER, JOURNAL_HEADER_SIZE)) {
+            zsys_error ("hydra_journal: %s is not a valid journal", filename);
+            hydra_journal_destroy (&self);
+        }
+    }
+    if (self)
+        self->cursor = JOURNAL_HEADER_SIZE;
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy the journal, flushing any pending writes
+
+void
+hydra_journal_destroy (hydra_journal_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        hydra_journal_t *self = *self_p;
+        if (self->handle)
+            fclose (self->handle);
+        free (self->filename);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Append a record to the journal. Returns the offset of the new record,
+//  or -1 if the write failed. Unless the journal is buffered, the record is
+//  visible to other readers of the file when this returns, but is not
+//  durable on disk until you call hydra_journal_sync.
+
+int64_t
+hydra_journal_append (hydra_journal_t *self, zchunk_t *record)
+{
+    assert (self);
+    assert (record);
+    size_t size = zchunk_size (record);
+    assert (size <= RECORD_MAX_SIZE);
+
+    byte header [RECORD_HEADER_SIZE];
+    hydra_util_put_number4 (header, (uint32_t) size);
+    hydra_util_put_number4 (header + 4, hydra_journal_checksum (zchunk_data (record), size));
+
+    if (self->broken) {
+        zsys_error ("hydra_journal: %s is damaged at offset=%ld, repair it before writing",
+                    self->filename, (long) self->broken);
+        return -1;
+    }
+    if (self->damaged) {
+        if (s_journal_truncate (self, self->size))
+            return -1;
+        self->damaged = false;
+    }
+    //  Seeking would flush any buffered records, so we only seek if we've
+    //  read since we last appended
+    int64_t offset = self->size;
+    if ((!self->appending && fseek (self->handle, (long) offset, SEEK_SET))
+    ||  fwrite (header, 1, RECORD_HEADER_SIZE, self->handle) != RECORD_HEADER_SIZE
+    ||  fwrite (zchunk_data (record), 1, size, self->handle) != size
+    ||  (!self->buffered && fflush (self->handle))) {
+        zsys_error ("hydra_journal: cannot write %s: %s", self->filename, strerror (errno));
+        //  Drop whatever part of the record made it to disk
+        self->damaged = true;
+        self->appending = false;
+        return -1;
+    }
+    self->appending = true;
+    self->size = offset + RECORD_HEADER_SIZE + size;
+    return offset;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Hold appended records in memory until the next flush or sync, rather
+//  than writing each one through to the file as it is appended. Use this
+//  to write a batch of records with as few system calls as possible.
+
+void
+hydra_journal_set_buffered (hydra_journal_t *self, bool buffered)
+{
+    assert (self);
+    self->buffered = buffered;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Write any records held in memory through to the file, so other readers
+//  of the file can see them. Returns 0 if OK, -1 if that failed, in which
+//  case some of the records appended since the last flush may be lost.
+
+int
+hydra_journal_flush (hydra_journal_t *self)
+{
+    assert (self);
+    if (fflush (self->handle)) {
+        zsys_error ("hydra_journal: cannot write %s: %s", self->filename, strerror (errno));
+        self->damaged = true;
+        return -1;
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Read the record at the specified offset. Returns a new chunk holding the
+//  record payload, or NULL if there is no valid record at that offset.
+
+zchunk_t *
+hydra_journal_read (hydra_journal_t *self, int64_t offset)
+{
+    assert (self);
+    if (offset < JOURNAL_HEADER_SIZE || offset + RECORD_HEADER_SIZE > self->size)
+        return NULL;
+
+    byte header [RECORD_HEADER_SIZE];
+    self->appending = false;
+    if (fseek (self->handle, (long) offset, SEEK_SET)
+    ||  fread (header, 1, RECORD_HEADER_SIZE, self->handle) != RECORD_HEADER_SIZE)
+        return NULL;
+
+    size_t size = hydra_util_get_number4 (header);
+    if (size > RECORD_MAX_SIZE || offset + RECORD_HEADER_SIZE + (int64_t) size > self->size)
+        return NULL;
+
+    zchunk_t *record = zchunk_new (NULL, size);
+    if (fread (zchunk_data (record), 1, size, self->handle) != size
+    ||  hydra_journal_checksum (zchunk_data (record), size) != hydra_util_get_number4 (header + 4))
+        zchunk_destroy (&record);
+    else
+        zchunk_set (record, NULL, size);
+    return record;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the first record in the journal, for replaying. Returns NULL if
+//  the journal is empty. The caller must destroy the returned chunk.
+
+zchunk_t *
+hydra_journal_first (hydra_journal_t *self)
+{
+    assert (self);
+    self->cursor = JOURNAL_HEADER_SIZE;
+    return hydra_journal_next (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the offset just past the record at the specified offset, going by
+//  its size, which may be past the end of the file. Returns -1 if the size
+//  cannot be right.
+
+static int64_t
+s_record_end (hydra_journal_t *self, int64_t offset)
+{
+    byte header [RECORD_HEADER_SIZE];
+    self->appending = false;
+    if (offset + RECORD_HEADER_SIZE > self->size)
+        return self->size;      //  Not even a whole header
+    if (fseek (self->handle, (long) offset, SEEK_SET)
+    ||  fread (header, 1, RECORD_HEADER_SIZE, self->handle) != RECORD_HEADER_SIZE)
+        return -1;
+    size_t size = hydra_util_get_number4 (header);
+    if (size > RECORD_MAX_SIZE)
+        return -1;
+    return offset + RECORD_HEADER_SIZE + (int64_t) size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the next record in the journal, or NULL when there are no more.
+//  If the last record is damaged, ends the journal there, on the basis that
+//  a crash interrupted the last write. Skips a damaged record that good
+//  records follow, if we can find the next one; if not, ends the replay
+//  there, and the journal refuses appends until it is repaired.
+
+zchunk_t *
+hydra_journal_next (hydra_journal_t *self)
+{
+    assert (self);
+    while (self->cursor < self->size
+    &&    (!self->broken || self->cursor < self->broken)) {
+        zchunk_t *record = hydra_journal_read (self, self->cursor);
+        if (record) {
+            self->current = self->cursor;
+            self->cursor += RECORD_HEADER_SIZE + zchunk_size (record);
+            return record;
+        }
+        int64_t record_end = s_record_end (self, self->cursor);
+        if (record_end >= self->size) {
+            zsys_warning ("hydra_journal: %s ends in damaged record, offset=%ld",
+                          self->filename, (long) self->cursor);
+            self->size = self->cursor;
+            self->damaged = true;
+            break;
+        }
+        zchunk_t *next = record_end > 0? hydra_journal_read (self, record_end): NULL;
+        if (next) {
+            zsys_error ("hydra_journal: %s has damaged record, offset=%ld, skipping it",
+                        self->filename, (long) self->cursor);
+            zchunk_destroy (&next);
+            self->cursor = record_end;
+        }
+        else {
+            zsys_error ("hydra_journal: %s is damaged at offset=%ld, cannot replay past it",
+                        self->filename, (long) self->cursor);
+            self->broken = self->cursor;
+        }
+    }
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the replay position to the specified offset, which must be the start
+//  of a record, so the next call to hydra_journal_next returns that record.
+//  Use this to replay from the point a snapshot was taken.
+
+void
+hydra_journal_seek (hydra_journal_t *self, int64_t offset)
+{
+    assert (self);
+    assert (offset >= JOURNAL_HEADER_SIZE);
+    self->cursor = offset;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return offset of the record last returned by first/next
+
+int64_t
+hydra_journal_cursor (hydra_journal_t *self)
+{
+    assert (self);
+    return self->current;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the journal size in bytes, which is also the offset at which the
+//  next record will be written.
+
+int64_t
+hydra_journal_size (hydra_journal_t *self)
+{
+    assert (self);
+    return self->size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Flush pending writes to disk and wait until the disk has them. Returns 0
+//  if OK, -1 if that failed.
+
+int
+hydra_journal_sync (hydra_journal_t *self)
+{
+    assert (self);
+    if (hydra_journal_flush (self))
+        return -1;
+#if defined (__WINDOWS__)
+    return _commit (_fileno (self->handle));
+#else
+    return fsync (fileno (self->handle));
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+hydra_journal_test (bool verbose)
+{
+    printf (" * hydra_journal: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zsys_dir_create (".hydra_test");
+    zsys_dir_change (".hydra_test");
+
+    hydra_journal_t *journal = hydra_journal_new ("journal");
+    assert (journal);
+    assert (hydra_journal_size (journal) == JOURNAL_HEADER_SIZE);
+    assert (hydra_journal_first (journal) == NULL);
+
+    //  Append two records and read them back
+    zchunk_t *chunk = zchunk_new ("Hello", 5);
+    int64_t first = hydra_journal_append (journal, chunk);
+    zchunk_destroy (&chunk);
+    chunk = zchunk_new ("World!", 6);
+    int64_t second = hydra_journal_append (journal, chunk);
+    zchunk_destroy (&chunk);
+    assert (first == JOURNAL_HEADER_SIZE);
+    assert (second == first + RECORD_HEADER_SIZE + 5);
+    assert (hydra_journal_sync (journal) == 0);
+
+    chunk = hydra_journal_read (journal, second);
+    assert (chunk);
+    assert (zchunk_size (chunk) == 6);
+    assert (memcmp (zchunk_data (chunk), "World!", 6) == 0);
+    zchunk_destroy (&chunk);
+    assert (hydra_journal_read (journal, second + 1) == NULL);
+    hydra_journal_destroy (&journal);
+
+    //  Simulate a torn write by appending half a record, then check that
+    //  replay drops it and further appends work
+    FILE *handle = fopen ("journal", "ab");
+    assert (handle);
+    fwrite ("\x00\x00\x00\x10\x12\x34", 1, 6, handle);
+    fclose (handle);
+
+    journal = hydra_journal_new ("journal");
+    assert (journal);
+    int records = 0;
+    chunk = hydra_journal_first (journal);
+    while (chunk) {
+        records++;
+        zchunk_destroy (&chunk);
+        chunk = hydra_journal_next (journal);
+    }
+    assert (records == 2);
+    assert (hydra_journal_cursor (journal) == second);
+    assert (hydra_journal_size (journal) == second + RECORD_HEADER_SIZE + 6);
+    chunk = zchunk_new ("Again", 5);
+    int64_t third = hydra_journal_append (journal, chunk);
+    zchunk_destroy (&chunk);
+    assert (third == second + RECORD_HEADER_SIZE + 6);
+
+    //  Replay from a known record
+    hydra_journal_seek (journal, second);
+    chunk = hydra_journal_next (journal);
+    assert (chunk && zchunk_size (chunk) == 6);
+    zchunk_destroy (&chunk);
+    chunk = hydra_journal_next (journal);
+    assert (chunk && zchunk_size (chunk) == 5);
+    assert (hydra_journal_cursor (journal) == third);
+    zchunk_destroy (&chunk);
+    assert (hydra_journal_next (journal) == NULL);
+
+    //  A damaged record with good records after it is skipped, not taken
+    //  for a torn write, so we keep the records after it
+    chunk = zchunk_new ("Fresh", 5);
+    int64_t last = hydra_journal_append (journal, chunk);
+    zchunk_destroy (&chunk);
+    int64_t size = hydra_journal_size (journal);
+    hydra_journal_destroy (&journal);
+    handle = fopen ("journal", "r+b");
+    assert (handle);
+    fseek (handle, (long) third + RECORD_HEADER_SIZE, SEEK_SET);
+    fwrite ("X", 1, 1, handle);
+    fclose (handle);
+    journal = hydra_journal_new ("journal");
+    assert (journal);
+    hydra_journal_seek (journal, second);
+    chunk = hydra_journal_next (journal);
+    assert (chunk && zchunk_size (chunk) == 6);
+    zchunk_destroy (&chunk);
+    chunk = hydra_journal_next (journal);
+    assert (chunk && memcmp (zchunk_data (chunk), "Fresh", 5) == 0);
+    assert (hydra_journal_cursor (journal) == last);
+    zchunk_destroy (&chunk);
+    assert (hydra_journal_next (journal) == NULL);
+    assert (hydra_journal_size (journal) == size);
+
+    //  If a damaged size hides where the next record starts, we stop the
+    //  replay there and refuse to append, rather than cut the journal
+    hydra_journal_destroy (&journal);
+    handle = fopen ("journal", "r+b");
+    assert (handle);
+    fseek (handle, (long) third, SEEK_SET);
+    fwrite ("\x7F", 1, 1, handle);
+    fclose (handle);
+    journal = hydra_journal_new ("journal");
+    assert (journal);
+    hydra_journal_seek (journal, second);
+    chunk = hydra_journal_next (journal);
+    assert (chunk);
+    zchunk_destroy (&chunk);
+    assert (hydra_journal_next (journal) == NULL);
+    chunk = zchunk_new ("Refused", 7);
+    assert (hydra_journal_append (journal, chunk) == -1);
+    zchunk_destroy (&chunk);
+    assert (hydra_journal_size (journal) == size);
+    hydra_journal_destroy (&journal);
+
+    //  Repair the journal by hand, and it works again
+    handle = fopen ("journal", "r+b");
+    assert (handle);
+    fseek (handle, (long) third, SEEK_SET);
+    fwrite ("\x00", 1, 1, handle);
+    fseek (handle, (long) third + RECORD_HEADER_SIZE, SEEK_SET);
+    fwrite ("A", 1, 1, handle);
+    fclose (handle);
+    journal = hydra_journal_new ("journal");
+    assert (journal);
+
+    //  Buffered records can be read back, and are written by a flush
+    hydra_journal_set_buffered (journal, true);
+    chunk = zchunk_new ("Batch", 5);
+    int64_t fourth = hydra_journal_append (journal, chunk);
+    hydra_journal_append (journal, chunk);
+    zchunk_destroy (&chunk);
+    chunk = hydra_journal_read (journal, fourth);
+    assert (chunk && zchunk_size (chunk) == 5);
+    zchunk_destroy (&chunk);
+    assert (hydra_journal_flush (journal) == 0);
+    hydra_journal_destroy (&journal);
+    journal = hydra_journal_new ("journal");
+    records = 0;
+    chunk = hydra_journal_first (journal);
+    while (chunk) {
+        records++;
+        zchunk_destroy (&chunk);
+        chunk = hydra_journal_next (journal);
+    }
+    assert (records == 6);
+    hydra_journal_destroy (&journal);
+
+    //  A second instance cannot open a journal that is in use
+    journal = hydra_journal_new ("journal");
+    assert (journal);
+    hydra_journal_t *other = hydra_journal_new ("journal");
+    assert (other == NULL);
+    hydra_journal_destroy (&journal);
+    other = hydra_journal_new ("journal");
+    assert (other);
+    hydra_journal_destroy (&other);
+
+    //  Anything else is not a journal
+    handle = fopen ("notajournal", "wb");
+    assert (handle);
+    fwrite ("Some text\n", 1, 10, handle);
+    fclose (handle);
+    journal = hydra_journal_new ("notajournal");
+    assert (journal == NULL);
+
+    //  Delete the test directory
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (".hydra_test", NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
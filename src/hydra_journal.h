@@ -0,0 +1,99 @@
+/*  =========================================================================
+    hydra_journal - append-only journal of ledger records
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef HYDRA_JOURNAL_H_INCLUDED
+#define HYDRA_JOURNAL_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new journal instance, opening or creating the specified file.
+//  Returns NULL if the file could not be opened, is not a journal, or is
+//  already open in another journal instance.
+HYDRA_PRIVATE hydra_journal_t *
+    hydra_journal_new (const char *filename);
+
+//  Destroy the journal, flushing any pending writes
+HYDRA_PRIVATE void
+    hydra_journal_destroy (hydra_journal_t **self_p);
+
+//  Append a record to the journal. Returns the offset of the new record,
+//  or -1 if the write failed. Unless the journal is buffered, the record is
+//  visible to other readers of the file when this returns, but is not
+//  durable on disk until you call hydra_journal_sync.
+HYDRA_PRIVATE int64_t
+    hydra_journal_append (hydra_journal_t *self, zchunk_t *record);
+
+//  Hold appended records in memory until the next flush or sync, rather
+//  than writing each one through to the file as it is appended. Use this
+//  to write a batch of records with as few system calls as possible.
+HYDRA_PRIVATE void
+    hydra_journal_set_buffered (hydra_journal_t *self, bool buffered);
+
+//  Write any records held in memory through to the file, so other readers
+//  of the file can see them. Returns 0 if OK, -1 if that failed, in which
+//  case some of the records appended since the last flush may be lost.
+HYDRA_PRIVATE int
+    hydra_journal_flush (hydra_journal_t *self);
+
+//  Read the record at the specified offset. Returns a new chunk holding the
+//  record payload, or NULL if there is no valid record at that offset.
+HYDRA_PRIVATE zchunk_t *
+    hydra_journal_read (hydra_journal_t *self, int64_t offset);
+
+//  Return the first record in the journal, for replaying. Returns NULL if
+//  the journal is empty. The caller must destroy the returned chunk.
+HYDRA_PRIVATE zchunk_t *
+    hydra_journal_first (hydra_journal_t *self);
+
+//  Return the next record in the journal, or NULL when there are no more.
+//  If the next record is damaged, ends the journal there, on the basis that
+//  a crash interrupted the last write.
+HYDRA_PRIVATE zchunk_t *
+    hydra_journal_next (hydra_journal_t *self);
+
+//  Set the replay position to the specified offset, which must be the start
+//  of a record, so the next call to hydra_journal_next returns that record.
+//  Use this to replay from the point a snapshot was taken.
+HYDRA_PRIVATE void
+    hydra_journal_seek (hydra_journal_t *self, int64_t offset);
+
+//  Return offset of the record last returned by first/next
+HYDRA_PRIVATE int64_t
+    hydra_journal_cursor (hydra_journal_t *self);
+
+//  Return the journal size in bytes, which is also the offset at which the
+//  next record will be written.
+HYDRA_PRIVATE int64_t
+    hydra_journal_size (hydra_journal_t *self);
+
+//  Flush pending writes to disk and wait until the disk has them. Returns 0
+//  if OK, -1 if that failed.
+HYDRA_PRIVATE int
+    hydra_journal_sync (hydra_journal_t *self);
+
+//  Return the CRC-32 checksum of a block of data
+HYDRA_PRIVATE uint32_t
+    hydra_journal_checksum (const byte *data, size_t size);
+
+//  Self test of this class
+HYDRA_PRIVATE void
+    hydra_journal_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,213 +15,3418 @@
     Works with a ledger of posts. The ledger is the database of all posts
     held by a node.
 @discuss
+    The ledger keeps post metadata in a single journal file, posts/journal,
+    one packed post per record, and post content in the blob store, where
+    posts with the same content share one blob. Loading the ledger replays
+    the journal. Older nodes kept one ZPL file per post in posts/; if we
+    find no journal, we migrate those files into a new journal and delete
+    them. We build that journal as posts/journal.tmp and rename it once it
+    is on disk, so a crash during migration leaves the post files intact,
+    and we migrate them again at the next start.
+
+    To start quickly, the ledger saves its index to posts/index when you
+    call hydra_ledger_checkpoint. Loading maps this snapshot into memory,
+    checks that its last post matches the journal, and replays only the
+    journal records written after it. Posts in the snapshot are looked up
+    there; posts added since are held in memory.
+
+    Blobs are written to posts/staging and renamed into posts/blobs when
+    complete. We spread blobs over posts/blobs/XX/, by the first two hex
+    digits of their digest, and move blobs left flat by older nodes there
+    when we load. Each checkpoint writes a marker record to the journal,
+    and since the server checkpoints when it stops cleanly, the posts after
+    the last marker are those a crash may have interrupted. We check their
+    content against its digest when we replay, and drop any post whose blob
+    is missing or damaged, so a peer can send it to us again. Posts before
+    the marker only need their content to be there. So even if we lose the
+    snapshot and replay the whole journal, recovery hashes content in
+    proportion to the posts written since the last checkpoint, not to the
+    size of the ledger.
+
+    A Bloom filter over all post IDs answers most "don't have it" lookups
+    without touching the index.
+
+    Replies point to the post they reply to, via its parent ID. To show a
+    thread, we keep an index from each post to its replies. The snapshot
+    holds the parent IDs, so we build this index without reading the
+    journal, when we first need it, and then keep it up to date.
+
+    To filter posts by MIME type, content digest, size, or time, we hold
+    these properties in columns, one array per property, and scan only the
+    columns a query tests, a block of posts at a time. We hold each MIME
+    type once, in a dictionary, and give each post its code, so we match a
+    MIME type against the dictionary and then compare codes. We build the
+    columns on the first query and then keep them up to date.
+
+    To search posts by their words, we keep a word index in posts/words,
+    which maps each word in a post's subject, or in its content if that is
+    plain text, to the posts that use it. We load the index when we first
+    search, add the posts stored since we last saved it, and then add each
+    post as we store it. A checkpoint saves the index if we loaded it.
+
+    The ledger lists posts in the order it stored them, which is not the
+    order of their timestamps. To list posts by time, we keep a second
+    index sorted by timestamp, which we build on the first query by time
+    and then keep up to date. A query finds the start and end of its time
+    range by binary search, and then reads the posts in the range in order.
+
+    You can set limits on the number of posts, their total content size,
+    and their age. The ledger then evicts its oldest posts, deleting their
+    blobs, and writes a small record to the journal so the eviction holds
+    when we next load. Evicted posts stay in the index, and in the snapshot,
+    so we refuse them if peers offer them again, and the server tells its
+    peers not to send them.
+
+    Compacting the ledger rolls the blobs of old posts into pack files in
+    posts/packs, so a long-lived node does not need one file per post. A
+    packed blob keeps its location; when we fetch its post we find it in
+    the packs and tell the post where to read it. Packs are never changed,
+    so blobs evicted after we pack them stay on disk until retention has
+    evicted every post using the pack, when we delete the whole pack.
+
+    To copy a ledger in bulk, export it to an archive file and import that
+    into another node. The archive holds each post's packed metadata, with
+    a CRC-32 checksum, followed by its content. We check content against
+    its digest both ways, and stop importing at the first damaged record.
+
+    Disks rot, so the ledger can scrub itself: it walks its posts a few at
+    a time, checks each journal record against the post ID and digest we
+    indexed, and hashes the content again. The caller gives each step a
+    budget of bytes, and we stop hashing a large blob partway and carry on
+    at the next step, so scrubbing never holds the caller up for long. We
+    quarantine damaged posts: we no longer fetch or export them, nor return
+    them from ranges, queries, searches, or threads. We list their IDs in
+    posts/quarantine/posts so they stay quarantined when we next load, and
+    we move a damaged blob into posts/quarantine so good content with the
+    same digest can take its place. If the post came after the last
+    snapshot, the next load drops it instead, as it would after a crash, so
+    a peer can send it to us again.
 @end
 */
 
 #include "hydra_classes.h"
 
+#define JOURNAL_FILE    "posts/journal"
+#define JOURNAL_TEMP    "posts/journal.tmp"
+#define INDEX_FILE      "posts/index"
+#define WORDS_FILE      "posts/words"
+#define WORDS_TEXT_MAX  (1024 * 1024)   //  Most text we index per post
+#define CACHE_LIMIT     1024    //  Maximum posts held in fetch cache
+#define LOAD_BATCH      16384   //  Journal records decoded per batch
+#define LOAD_MIN_SLICE  1024    //  Fewest records worth giving a worker
+#define IDENT_SIZE      20      //  SHA1 digest, binary
+#define FILTER_BLOCK    8       //  Filter words per block, one cache line
+#define FILTER_POSTS    32      //  Posts per filter block, i.e. 16 bits each
+#define EVICT_RECORD    0xEE    //  Journal record marking evicted posts
+#define EVICT_SIZE      9       //  Record tag plus 8-byte journal offset
+#define CHECKPOINT_RECORD   0xCC    //  Journal record marking a checkpoint
+#define CHECKPOINT_SIZE     1       //  Record tag only
+#define BLOBS_DIR       "posts/blobs/"
+#define BLOBS_LAYOUT    BLOBS_DIR "layout"
+#define STAGING_DIR     "posts/staging"
+#define PACKS_DIR       "posts/packs"
+#define PACK_FILE       PACKS_DIR "/%06zu.pack"
+#define PACK_MAX_BYTES  (64 * 1024 * 1024)  //  Most content packed at once
+#define ARCHIVE_SIGNATURE   "HYDRAA\x00\x01"  //  Start of an export archive
+#define ARCHIVE_SIGNATURE_SIZE  8
+#define ARCHIVE_META_MAX    (16 * 1024 * 1024)  //  Largest packed post we accept
+#define COPY_BLOCK      65536   //  Content bytes exported at once
+#define QUERY_BLOCK     256     //  Posts tested at once by a query
+#define QUARANTINE_DIR  "posts/quarantine"
+#define QUARANTINE_FILE QUARANTINE_DIR "/posts"
+
+//  A post added to the ledger since the last snapshot. We hold its post ID,
+//  parent ID, and content digest in the idents, parents, and digests arrays,
+//  at the same position.
+
+typedef struct {
+    int64_t offset;             //  Journal offset of post
+    int64_t timestamp;          //  Post time, seconds since epoch
+    size_t content_size;        //  Content size
+    size_t location;            //  Offset + 1 into locations arena, or 0
+    size_t mime_type;           //  Offset + 1 into locations arena, or 0
+} ledger_post_t;
+
+//  A post decoded from the journal, before we add it to the ledger
+
+typedef struct {
+    byte ident [IDENT_SIZE];    //  Post ID, binary
+    byte parent [IDENT_SIZE];   //  Parent post ID, binary, or zeros
+    byte digest [IDENT_SIZE];   //  Content digest, binary
+    bool valid;                 //  False if record was not a valid post
+    bool damaged;               //  Content does not match its digest
+    bool checkpoint;            //  Record marks a checkpoint
+    char *location;             //  Content location, if any
+    char *mime_type;            //  MIME type, if any
+    int64_t offset;             //  Journal offset of post
+    int64_t timestamp;          //  Post time, seconds since epoch
+    size_t content_size;        //  Content size
+    int64_t horizon;            //  If eviction record, first kept offset
+} decoded_post_t;
+
+//  A post in the time index, which orders posts by timestamp, and posts
+//  with the same timestamp by position
+
+typedef struct {
+    int64_t timestamp;          //  Post time, seconds since epoch
+    size_t position;            //  Post position in ledger
+} time_entry_t;
+
 //  Structure of our class
 
 struct _hydra_ledger_t {
-    zhash_t *post_files;    //  Hash table maps post IDs to filenames
-    char **posts_list;      //  Array of post IDs, oldest to newest
-    size_t size;            //  Current size of posts list
-    size_t max_size;        //  Maximum size of posts list (allocated)
-    int sequence;           //  Number of posts created today
+    hydra_journal_t *journal;   //  Journal holding post metadata
+    hydra_snapshot_t *snapshot; //  Index snapshot, holds the oldest posts
+    size_t snapshot_size;   //  Number of posts held in snapshot
+    byte *idents;           //  Post IDs after snapshot, binary, oldest first
+    byte *parents;          //  Parent IDs after snapshot, binary, or zeros
+    byte *digests;          //  Content digests after snapshot, binary
+    ledger_post_t *posts;   //  Posts after snapshot, oldest to newest
+    size_t size;            //  Current size of ledger, including snapshot
+    size_t first;           //  Position of oldest post not evicted
+    size_t max_size;        //  Maximum size of posts array (allocated)
+    uint32_t *post_index;   //  Hash table of positions + 1 in posts array
+    size_t index_limit;     //  Slots in hash table, a power of two
+    char *locations;        //  Arena holding content locations, MIME types
+    size_t locations_size;  //  Bytes used in locations arena
+    size_t locations_max;   //  Bytes allocated for locations arena
+    uint64_t *filter;       //  Bloom filter of all post IDs in ledger
+    size_t filter_blocks;   //  Blocks in filter, a power of two
+    zlistx_t *cache;        //  Fetched posts, most recently used first
+    zhashx_t *cache_index;  //  Maps post index + 1 to cache list handle
+    size_t cache_hits;      //  Fetches served from cache
+    size_t cache_misses;    //  Fetches that read the journal
+    size_t workers;         //  Threads used to decode journal at load
+    size_t max_posts;       //  Retention limit on posts, or 0
+    size_t max_bytes;       //  Retention limit on content bytes, or 0
+    int64_t max_age;        //  Retention limit on post age, secs, or 0
+    size_t content_bytes;   //  Content bytes of posts not evicted
+    size_t unsaved;         //  Posts added since the index was saved
+    hydra_blobs_t *blobs;   //  Blob store, built when first needed
+    hydra_pack_t **packs;   //  Pack files holding old blobs
+    size_t packs_size;      //  Number of pack files
+    size_t *packs_live;     //  Blobs posts still use in each pack, counted
+                            //  when we first evict packed content
+    size_t pack_next;       //  Number of next pack file we write
+    size_t pack_cursor;     //  Posts before this position are packed
+    bool durable;           //  Sync writes to disk before committing
+    bool in_batch;          //  Between hydra_ledger_begin and commit
+    size_t batch_first;     //  Position of first post in current batch
+    zlist_t *batch_blobs;   //  Blobs written since last commit, if durable
+    time_entry_t *times;    //  Posts in timestamp order, built when needed
+    size_t times_first;     //  First entry in use in times array
+    size_t times_end;       //  Entry after last in use in times array
+    size_t times_max;       //  Entries allocated in times array
+    zhashx_t *children;     //  Newest reply to each post, built when needed
+    size_t *siblings;       //  Next older reply to same post, by position
+    size_t siblings_max;    //  Entries allocated in siblings array
+    int64_t *column_times;  //  Timestamp of each post, by position
+    uint64_t *column_sizes; //  Content size of each post, by position
+    byte *column_digests;   //  Content digest of each post, by position
+    uint32_t *column_types; //  MIME type code of each post, or 0 if none
+    size_t columns_max;     //  Entries allocated in each column
+    char **types;           //  MIME type of each code, less one
+    size_t types_size;      //  Number of MIME type codes
+    size_t types_max;       //  Entries allocated in types array
+    zhashx_t *type_codes;   //  Code of each MIME type
+    hydra_words_t *words;   //  Full-text index, loaded when needed
+    zhashx_t *quarantine;   //  Positions + 1 of damaged posts, or NULL
+    size_t scrub_cursor;    //  Position of next post to scrub
+    hydra_post_t *scrub_post;   //  Post whose content we are hashing
+    FILE *scrub_input;      //  Its content, open at next byte to hash
+    zdigest_t *scrub_digest;    //  Digest of its content hashed so far
+    size_t scrub_left;      //  Bytes of its content left to hash
+    size_t scrub_posts;     //  Posts scrubbed
+    size_t scrub_bytes;     //  Bytes read while scrubbing
+    size_t scrub_passes;    //  Passes over the whole ledger
 };
 
-static void
-s_have_new_post (hydra_ledger_t *self, hydra_post_t *post, char *filename)
+//  A post held in the fetch cache
+
+typedef struct {
+    size_t position;        //  Post position in ledger
+    hydra_post_t *post;     //  Decoded post
+} cache_entry_t;
+
+
+//  --------------------------------------------------------------------------
+//  Convert post timestamp (yyyy-mm-ddThh:mm:ssZ) to seconds since the epoch.
+//  We do the calendar arithmetic ourselves as timegm is not portable.
+
+static int64_t
+s_post_time (const char *timestamp)
+{
+    int year, month, day, hour, minute, second;
+    if (sscanf (timestamp, "%d-%d-%dT%d:%d:%dZ",
+                &year, &month, &day, &hour, &minute, &second) != 6)
+        return 0;
+    //  Days since 1970-01-01, counting years from March
+    year -= month <= 2;
+    int64_t era = (year >= 0? year: year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month > 2? month - 3: month + 9) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    int64_t days = era * 146097 + day_of_era - 719468;
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Convert post ID from hex text to binary. Returns 0 if OK, -1 if the ID
+//  is not a valid SHA1 digest.
+
+static int
+s_ident_decode (const char *post_ident, byte *ident)
+{
+    uint byte_nbr;
+    for (byte_nbr = 0; byte_nbr < IDENT_SIZE; byte_nbr++) {
+        //  Check each digit before reading the next, which may be past
+        //  the end of the string
+        byte high = (byte) post_ident [byte_nbr * 2];
+        if (!isxdigit (high))
+            return -1;
+        byte low = (byte) post_ident [byte_nbr * 2 + 1];
+        if (!isxdigit (low))
+            return -1;
+        //  Letters have bit 6 set, and their low nibble is 1..6
+        ident [byte_nbr] = (((high & 0xF) + (high >> 6) * 9) << 4)
+                         |  ((low  & 0xF) + (low  >> 6) * 9);
+    }
+    return post_ident [IDENT_SIZE * 2]? -1: 0;
+}
+
+//  Convert post ID from binary to hex text, which must have room for 41
+//  characters
+
+static void
+s_ident_encode (const byte *ident, char *post_ident)
+{
+    static const char hex [] = "0123456789ABCDEF";
+    uint byte_nbr;
+    for (byte_nbr = 0; byte_nbr < IDENT_SIZE; byte_nbr++) {
+        post_ident [byte_nbr * 2] = hex [ident [byte_nbr] >> 4];
+        post_ident [byte_nbr * 2 + 1] = hex [ident [byte_nbr] & 0xF];
+    }
+    post_ident [IDENT_SIZE * 2] = 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  The hash table holds positions in the posts array. Post IDs are SHA1
+//  digests, so their leading bytes are already a good hash. We use open
+//  addressing with linear probing, and keep the table at most half full.
+//  Returns the slot for the post ID: either the one holding it, or the
+//  empty slot where it would go.
+
+static size_t
+s_index_slot (hydra_ledger_t *self, const byte *ident)
+{
+    uint64_t hash;
+    memcpy (&hash, ident, sizeof (hash));
+    size_t slot = (size_t) hash & (self->index_limit - 1);
+    while (self->post_index [slot]
+    &&  memcmp (self->idents + (self->post_index [slot] - 1) * IDENT_SIZE,
+                ident, IDENT_SIZE))
+        slot = (slot + 1) & (self->index_limit - 1);
+    return slot;
+}
+
+static void
+s_index_rebuild (hydra_ledger_t *self)
+{
+    free (self->post_index);
+    self->post_index = (uint32_t *) zmalloc (sizeof (uint32_t) * self->index_limit);
+    size_t position;
+    for (position = 0; position < self->size - self->snapshot_size; position++) {
+        size_t slot = s_index_slot (self, self->idents + position * IDENT_SIZE);
+        self->post_index [slot] = (uint32_t) position + 1;
+    }
+}
+
+static void
+s_index_grow (hydra_ledger_t *self)
+{
+    self->index_limit *= 2;
+    s_index_rebuild (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Copy a location into the locations arena and return its offset + 1
+
+static size_t
+s_location_store (hydra_ledger_t *self, const char *location)
+{
+    size_t location_size = strlen (location) + 1;
+    while (self->locations_size + location_size > self->locations_max) {
+        self->locations_max *= 2;
+        self->locations = (char *) realloc (self->locations, self->locations_max);
+    }
+    memcpy (self->locations + self->locations_size, location, location_size);
+    self->locations_size += location_size;
+    return self->locations_size - location_size + 1;
+}
+
+static const char *
+s_location (hydra_ledger_t *self, size_t location)
+{
+    return location? self->locations + location - 1: NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return properties of the post at a ledger position, which may be in the
+//  snapshot or in memory. Positions count evicted posts, so the position
+//  of a post does not change when older posts are evicted.
+
+static const byte *
+s_post_ident (hydra_ledger_t *self, size_t position)
+{
+    return position < self->snapshot_size
+        ? hydra_snapshot_ident (self->snapshot, position)
+        : self->idents + (position - self->snapshot_size) * IDENT_SIZE;
+}
+
+static int64_t
+s_post_offset (hydra_ledger_t *self, size_t position)
+{
+    return position < self->snapshot_size
+        ? hydra_snapshot_offset (self->snapshot, position)
+        : self->posts [position - self->snapshot_size].offset;
+}
+
+static int64_t
+s_post_timestamp (hydra_ledger_t *self, size_t position)
+{
+    return position < self->snapshot_size
+        ? hydra_snapshot_timestamp (self->snapshot, position)
+        : self->posts [position - self->snapshot_size].timestamp;
+}
+
+//  Returns NULL if the post has no parent
+
+static const byte *
+s_post_parent (hydra_ledger_t *self, size_t position)
+{
+    if (position < self->snapshot_size)
+        return hydra_snapshot_parent (self->snapshot, position);
+    const byte *parent = self->parents + (position - self->snapshot_size) * IDENT_SIZE;
+    size_t byte_nbr;
+    for (byte_nbr = 0; byte_nbr < IDENT_SIZE; byte_nbr++)
+        if (parent [byte_nbr])
+            return parent;
+    return NULL;
+}
+
+static const byte *
+s_post_digest (hydra_ledger_t *self, size_t position)
+{
+    return position < self->snapshot_size
+        ? hydra_snapshot_digest (self->snapshot, position)
+        : self->digests + (position - self->snapshot_size) * IDENT_SIZE;
+}
+
+static const char *
+s_post_mime_type (hydra_ledger_t *self, size_t position)
+{
+    return position < self->snapshot_size
+        ? hydra_snapshot_mime_type (self->snapshot, position)
+        : s_location (self, self->posts [position - self->snapshot_size].mime_type);
+}
+
+static size_t
+s_post_content_size (hydra_ledger_t *self, size_t position)
+{
+    return position < self->snapshot_size
+        ? hydra_snapshot_content_size (self->snapshot, position)
+        : self->posts [position - self->snapshot_size].content_size;
+}
+
+static const char *
+s_post_location (hydra_ledger_t *self, size_t position)
+{
+    return position < self->snapshot_size
+        ? hydra_snapshot_location (self->snapshot, position)
+        : s_location (self, self->posts [position - self->snapshot_size].location);
+}
+
+
+//  --------------------------------------------------------------------------
+//  The Bloom filter tells us quickly that we do not have a post, which is
+//  the common answer when syncing with a new peer. It is blocked: each post
+//  ID sets four bits within one 64-byte block, so a test touches a single
+//  cache line. We take the block and the bits from bytes of the post ID
+//  that the hash table does not use.
+
+static uint64_t *
+s_filter_block (hydra_ledger_t *self, const byte *ident, uint64_t *bits)
+{
+    uint32_t block;
+    memcpy (&block, ident + 8, sizeof (block));
+    memcpy (bits, ident + 12, sizeof (*bits));
+    return self->filter + (block & (self->filter_blocks - 1)) * FILTER_BLOCK;
+}
+
+static void
+s_filter_add (hydra_ledger_t *self, const byte *ident)
+{
+    uint64_t bits;
+    uint64_t *block = s_filter_block (self, ident, &bits);
+    uint bit_nbr;
+    for (bit_nbr = 0; bit_nbr < 4; bit_nbr++, bits >>= 9)
+        block [(bits >> 6) & 7] |= (uint64_t) 1 << (bits & 63);
+}
+
+static bool
+s_filter_test (hydra_ledger_t *self, const byte *ident)
+{
+    uint64_t bits;
+    uint64_t *block = s_filter_block (self, ident, &bits);
+    uint bit_nbr;
+    for (bit_nbr = 0; bit_nbr < 4; bit_nbr++, bits >>= 9)
+        if (!(block [(bits >> 6) & 7] & ((uint64_t) 1 << (bits & 63))))
+            return false;
+    return true;
+}
+
+//  Size the filter for the current ledger and add every post to it; we do
+//  this after loading a snapshot, and whenever the ledger outgrows the
+//  filter.
+
+static void
+s_filter_rebuild (hydra_ledger_t *self)
+{
+    while (self->filter_blocks * FILTER_POSTS < self->size)
+        self->filter_blocks *= 2;
+    free (self->filter);
+    self->filter = (uint64_t *) zmalloc (
+        sizeof (uint64_t) * FILTER_BLOCK * self->filter_blocks);
+    size_t position;
+    for (position = 0; position < self->size; position++)
+        s_filter_add (self, s_post_ident (self, position));
+}
+
+
+//  --------------------------------------------------------------------------
+//  Quarantined posts are few, so we hold their positions in a hash table,
+//  keyed like the fetch cache. We mark posts whose content we moved aside,
+//  as they no longer hold a reference to their blob. Returns true if the
+//  post is quarantined.
+
+#define QUARANTINE_HELD     ((void *) 1)
+#define QUARANTINE_ASIDE    ((void *) 2)
+
+static bool
+s_quarantined (hydra_ledger_t *self, size_t position)
+{
+    return self->quarantine
+        && zhashx_lookup (self->quarantine, (void *) (position + 1)) != NULL;
+}
+
+static bool
+s_quarantined_aside (hydra_ledger_t *self, size_t position)
+{
+    return self->quarantine
+        && zhashx_lookup (self->quarantine, (void *) (position + 1)) == QUARANTINE_ASIDE;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Lookup post by its binary or hex ID and return its ledger position,
+//  counting evicted posts, or -1 if we never had it.
+
+static int
+s_find_ident (hydra_ledger_t *self, const byte *ident)
+{
+    if (!s_filter_test (self, ident))
+        return -1;
+    uint32_t position = self->post_index [s_index_slot (self, ident)];
+    if (position)
+        return (int) (self->snapshot_size + position - 1);
+    if (self->snapshot)
+        return hydra_snapshot_find (self->snapshot, ident);
+    return -1;
+}
+
+static int
+s_find (hydra_ledger_t *self, const char *post_ident)
+{
+    byte ident [IDENT_SIZE];
+    if (s_ident_decode (post_ident, ident))
+        return -1;
+    return s_find_ident (self, ident);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Posts with the same content share one blob, so before we delete a blob
+//  we must know no other post uses it. The blob store counts the posts using
+//  each blob; we build it when we first need it, as most ledgers never
+//  evict or ask about blobs.
+
+static hydra_blobs_t *
+s_blobs (hydra_ledger_t *self)
+{
+    if (!self->blobs) {
+        self->blobs = hydra_blobs_new ();
+        size_t position;
+        for (position = self->first; position < self->size; position++) {
+            const char *digest = hydra_blobs_digest (s_post_location (self, position));
+            if (digest)
+                hydra_blobs_ref (self->blobs, digest);
+        }
+    }
+    return self->blobs;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Find a blob in our pack files, newest first. Returns the pack holding
+//  the blob and sets the blob position in the pack, or returns NULL. This
+//  only reads the ledger, so is safe to call from worker threads.
+
+static hydra_pack_t *
+s_pack_find (hydra_ledger_t *self, const char *digest, int *position_p)
+{
+    size_t index = self->packs_size;
+    while (index--) {
+        int position = hydra_pack_find (self->packs [index], digest);
+        if (position >= 0) {
+            if (position_p)
+                *position_p = position;
+            return self->packs [index];
+        }
+    }
+    return NULL;
+}
+
+//  Count the blobs in a pack that posts still use
+
+static size_t
+s_pack_live (hydra_ledger_t *self, hydra_pack_t *pack)
+{
+    size_t live = 0;
+    size_t position;
+    for (position = 0; position < hydra_pack_size (pack); position++) {
+        char *digest = hydra_pack_digest (pack, position);
+        if (hydra_blobs_refs (s_blobs (self), digest))
+            live++;
+        zstr_free (&digest);
+    }
+    return live;
+}
+
+//  Evicting posts frees no disk space while their content sits in a pack, so
+//  we count down the blobs each pack still holds for posts, and delete the
+//  pack when none are left. Call this when the last post using a blob goes.
+
+static void
+s_pack_release (hydra_ledger_t *self, const char *digest)
+{
+    size_t index;
+    if (!self->packs_live) {
+        self->packs_live = (size_t *) zmalloc (sizeof (size_t) * (self->packs_size + 1));
+        for (index = 0; index < self->packs_size; index++)
+            self->packs_live [index] = s_pack_live (self, self->packs [index]);
+    }
+    for (index = 0; index < self->packs_size; index++)
+        if (hydra_pack_find (self->packs [index], digest) >= 0)
+            break;
+    if (index == self->packs_size)
+        return;
+    if (self->packs_live [index])
+        self->packs_live [index]--;
+    //  A post may have brought a blob back since we counted, so look again
+    if (self->packs_live [index] == 0
+    &&  s_pack_live (self, self->packs [index]) == 0) {
+        hydra_pack_t *pack = self->packs [index];
+        zsys_info ("hydra_ledger: delete %s, no posts use it", hydra_pack_filename (pack));
+        zsys_file_delete (hydra_pack_filename (pack));
+        hydra_pack_destroy (&pack);
+        self->packs_size--;
+        memmove (self->packs + index, self->packs + index + 1,
+                 sizeof (hydra_pack_t *) * (self->packs_size - index));
+        memmove (self->packs_live + index, self->packs_live + index + 1,
+                 sizeof (size_t) * (self->packs_size - index));
+    }
+}
+
+//  If the post content is packed, have the post read it from the pack
+
+static void
+s_pack_resolve (hydra_ledger_t *self, hydra_post_t *post)
+{
+    int position;
+    const char *digest = hydra_blobs_digest (hydra_post_location (post));
+    hydra_pack_t *pack = digest? s_pack_find (self, digest, &position): NULL;
+    if (pack)
+        hydra_post_set_pack (post, hydra_pack_filename (pack),
+                             hydra_pack_offset (pack, position));
+}
+
+
+//  Return true if the post content is where the post says, and the right
+//  size. This is far quicker than checking the content against its digest.
+
+static bool
+s_content_present (hydra_ledger_t *self, hydra_post_t *post)
+{
+    const char *location = hydra_post_location (post);
+    const char *digest = hydra_blobs_digest (location);
+    if (!location || (digest && s_pack_find (self, digest, NULL)))
+        return true;
+    return zsys_file_size (location) == (ssize_t) hydra_post_content_size (post);
+}
+
+
+//  --------------------------------------------------------------------------
+//  The time index holds the live posts sorted by timestamp, in the times
+//  array between times_first and times_end. Posts mostly arrive in time
+//  order, or in reverse when we sync from a peer, so we keep free space at
+//  both ends of the array, and most inserts take no move at all. We build
+//  the index when we first need it, as most ledgers are never queried by
+//  time.
+
+static int
+s_time_compare (const void *item1, const void *item2)
+{
+    const time_entry_t *entry1 = (const time_entry_t *) item1;
+    const time_entry_t *entry2 = (const time_entry_t *) item2;
+    if (entry1->timestamp != entry2->timestamp)
+        return entry1->timestamp < entry2->timestamp? -1: 1;
+    if (entry1->position != entry2->position)
+        return entry1->position < entry2->position? -1: 1;
+    return 0;
+}
+
+//  Return the first slot in the time index holding an entry that sorts at
+//  or after the specified timestamp and position
+
+static size_t
+s_times_slot (hydra_ledger_t *self, int64_t timestamp, size_t position)
+{
+    time_entry_t key = { timestamp, position };
+    size_t low = self->times_first;
+    size_t high = self->times_end;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (s_time_compare (&self->times [middle], &key) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static void
+s_times (hydra_ledger_t *self)
+{
+    if (self->times)
+        return;
+    size_t size = self->size - self->first;
+    self->times_max = size * 2 > 256? size * 2: 256;
+    self->times = (time_entry_t *) malloc (sizeof (time_entry_t) * self->times_max);
+    //  Leave as much free space before the entries as after them
+    self->times_first = (self->times_max - size) / 2;
+    self->times_end = self->times_first + size;
+    size_t position;
+    for (position = self->first; position < self->size; position++) {
+        time_entry_t *entry = &self->times [self->times_first + position - self->first];
+        entry->timestamp = s_post_timestamp (self, position);
+        entry->position = position;
+    }
+    qsort (self->times + self->times_first, size, sizeof (time_entry_t), s_time_compare);
+}
+
+static void
+s_times_insert (hydra_ledger_t *self, int64_t timestamp, size_t position)
+{
+    time_entry_t entry = { timestamp, position };
+    size_t size = self->times_end - self->times_first;
+    if (size == 0 || s_time_compare (&self->times [self->times_end - 1], &entry) < 0) {
+        //  Newest post, which goes at the end
+        if (self->times_end == self->times_max) {
+            self->times_max *= 2;
+            self->times = (time_entry_t *) realloc (self->times,
+                sizeof (time_entry_t) * self->times_max);
+        }
+        self->times [self->times_end++] = entry;
+    }
+    else
+    if (s_time_compare (&entry, &self->times [self->times_first]) < 0
+    &&  self->times_first > 0)
+        //  Oldest post, which goes at the start
+        self->times [--self->times_first] = entry;
+    else {
+        if (self->times_end == self->times_max || self->times_first == 0) {
+            //  Recentre the entries in an array twice their size
+            time_entry_t *times = (time_entry_t *) malloc (
+                sizeof (time_entry_t) * size * 4);
+            memcpy (times + size, self->times + self->times_first,
+                    sizeof (time_entry_t) * size);
+            free (self->times);
+            self->times = times;
+            self->times_max = size * 4;
+            self->times_first = size;
+            self->times_end = size * 2;
+        }
+        //  Move whichever side of the slot is shorter
+        size_t slot = s_times_slot (self, timestamp, position);
+        if (slot - self->times_first < self->times_end - slot) {
+            memmove (self->times + self->times_first - 1, self->times + self->times_first,
+                     sizeof (time_entry_t) * (slot - self->times_first));
+            self->times_first--;
+            slot--;
+        }
+        else {
+            memmove (self->times + slot + 1, self->times + slot,
+                     sizeof (time_entry_t) * (self->times_end - slot));
+            self->times_end++;
+        }
+        self->times [slot] = entry;
+    }
+}
+
+static void
+s_times_remove (hydra_ledger_t *self, int64_t timestamp, size_t position)
+{
+    size_t slot = s_times_slot (self, timestamp, position);
+    assert (slot < self->times_end && self->times [slot].position == position);
+    if (slot == self->times_first)
+        self->times_first++;
+    else {
+        memmove (self->times + slot, self->times + slot + 1,
+                 sizeof (time_entry_t) * (self->times_end - slot - 1));
+        self->times_end--;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  The thread index finds the replies to a post. It maps each post ID that
+//  has replies to the newest reply, and each reply to the next older reply
+//  to the same post, so the replies to a post form a list, newest first.
+//  Replies may arrive before the post they reply to, so we key the map on
+//  the parent ID, not its position. We build the index from the parent IDs
+//  in the ledger when we first need it.
+
+static size_t
+s_parent_key_hash (const void *key)
+{
+    //  Post IDs are SHA1 digests, so any of their bytes make a good hash
+    size_t hash;
+    memcpy (&hash, key, sizeof (hash));
+    return hash;
+}
+
+static int
+s_parent_key_compare (const void *key1, const void *key2)
+{
+    return memcmp (key1, key2, IDENT_SIZE);
+}
+
+static void *
+s_parent_key_dup (const void *key)
+{
+    byte *copy = (byte *) malloc (IDENT_SIZE);
+    if (copy)
+        memcpy (copy, key, IDENT_SIZE);
+    return copy;
+}
+
+static void
+s_parent_key_destroy (void **key_p)
+{
+    free (*key_p);
+    *key_p = NULL;
+}
+
+//  Add the post at the specified position to the replies to its parent
+
+static void
+s_children_link (hydra_ledger_t *self, size_t position)
+{
+    const byte *parent = s_post_parent (self, position);
+    if (!parent)
+        return;
+    if (position >= self->siblings_max) {
+        while (position >= self->siblings_max)
+            self->siblings_max *= 2;
+        self->siblings = (size_t *) realloc (self->siblings,
+            sizeof (size_t) * self->siblings_max);
+    }
+    //  Both hold position + 1, so that zero ends the list
+    self->siblings [position] = (size_t) zhashx_lookup (self->children, parent);
+    zhashx_update (self->children, parent, (void *) (position + 1));
+}
+
+static void
+s_children (hydra_ledger_t *self)
+{
+    if (self->children)
+        return;
+    self->children = zhashx_new ();
+    zhashx_set_key_hasher (self->children, s_parent_key_hash);
+    zhashx_set_key_comparator (self->children, s_parent_key_compare);
+    zhashx_set_key_duplicator (self->children, s_parent_key_dup);
+    zhashx_set_key_destructor (self->children, s_parent_key_destroy);
+    self->siblings_max = self->size > 256? self->size: 256;
+    self->siblings = (size_t *) malloc (sizeof (size_t) * self->siblings_max);
+    size_t position;
+    for (position = self->first; position < self->size; position++)
+        s_children_link (self, position);
+}
+
+//  Return the position of the newest live reply to the post with the
+//  specified binary ID, or of the next older reply to the same post after
+//  the specified position; returns -1 if there are no more. Evicted posts
+//  are the oldest, so end the list.
+
+static int
+s_children_first (hydra_ledger_t *self, const byte *ident)
+{
+    size_t position = (size_t) zhashx_lookup (self->children, ident);
+    return position > self->first? (int) position - 1: -1;
+}
+
+static int
+s_children_next (hydra_ledger_t *self, size_t position)
+{
+    size_t sibling = self->siblings [position];
+    return sibling > self->first? (int) sibling - 1: -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  The columns hold the properties that queries test, one array per
+//  property, in host byte order and ledger order, so a query reads only the
+//  properties it tests, and tests a block of posts per loop with no
+//  branches, which the compiler can vectorize. We keep each MIME type once,
+//  in the types dictionary, and hold its code in the column. We build the
+//  columns when we first need them, as the thread index does.
+
+static uint32_t
+s_type_code (hydra_ledger_t *self, const char *mime_type)
+{
+    if (!mime_type || !*mime_type)
+        return 0;
+    uint32_t code = (uint32_t) (size_t) zhashx_lookup (self->type_codes, mime_type);
+    if (!code) {
+        if (self->types_size == self->types_max) {
+            self->types_max *= 2;
+            self->types = (char **) realloc (self->types, sizeof (char *) * self->types_max);
+        }
+        self->types [self->types_size++] = strdup (mime_type);
+        code = (uint32_t) self->types_size;
+        zhashx_insert (self->type_codes, mime_type, (void *) (size_t) code);
+    }
+    return code;
+}
+
+//  Store the properties of the post at the specified position in the
+//  columns
+
+static void
+s_columns_set (hydra_ledger_t *self, size_t position)
+{
+    if (position >= self->columns_max) {
+        while (position >= self->columns_max)
+            self->columns_max *= 2;
+        self->column_times = (int64_t *) realloc (self->column_times,
+            sizeof (int64_t) * self->columns_max);
+        self->column_sizes = (uint64_t *) realloc (self->column_sizes,
+            sizeof (uint64_t) * self->columns_max);
+        self->column_digests = (byte *) realloc (self->column_digests,
+            IDENT_SIZE * self->columns_max);
+        self->column_types = (uint32_t *) realloc (self->column_types,
+            sizeof (uint32_t) * self->columns_max);
+    }
+    self->column_times [position] = s_post_timestamp (self, position);
+    self->column_sizes [position] = s_post_content_size (self, position);
+    memcpy (self->column_digests + position * IDENT_SIZE,
+            s_post_digest (self, position), IDENT_SIZE);
+    self->column_types [position] = s_type_code (self, s_post_mime_type (self, position));
+}
+
+static void
+s_columns (hydra_ledger_t *self)
+{
+    if (self->type_codes)
+        return;
+    self->type_codes = zhashx_new ();
+    self->types_max = 64;
+    self->types = (char **) malloc (sizeof (char *) * self->types_max);
+    self->columns_max = self->size > 256? self->size: 256;
+    self->column_times = (int64_t *) malloc (sizeof (int64_t) * self->columns_max);
+    self->column_sizes = (uint64_t *) malloc (sizeof (uint64_t) * self->columns_max);
+    self->column_digests = (byte *) malloc (IDENT_SIZE * self->columns_max);
+    self->column_types = (uint32_t *) malloc (sizeof (uint32_t) * self->columns_max);
+    size_t position;
+    for (position = self->first; position < self->size; position++)
+        s_columns_set (self, position);
+}
+
+
+//  --------------------------------------------------------------------------
+//  A query over the columns. Posts match if they pass every test.
+
+typedef struct {
+    int64_t since;              //  Oldest timestamp matched
+    int64_t until;              //  Timestamp after newest matched
+    uint64_t min_size;          //  Smallest content size matched
+    uint64_t max_size;          //  Largest content size matched
+    byte *types;                //  1 for each MIME type code matched, or NULL
+    byte digest [IDENT_SIZE];   //  Content digest matched, if has_digest
+    bool has_digest;            //  True if we match on content digest
+} ledger_query_t;
+
+//  Return true if the MIME type matches the pattern, where "type/*"
+//  matches any subtype
+
+static bool
+s_type_matches (const char *mime_type, const char *pattern)
+{
+    size_t size = strlen (pattern);
+    if (size > 2 && streq (pattern + size - 2, "/*"))
+        return strncmp (mime_type, pattern, size - 1) == 0;
+    return streq (mime_type, pattern);
+}
+
+//  Prepare a query from the arguments to hydra_ledger_query. Returns 0 if
+//  OK, -1 if no post can match, in which case there is nothing to free.
+
+static int
+s_query_prepare (hydra_ledger_t *self, ledger_query_t *query,
+                 const char *mime_type, const char *digest,
+                 size_t min_size, size_t max_size, int64_t since, int64_t until)
+{
+    s_columns (self);
+    query->since = since? since: INT64_MIN;
+    query->until = until? until: INT64_MAX;
+    query->min_size = min_size;
+    query->max_size = max_size? max_size: UINT64_MAX;
+    query->has_digest = digest != NULL;
+    if (digest && s_ident_decode (digest, query->digest))
+        return -1;
+    query->types = NULL;
+    if (mime_type) {
+        //  Test each MIME type we know once, so that testing a post is a
+        //  lookup by its code. Code 0, no MIME type, never matches.
+        query->types = (byte *) zmalloc (self->types_size + 1);
+        bool matched = false;
+        size_t code;
+        for (code = 1; code <= self->types_size; code++)
+            if (s_type_matches (self->types [code - 1], mime_type)) {
+                query->types [code] = 1;
+                matched = true;
+            }
+        if (!matched) {
+            free (query->types);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//  Run a query over the live posts, in ledger order. Skips the first offset
+//  matches, and stores the indexes of at most limit matches after that into
+//  the indexes array, stopping when that is full. If indexes is NULL, counts
+//  all the matches. Returns the number of posts that matched.
+
+static size_t
+s_query_run (hydra_ledger_t *self, ledger_query_t *query,
+             size_t offset, int *indexes, size_t limit)
+{
+    byte hits [QUERY_BLOCK];
+    size_t matches = 0;
+    size_t count = 0;
+    size_t start = self->first;
+    while (start < self->size && (!indexes || count < limit)) {
+        size_t block = self->size - start < QUERY_BLOCK? self->size - start: QUERY_BLOCK;
+        const int64_t *times = self->column_times + start;
+        const uint64_t *sizes = self->column_sizes + start;
+        size_t index;
+        for (index = 0; index < block; index++)
+            hits [index] = (times [index] >= query->since)
+                         & (times [index] < query->until)
+                         & (sizes [index] >= query->min_size)
+                         & (sizes [index] <= query->max_size);
+        if (query->types) {
+            const uint32_t *codes = self->column_types + start;
+            for (index = 0; index < block; index++)
+                hits [index] &= query->types [codes [index]];
+        }
+        if (query->has_digest) {
+            const byte *digests = self->column_digests + start * IDENT_SIZE;
+            for (index = 0; index < block; index++)
+                hits [index] &= memcmp (digests + index * IDENT_SIZE,
+                                        query->digest, IDENT_SIZE) == 0;
+        }
+        if (self->quarantine)
+            for (index = 0; index < block; index++)
+                hits [index] &= !s_quarantined (self, start + index);
+        for (index = 0; index < block; index++)
+            if (hits [index]) {
+                if (matches >= offset && count < limit)
+                    indexes [count++] = (int) (start + index - self->first);
+                matches++;
+            }
+        start += block;
+    }
+    return matches;
+}
+
+
+//  --------------------------------------------------------------------------
+//  The word index finds posts by the words in their subject, and in their
+//  content if that is text. It keys posts by journal offset, which unlike
+//  position does not change when we reload the ledger. We load the index
+//  when we first search, and then add each post we store.
+
+static void
+s_words_add (hydra_ledger_t *self, hydra_post_t *post, int64_t offset)
+{
+    zchunk_t *text = NULL;
+    size_t text_size = hydra_post_content_size (post);
+    if (text_size > WORDS_TEXT_MAX)
+        text_size = WORDS_TEXT_MAX;
+    const char *mime_type = hydra_post_mime_type (post);
+    if (text_size && mime_type && streq (mime_type, "text/plain"))
+        text = hydra_post_fetch (post, text_size, 0);
+    if (text && zchunk_size (text) < text_size)
+        text_size = zchunk_size (text);
+    hydra_words_add (self->words, (uint64_t) offset, hydra_post_subject (post),
+                     text? (const char *) zchunk_data (text): NULL, text? text_size: 0);
+    zchunk_destroy (&text);
+}
+
+//  Return the position of the first post at or after the specified journal
+//  offset; positions and offsets go up together
+
+static size_t
+s_offset_position (hydra_ledger_t *self, int64_t offset)
+{
+    size_t low = self->first;
+    size_t high = self->size;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (s_post_offset (self, middle) < offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static void
+s_words (hydra_ledger_t *self)
+{
+    if (self->words)
+        return;
+    self->words = hydra_words_load (WORDS_FILE);
+    if (self->words
+    &&  hydra_words_cursor (self->words) > (uint64_t) hydra_journal_size (self->journal))
+        hydra_words_destroy (&self->words);
+    if (!self->words)
+        self->words = hydra_words_new ();
+
+    //  Add the posts stored since we last saved the index
+    size_t position = s_offset_position (self, hydra_words_cursor (self->words));
+    for (; position < self->size; position++) {
+        hydra_post_t *post = NULL;
+        zchunk_t *chunk = hydra_journal_read (self->journal, s_post_offset (self, position));
+        if (chunk) {
+            post = hydra_post_unpack (chunk);
+            zchunk_destroy (&chunk);
+        }
+        if (post) {
+            s_pack_resolve (self, post);
+            s_words_add (self, post, s_post_offset (self, position));
+            hydra_post_destroy (&post);
+        }
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Decode a post for adding to the ledger; this is safe to call from worker
+//  threads as it touches only the post and the decoded post.
+
+static void
+s_decode_post (decoded_post_t *decoded, hydra_post_t *post)
+{
+    decoded->valid = s_ident_decode (hydra_post_ident (post), decoded->ident) == 0;
+    if (s_ident_decode (hydra_post_parent_id (post), decoded->parent))
+        memset (decoded->parent, 0, IDENT_SIZE);
+    if (s_ident_decode (hydra_post_digest (post), decoded->digest))
+        memset (decoded->digest, 0, IDENT_SIZE);
+    decoded->location = hydra_post_location (post)? strdup (hydra_post_location (post)): NULL;
+    decoded->mime_type = hydra_post_mime_type (post)? strdup (hydra_post_mime_type (post)): NULL;
+    decoded->timestamp = s_post_time (hydra_post_timestamp (post));
+    decoded->content_size = hydra_post_content_size (post);
+    decoded->horizon = 0;
+    decoded->damaged = false;
+    decoded->checkpoint = false;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add a decoded post to the ledger, and free its location and MIME type
+
+static void
+s_add_post (hydra_ledger_t *self, decoded_post_t *decoded)
+{
+    //  Store post in arrays and bump size
+    size_t position = self->size - self->snapshot_size;
+    if (position == self->max_size) {
+        self->max_size *= 2;
+        self->posts = (ledger_post_t *) realloc (
+            self->posts, sizeof (ledger_post_t) * self->max_size);
+        self->idents = (byte *) realloc (
+            self->idents, IDENT_SIZE * self->max_size);
+        self->parents = (byte *) realloc (
+            self->parents, IDENT_SIZE * self->max_size);
+        self->digests = (byte *) realloc (
+            self->digests, IDENT_SIZE * self->max_size);
+    }
+    memcpy (self->idents + position * IDENT_SIZE, decoded->ident, IDENT_SIZE);
+    memcpy (self->parents + position * IDENT_SIZE, decoded->parent, IDENT_SIZE);
+    memcpy (self->digests + position * IDENT_SIZE, decoded->digest, IDENT_SIZE);
+    ledger_post_t *entry = &self->posts [position];
+    entry->offset = decoded->offset;
+    entry->timestamp = decoded->timestamp;
+    entry->content_size = decoded->content_size;
+    entry->location = decoded->location? s_location_store (self, decoded->location): 0;
+    zstr_free (&decoded->location);
+    entry->mime_type = decoded->mime_type? s_location_store (self, decoded->mime_type): 0;
+    zstr_free (&decoded->mime_type);
+    self->size++;
+    self->unsaved++;
+    self->content_bytes += entry->content_size;
+    if (self->times)
+        s_times_insert (self, entry->timestamp, self->size - 1);
+    if (self->children)
+        s_children_link (self, self->size - 1);
+    if (self->type_codes)
+        s_columns_set (self, self->size - 1);
+    if (self->blobs) {
+        const char *digest = hydra_blobs_digest (s_location (self, entry->location));
+        if (digest)
+            hydra_blobs_ref (self->blobs, digest);
+    }
+
+    if (self->size > self->filter_blocks * FILTER_POSTS)
+        s_filter_rebuild (self);
+    else
+        s_filter_add (self, decoded->ident);
+
+    //  Index holds position + 1 so that zero marks an empty slot
+    if ((position + 1) * 2 > self->index_limit)
+        s_index_grow (self);
+    else
+        self->post_index [s_index_slot (self, decoded->ident)] = (uint32_t) position + 1;
+}
+
+
+static void
+s_have_new_post (hydra_ledger_t *self, hydra_post_t *post, int64_t offset)
+{
+    decoded_post_t decoded;
+    s_decode_post (&decoded, post);
+    decoded.offset = offset;
+    if (decoded.valid) {
+        s_add_post (self, &decoded);
+        if (self->words)
+            s_words_add (self, post, offset);
+    }
+    else {
+        zstr_free (&decoded.location);
+        zstr_free (&decoded.mime_type);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Decode a run of journal records. Records that are not valid posts are
+//  marked as such; for eviction records we also set the horizon. We mark
+//  posts whose content is missing, or if we are asked to verify, does not
+//  check out, and decide what to do with them once we know which posts
+//  were evicted.
+
+typedef struct {
+    hydra_ledger_t *ledger;     //  Ledger we are loading
+    zchunk_t **chunks;          //  Journal records to decode
+    decoded_post_t *entries;    //  Posts to fill in, offsets already set
+    size_t size;                //  Number of records
+    bool verify;                //  Hash content against its digest
+} load_slice_t;
+
+static void
+s_decode_slice (load_slice_t *slice)
+{
+    size_t index;
+    for (index = 0; index < slice->size; index++) {
+        zchunk_t *chunk = slice->chunks [index];
+        decoded_post_t *entry = &slice->entries [index];
+        hydra_post_t *post = NULL;
+        if ((zchunk_size (chunk) != EVICT_SIZE || zchunk_data (chunk) [0] != EVICT_RECORD)
+        &&  (zchunk_size (chunk) != CHECKPOINT_SIZE || zchunk_data (chunk) [0] != CHECKPOINT_RECORD))
+            post = hydra_post_unpack (chunk);
+        if (post) {
+            s_decode_post (entry, post);
+            s_pack_resolve (slice->ledger, post);
+            if (entry->valid)
+                entry->damaged = slice->verify
+                    ? hydra_post_verify_content (post) != 0
+                    : !s_content_present (slice->ledger, post);
+            hydra_post_destroy (&post);
+        }
+        else {
+            entry->valid = false;
+            entry->damaged = false;
+            entry->checkpoint = zchunk_size (chunk) == CHECKPOINT_SIZE
+                             && zchunk_data (chunk) [0] == CHECKPOINT_RECORD;
+            entry->location = NULL;
+            entry->mime_type = NULL;
+            entry->horizon = 0;
+            if (zchunk_size (chunk) == EVICT_SIZE && zchunk_data (chunk) [0] == EVICT_RECORD)
+                entry->horizon = (int64_t) hydra_util_get_number8 (zchunk_data (chunk) + 1);
+        }
+    }
+}
+
+static void
+s_load_worker (zsock_t *pipe, void *args)
+{
+    zsock_signal (pipe, 0);
+    s_decode_slice ((load_slice_t *) args);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Decode a batch of journal records, splitting the work across our worker
+//  threads if the batch is large enough to make that worthwhile. Each worker
+//  fills in its own part of the entries array, so the order of entries is
+//  the journal order whatever the number of workers.
+
+static void
+s_decode_batch (hydra_ledger_t *self, zchunk_t **chunks, decoded_post_t *entries,
+                size_t size, bool verify)
+{
+    size_t workers = self->workers;
+    if (workers > size / LOAD_MIN_SLICE)
+        workers = size / LOAD_MIN_SLICE;
+    if (workers <= 1) {
+        load_slice_t slice = { self, chunks, entries, size, verify };
+        s_decode_slice (&slice);
+        return;
+    }
+    load_slice_t *slices = (load_slice_t *) malloc (sizeof (load_slice_t) * workers);
+    zactor_t **actors = (zactor_t **) malloc (sizeof (zactor_t *) * workers);
+    size_t worker;
+    for (worker = 0; worker < workers; worker++) {
+        size_t first = size * worker / workers;
+        slices [worker].ledger = self;
+        slices [worker].chunks = chunks + first;
+        slices [worker].entries = entries + first;
+        slices [worker].size = size * (worker + 1) / workers - first;
+        slices [worker].verify = verify;
+        actors [worker] = zactor_new (s_load_worker, &slices [worker]);
+    }
+    //  Destroying each actor waits for it to finish
+    for (worker = 0; worker < workers; worker++)
+        zactor_destroy (&actors [worker]);
+    free (actors);
+    free (slices);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Drop the posts we replayed with damaged content, which are at the listed
+//  positions, in order. A post we evicted later keeps its place, as we must
+//  go on refusing it, and so does its ID. We call this while loading, before
+//  we build any of the indexes that we build on demand.
+
+static void
+s_drop_damaged (hydra_ledger_t *self, size_t *damaged, size_t count)
+{
+    size_t drops = 0;
+    size_t index;
+    for (index = 0; index < count; index++) {
+        size_t position = damaged [index];
+        //  A later copy of the post that checked out replaces this one
+        bool replaced = s_find_ident (self, s_post_ident (self, position)) != (int) position;
+        if (position < self->first && !replaced)
+            continue;
+        char post_ident [IDENT_SIZE * 2 + 1];
+        s_ident_encode (s_post_ident (self, position), post_ident);
+        zsys_warning ("hydra_ledger: damaged content, dropping post ident=%s", post_ident);
+        const char *location = s_post_location (self, position);
+        if (!replaced && hydra_blobs_digest (location))
+            zsys_file_delete (location);
+        damaged [drops++] = position;
+    }
+    if (drops == 0)
+        return;
+
+    //  Close up the post arrays over the dropped posts
+    size_t evicted_drops = 0;
+    size_t target = damaged [0] - self->snapshot_size;
+    size_t source;
+    index = 0;
+    for (source = target; source < self->size - self->snapshot_size; source++) {
+        if (index < drops && damaged [index] == source + self->snapshot_size) {
+            if (damaged [index] < self->first)
+                evicted_drops++;
+            else
+                self->content_bytes -= self->posts [source].content_size;
+            index++;
+            continue;
+        }
+        self->posts [target] = self->posts [source];
+        memcpy (self->idents + target * IDENT_SIZE, self->idents + source * IDENT_SIZE, IDENT_SIZE);
+        memcpy (self->parents + target * IDENT_SIZE, self->parents + source * IDENT_SIZE, IDENT_SIZE);
+        memcpy (self->digests + target * IDENT_SIZE, self->digests + source * IDENT_SIZE, IDENT_SIZE);
+        target++;
+    }
+    self->size -= drops;
+    self->unsaved -= drops;
+    self->first -= evicted_drops;
+    s_index_rebuild (self);
+    s_filter_rebuild (self);
+}
+
+
+//  A list of post positions, which we build while we replay the journal
+
+typedef struct {
+    size_t *positions;          //  Positions in the list
+    size_t size;                //  Number of positions
+    size_t max_size;            //  Positions we have room for
+} position_list_t;
+
+static void
+s_position_add (position_list_t *list, size_t position)
+{
+    if (list->size == list->max_size) {
+        list->max_size = list->max_size? list->max_size * 2: 16;
+        list->positions = (size_t *) realloc (list->positions, sizeof (size_t) * list->max_size);
+    }
+    list->positions [list->size++] = position;
+}
+
+//  Remove the position from the list, if it is there. Returns true if it
+//  was in the list.
+
+static bool
+s_position_remove (position_list_t *list, size_t position)
+{
+    size_t index = list->size;
+    while (index--)
+        if (list->positions [index] == position) {
+            list->positions [index] = list->positions [--list->size];
+            return true;
+        }
+    return false;
+}
+
+static bool
+s_position_listed (position_list_t *list, size_t position)
+{
+    size_t index = list->size;
+    while (index--)
+        if (list->positions [index] == position)
+            return true;
+    return false;
+}
+
+static int
+s_position_compare (const void *item1, const void *item2)
+{
+    size_t position1 = *(const size_t *) item1;
+    size_t position2 = *(const size_t *) item2;
+    return position1 < position2? -1: position1 > position2? 1: 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Check the content of the listed posts against their digests, a batch at
+//  a time, hashing on our worker threads, and add those that fail to the
+//  damaged list.
+
+static void
+s_verify_posts (hydra_ledger_t *self, position_list_t *posts, position_list_t *damaged)
+{
+    zchunk_t **chunks = (zchunk_t **) malloc (sizeof (zchunk_t *) * LOAD_BATCH);
+    decoded_post_t *entries = (decoded_post_t *) malloc (sizeof (decoded_post_t) * LOAD_BATCH);
+    size_t done = 0;
+    while (done < posts->size) {
+        size_t size = 0;
+        while (done + size < posts->size && size < LOAD_BATCH) {
+            size_t position = posts->positions [done + size];
+            chunks [size] = hydra_journal_read (self->journal, s_post_offset (self, position));
+            if (!chunks [size])
+                chunks [size] = zchunk_new (NULL, 0);
+            size++;
+        }
+        s_decode_batch (self, chunks, entries, size, true);
+        size_t index;
+        for (index = 0; index < size; index++) {
+            if (!entries [index].valid || entries [index].damaged)
+                s_position_add (damaged, posts->positions [done + index]);
+            zstr_free (&entries [index].location);
+            zstr_free (&entries [index].mime_type);
+            zchunk_destroy (&chunks [index]);
+        }
+        done += size;
+    }
+    free (chunks);
+    free (entries);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Replay journal records into the ledger, starting with the record we have
+//  already read. We read records in batches, decode each batch, and then add
+//  the posts in journal order. As we go we only check that post content is
+//  there; at the end we hash the content of the posts after the last
+//  checkpoint marker.
+
+static void
+s_replay_journal (hydra_ledger_t *self, zchunk_t *chunk)
+{
+    zchunk_t **chunks = (zchunk_t **) malloc (sizeof (zchunk_t *) * LOAD_BATCH);
+    decoded_post_t *entries = (decoded_post_t *) malloc (sizeof (decoded_post_t) * LOAD_BATCH);
+    position_list_t damaged = { NULL, 0, 0 };       //  Posts with damaged content
+    position_list_t unchecked = { NULL, 0, 0 };     //  Posts since the last marker
+    while (chunk) {
+        size_t size = 0;
+        while (chunk && size < LOAD_BATCH) {
+            chunks [size] = chunk;
+            entries [size].offset = hydra_journal_cursor (self->journal);
+            size++;
+            chunk = hydra_journal_next (self->journal);
+        }
+        s_decode_batch (self, chunks, entries, size, false);
+        size_t index;
+        for (index = 0; index < size; index++) {
+            //  A post with damaged content may have been stored again
+            //  later, and then the later copy replaces it
+            decoded_post_t *entry = &entries [index];
+            int known = entry->valid? s_find_ident (self, entry->ident): -1;
+            if (known >= 0 && s_position_remove (&unchecked, known)) {
+                size_t position = known;
+                position_list_t check = { &position, 1, 1 };
+                s_verify_posts (self, &check, &damaged);
+            }
+            if (entry->valid
+            &&  (known == -1 || s_position_listed (&damaged, known))) {
+                if (entry->damaged)
+                    s_position_add (&damaged, self->size);
+                else
+                    s_position_add (&unchecked, self->size);
+                s_add_post (self, entry);
+            }
+            else {
+                zstr_free (&entries [index].location);
+                zstr_free (&entries [index].mime_type);
+                //  Eviction was done when the record was written; we only
+                //  need to forget the posts again
+                while (self->first < self->size
+                &&     s_post_offset (self, self->first) < entries [index].horizon)
+                    self->content_bytes -= s_post_content_size (self, self->first++);
+                //  A checkpoint vouches for the posts before it
+                if (entries [index].checkpoint)
+                    unchecked.size = 0;
+            }
+            zchunk_destroy (&chunks [index]);
+        }
+    }
+    free (chunks);
+    free (entries);
+    s_verify_posts (self, &unchecked, &damaged);
+    qsort (damaged.positions, damaged.size, sizeof (size_t), s_position_compare);
+    s_drop_damaged (self, damaged.positions, damaged.size);
+    free (damaged.positions);
+    free (unchecked.positions);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return number of CPU cores, which is our default number of load workers
+
+static size_t
+s_cpu_cores (void)
+{
+    long cores = 1;
+#if defined (__WINDOWS__)
+    SYSTEM_INFO info;
+    GetSystemInfo (&info);
+    cores = info.dwNumberOfProcessors;
+#elif defined (_SC_NPROCESSORS_ONLN)
+    cores = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+    return cores > 1? (size_t) cores: 1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  The fetch cache is keyed by post position + 1, so we hash small integers
+
+static size_t
+s_cache_key_hash (const void *key)
+{
+    return (size_t) key;
+}
+
+static int
+s_cache_key_compare (const void *key1, const void *key2)
+{
+    return (size_t) key1 == (size_t) key2? 0: 1;
+}
+
+static void
+s_cache_entry_destroy (void **item_p)
+{
+    cache_entry_t *entry = (cache_entry_t *) *item_p;
+    if (entry) {
+        hydra_post_destroy (&entry->post);
+        free (entry);
+        *item_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add a post to the fetch cache, evicting the least recently used post if
+//  the cache is full. Takes ownership of the post.
+
+static void
+s_cache_insert (hydra_ledger_t *self, size_t position, hydra_post_t *post)
+{
+    if (zlistx_size (self->cache) == CACHE_LIMIT) {
+        zlistx_last (self->cache);
+        void *handle = zlistx_cursor (self->cache);
+        cache_entry_t *entry = (cache_entry_t *) zlistx_handle_item (handle);
+        zhashx_delete (self->cache_index, (void *) (entry->position + 1));
+        zlistx_delete (self->cache, handle);
+    }
+    cache_entry_t *entry = (cache_entry_t *) zmalloc (sizeof (cache_entry_t));
+    entry->position = position;
+    entry->post = post;
+    void *handle = zlistx_add_start (self->cache, entry);
+    zhashx_insert (self->cache_index, (void *) (position + 1), handle);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Quarantine the post at the specified position, marking whether we moved
+//  its content aside, and drop it from the fetch cache
+
+static void
+s_quarantine_mark (hydra_ledger_t *self, size_t position, void *mark)
+{
+    if (!self->quarantine) {
+        self->quarantine = zhashx_new ();
+        zhashx_set_key_hasher (self->quarantine, s_cache_key_hash);
+        zhashx_set_key_comparator (self->quarantine, s_cache_key_compare);
+        zhashx_set_key_duplicator (self->quarantine, NULL);
+        zhashx_set_key_destructor (self->quarantine, NULL);
+    }
+    zhashx_update (self->quarantine, (void *) (position + 1), mark);
+    void *handle = zhashx_lookup (self->cache_index, (void *) (position + 1));
+    if (handle) {
+        zhashx_delete (self->cache_index, (void *) (position + 1));
+        zlistx_delete (self->cache, handle);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Evict the oldest posts until the ledger is within its retention limits.
+//  We always keep the newest post. We record the eviction in the journal
+//  before deleting any content, so a crash can at worst leave an orphan
+//  blob behind. Evicted posts stay in the index, and checkpoints keep them,
+//  so we can refuse them if peers offer them again.
+
+static void
+s_enforce_retention (hydra_ledger_t *self)
+{
+    int64_t too_old = self->max_age? (int64_t) time (NULL) - self->max_age: 0;
+    size_t first = self->first;
+    size_t content_bytes = self->content_bytes;
+    while (first + 1 < self->size
+    &&    ((self->max_posts && self->size - first > self->max_posts)
+    ||     (self->max_bytes && content_bytes > self->max_bytes)
+    ||     (too_old && s_post_timestamp (self, first) < too_old)))
+        content_bytes -= s_post_content_size (self, first++);
+    if (first == self->first)
+        return;
+
+    byte record [EVICT_SIZE];
+    record [0] = EVICT_RECORD;
+    hydra_util_put_number8 (record + 1, (uint64_t) s_post_offset (self, first));
+    zchunk_t *chunk = zchunk_new (record, EVICT_SIZE);
+    int64_t offset = hydra_journal_append (self->journal, chunk);
+    zchunk_destroy (&chunk);
+    //  The eviction record must reach the file, or the disk if we are
+    //  durable, before we delete any content it covers
+    if (offset < 0
+    ||  (self->durable? hydra_journal_sync (self->journal)
+                      : hydra_journal_flush (self->journal)))
+        return;                 //  Keep the posts, we'll try again later
+
+    zsys_info ("hydra_ledger: evict %zd posts, %zd bytes",
+               first - self->first, self->content_bytes - content_bytes);
+    hydra_blobs_t *blobs = s_blobs (self);
+    for (; self->first < first; self->first++) {
+        const char *digest = hydra_blobs_digest (s_post_location (self, self->first));
+        if (digest && !s_quarantined_aside (self, self->first)
+        &&  hydra_blobs_unref (blobs, digest) == 0 && self->packs_size)
+            s_pack_release (self, digest);
+        if (self->times)
+            s_times_remove (self, s_post_timestamp (self, self->first), self->first);
+        void *handle = zhashx_lookup (self->cache_index, (void *) (self->first + 1));
+        if (handle) {
+            zhashx_delete (self->cache_index, (void *) (self->first + 1));
+            zlistx_delete (self->cache, handle);
+        }
+        if (self->quarantine)
+            zhashx_delete (self->quarantine, (void *) (self->first + 1));
+    }
+    self->content_bytes = content_bytes;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return why we won't store the post, or NULL if we will. We don't store
+//  posts we hold or evicted, nor posts older than the retention age limit.
+
+static const char *
+s_refusal (hydra_ledger_t *self, hydra_post_t *post)
+{
+    if (s_find (self, hydra_post_ident (post)) >= 0)
+        return "duplicate post";
+    if (self->max_age
+    &&  s_post_time (hydra_post_timestamp (post)) < (int64_t) time (NULL) - self->max_age)
+        return "post too old";
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Stop serving posts from the specified position on, after we failed to
+//  write them. They may not be on disk, so we hold them back until we next
+//  load, when the journal tells us which ones made it.
+
+static void
+s_withhold (hydra_ledger_t *self, size_t first)
+{
+    zsys_error ("hydra_ledger: cannot write %zd posts, withholding them",
+                self->size - first);
+    size_t position;
+    for (position = first; position < self->size; position++)
+        s_quarantine_mark (self, position, QUARANTINE_HELD);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return true if the blob at the location holds content that matches its
+//  digest.
+
+static bool
+s_blob_intact (const char *location, const char *digest)
+{
+    FILE *input = fopen (location, "rb");
+    if (!input)
+        return false;
+    zdigest_t *check = zdigest_new ();
+    byte *buffer = (byte *) malloc (COPY_BLOCK);
+    size_t got;
+    while ((got = fread (buffer, 1, COPY_BLOCK, input)) > 0)
+        zdigest_update (check, buffer, got);
+    bool intact = !ferror (input) && streq (zdigest_string (check), digest);
+    free (buffer);
+    zdigest_destroy (&check);
+    fclose (input);
+    return intact;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Quarantine a damaged post, and list it on disk so it stays quarantined.
+//  If its content is damaged and held in a blob, we move the blob aside, so
+//  we'll write good content with that digest if we get it, and the post
+//  drops its reference to the blob. When other posts use the blob we first
+//  hash it again, and leave it in place if it is good.
+
+static void
+s_quarantine (hydra_ledger_t *self, size_t position, const char *damage, bool content)
+{
+    char post_ident [IDENT_SIZE * 2 + 1];
+    s_ident_encode (s_post_ident (self, position), post_ident);
+    zsys_warning ("hydra_ledger: quarantine post, %s, ident=%s", damage, post_ident);
+
+    zsys_dir_create (QUARANTINE_DIR);
+    FILE *output = fopen (QUARANTINE_FILE, "a");
+    if (output) {
+        fprintf (output, "%s\n", post_ident);
+        fclose (output);
+    }
+    const char *location = s_post_location (self, position);
+    const char *digest = hydra_blobs_digest (location);
+    if (content && digest && !s_pack_find (self, digest, NULL)
+    &&  !(hydra_blobs_refs (s_blobs (self), digest) > 1 && s_blob_intact (location, digest))) {
+        char *aside = zsys_sprintf (QUARANTINE_DIR "/%s", digest);
+        hydra_util_file_rename (location, aside);
+        zstr_free (&aside);
+        hydra_blobs_unref (self->blobs, digest);
+        s_quarantine_mark (self, position, QUARANTINE_ASIDE);
+    }
+    else
+        s_quarantine_mark (self, position, QUARANTINE_HELD);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Quarantine the posts listed on disk, if we still hold them
+
+static void
+s_load_quarantine (hydra_ledger_t *self)
+{
+    FILE *input = fopen (QUARANTINE_FILE, "r");
+    if (!input)
+        return;
+    char post_ident [IDENT_SIZE * 2 + 2];
+    while (fgets (post_ident, sizeof (post_ident), input)) {
+        post_ident [strcspn (post_ident, "\r\n")] = 0;
+        int position = s_find (self, post_ident);
+        if (position >= (int) self->first)
+            s_quarantine_mark (self, position, QUARANTINE_HELD);
+    }
+    fclose (input);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Check the journal record of a post against what we indexed for it. We
+//  work out the post ID again from the metadata, so this catches damage to
+//  any field that goes into the ID. Returns the damage, or NULL if none.
+
+static const char *
+s_scrub_metadata (hydra_ledger_t *self, size_t position, hydra_post_t *post)
+{
+    if (!post)
+        return "metadata is unreadable";
+    if (hydra_post_verify_ident (post))
+        return "metadata does not match post ID";
+    decoded_post_t decoded;
+    s_decode_post (&decoded, post);
+    zstr_free (&decoded.location);
+    zstr_free (&decoded.mime_type);
+    if (!decoded.valid
+    ||  memcmp (decoded.ident, s_post_ident (self, position), IDENT_SIZE))
+        return "metadata does not match post ID";
+    if (memcmp (decoded.digest, s_post_digest (self, position), IDENT_SIZE)
+    ||  decoded.content_size != s_post_content_size (self, position))
+        return "metadata does not match index";
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Open the content of the post we are scrubbing, and start hashing it.
+//  Returns the damage, or NULL if there is none so far.
+
+static const char *
+s_scrub_open (hydra_ledger_t *self)
+{
+    hydra_post_t *post = self->scrub_post;
+    const char *location = hydra_post_location (post);
+    int pack_position;
+    const char *digest = hydra_blobs_digest (location);
+    hydra_pack_t *pack = digest? s_pack_find (self, digest, &pack_position): NULL;
+    FILE *input;
+    if (pack) {
+        input = fopen (hydra_pack_filename (pack), "rb");
+        if (input
+        &&  fseek (input, (long) hydra_pack_offset (pack, pack_position), SEEK_SET)) {
+            fclose (input);
+            input = NULL;
+        }
+    }
+    else {
+        input = fopen (location, "rb");
+        if (input
+        &&  zsys_file_size (location) != (ssize_t) hydra_post_content_size (post)) {
+            fclose (input);
+            return "content is the wrong size";
+        }
+    }
+    if (!input)
+        return "content is missing";
+    self->scrub_input = input;
+    self->scrub_digest = zdigest_new ();
+    self->scrub_left = hydra_post_content_size (post);
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Finish with the post we are scrubbing, quarantining it if damaged,
+//  unless we evicted it while we were hashing its content.
+
+static void
+s_scrub_close (hydra_ledger_t *self, const char *damage, bool content)
+{
+    if (self->scrub_input) {
+        fclose (self->scrub_input);
+        self->scrub_input = NULL;
+    }
+    zdigest_destroy (&self->scrub_digest);
+    hydra_post_destroy (&self->scrub_post);
+    if (damage && self->scrub_cursor >= self->first)
+        s_quarantine (self, self->scrub_cursor, damage, content);
+    self->scrub_cursor++;
+    self->scrub_posts++;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Wait until the disk has the file, which may be a directory. Returns 0 if
+//  OK, -1 if that failed.
+
+static int
+s_file_sync (const char *filename)
+{
+#if defined (__WINDOWS__)
+    //  Windows cannot sync directories, nor does it need to
+    if (zsys_file_mode (filename) & S_IFDIR)
+        return 0;
+    int handle = _open (filename, _O_RDWR);
+    if (handle == -1)
+        return -1;
+    int rc = _commit (handle);
+    _close (handle);
+#else
+    int handle = open (filename, O_RDONLY);
+    if (handle == -1)
+        return -1;
+    int rc = fsync (handle);
+    close (handle);
+#endif
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Write posts stored since the last commit through to the journal. If the
+//  ledger is durable, wait until the disk has the journal records and any
+//  new blobs. Returns 0 if OK, -1 if that failed.
+
+static int
+s_commit (hydra_ledger_t *self)
+{
+    if (!self->durable)
+        return hydra_journal_flush (self->journal);
+
+    int rc = 0;
+    if (zlist_size (self->batch_blobs)) {
+        const char *location = (const char *) zlist_first (self->batch_blobs);
+        while (location) {
+            if (s_file_sync (location))
+                rc = -1;
+            location = (const char *) zlist_next (self->batch_blobs);
+        }
+        zlist_purge (self->batch_blobs);
+        if (s_file_sync (BLOBS_DIR))
+            rc = -1;
+    }
+    if (hydra_journal_sync (self->journal))
+        rc = -1;
+    if (rc)
+        zsys_error ("hydra_ledger: cannot sync posts to disk");
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Append post to the journal and index it. Returns 0 if OK, -1 if the post
+//  could not be written.
+
+static int
+s_append_post (hydra_ledger_t *self, hydra_post_t *post)
+{
+    bool new_blob = !hydra_post_location (post);
+    if (hydra_post_save_content (post))
+        return -1;
+    if (self->durable && new_blob && hydra_post_location (post))
+        zlist_append (self->batch_blobs, (void *) hydra_post_location (post));
+    zchunk_t *chunk = hydra_post_pack (post);
+    int64_t offset = hydra_journal_append (self->journal, chunk);
+    zchunk_destroy (&chunk);
+    if (offset < 0)
+        return -1;
+    s_have_new_post (self, post, offset);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Migrate post files left by older versions into the journal, oldest first.
+//  Returns the list of post files we migrated, which the caller deletes
+//  once the journal is safely on disk.
+
+static zlist_t *
+s_migrate_post_files (hydra_ledger_t *self)
+{
+    zdir_t *dir = zdir_new ("posts", "-");
+    zfile_t **files = zdir_flatten (dir);
+    zlist_t *migrated = zlist_new ();
+    zlist_autofree (migrated);
+
+    uint index;
+    for (index = 0; files [index]; index++) {
+        char *filename = zfile_filename (files [index], NULL);
+        assert (memcmp (filename, "posts/", 6) == 0);
+        if (memcmp (filename, "posts/blobs/", 12) == 0
+        ||  memcmp (filename, "posts/staging/", 14) == 0
+        ||  streq (filename, JOURNAL_FILE)
+        ||  streq (filename, JOURNAL_TEMP))
+            continue;
+        hydra_post_t *post = hydra_post_load (filename + 6);
+        if (post) {
+            if (s_find (self, hydra_post_ident (post)) == -1) {
+                if (s_append_post (self, post) == 0)
+                    zlist_append (migrated, filename);
+            }
+            else {
+                zsys_warning ("hydra_ledger: duplicate post, ident=%s", hydra_post_ident (post));
+                zlist_append (migrated, filename);
+            }
+            hydra_post_destroy (&post);
+        }
+    }
+    if (zlist_size (migrated))
+        zsys_info ("hydra_ledger: migrated %zu post files to %s",
+                   zlist_size (migrated), JOURNAL_FILE);
+    zdir_flatten_free (&files);
+    zdir_destroy (&dir);
+    return migrated;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new journal, holding any post files left by older versions. We
+//  build it under a temporary name, and give it its real name only once it
+//  is on disk; until then, the post files are the only copy of those posts.
+//  Returns 0 if OK, -1 if the journal could not be created.
+
+static int
+s_create_journal (hydra_ledger_t *self)
+{
+    //  A journal left by a crashed migration is incomplete; start over
+    zsys_file_delete (JOURNAL_TEMP);
+    self->journal = hydra_journal_new (JOURNAL_TEMP);
+    if (!self->journal)
+        return -1;
+
+    zlist_t *migrated = s_migrate_post_files (self);
+    int rc = hydra_journal_sync (self->journal);
+    hydra_journal_destroy (&self->journal);
+    //  Any snapshot or word index we have refers to some other journal
+    zsys_file_delete (INDEX_FILE);
+    zsys_file_delete (WORDS_FILE);
+    if (rc == 0)
+        rc = hydra_util_file_rename (JOURNAL_TEMP, JOURNAL_FILE);
+    if (rc == 0) {
+        char *filename = (char *) zlist_first (migrated);
+        while (filename) {
+            zsys_file_delete (filename);
+            filename = (char *) zlist_next (migrated);
+        }
+        self->journal = hydra_journal_new (JOURNAL_FILE);
+    }
+    zlist_destroy (&migrated);
+    return self->journal? 0: -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Load the index snapshot, if there is one, and check it against the
+//  journal: the last post in the snapshot must be the journal record it
+//  points to. If not, we ignore the snapshot and replay the whole journal.
+
+static void
+s_load_snapshot (hydra_ledger_t *self)
+{
+    hydra_snapshot_t *snapshot = hydra_snapshot_load (INDEX_FILE);
+    if (!snapshot)
+        return;
+
+    bool valid = hydra_snapshot_journal_size (snapshot) <= hydra_journal_size (self->journal);
+    size_t size = hydra_snapshot_size (snapshot);
+    if (valid && size > 0) {
+        valid = false;
+        zchunk_t *chunk = hydra_journal_read (self->journal,
+                          hydra_snapshot_offset (snapshot, size - 1));
+        hydra_post_t *post = chunk? hydra_post_unpack (chunk): NULL;
+        byte ident [IDENT_SIZE];
+        if (post && s_ident_decode (hydra_post_ident (post), ident) == 0)
+            valid = memcmp (hydra_snapshot_ident (snapshot, size - 1), ident, IDENT_SIZE) == 0;
+        hydra_post_destroy (&post);
+        zchunk_destroy (&chunk);
+    }
+    if (valid) {
+        self->snapshot = snapshot;
+        self->snapshot_size = self->size = size;
+        self->first = hydra_snapshot_evicted (snapshot);
+        self->content_bytes = (size_t) hydra_snapshot_content_bytes (snapshot);
+        //  Use the saved filter if it is the size we'd make it
+        size_t filter_blocks = self->filter_blocks;
+        while (filter_blocks * FILTER_POSTS < size)
+            filter_blocks *= 2;
+        if (hydra_snapshot_filter_size (snapshot) == filter_blocks * FILTER_BLOCK) {
+            self->filter_blocks = filter_blocks;
+            free (self->filter);
+            self->filter = (uint64_t *) malloc (sizeof (uint64_t) * FILTER_BLOCK * filter_blocks);
+            hydra_snapshot_filter (snapshot, self->filter);
+        }
+        else
+            s_filter_rebuild (self);
+    }
+    else {
+        zsys_warning ("hydra_ledger: %s does not match journal, ignoring", INDEX_FILE);
+        hydra_snapshot_destroy (&snapshot);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Older nodes kept all blobs in posts/blobs, which gets slow to work with
+//  once it holds many files. Move any such blobs into the sharded layout
+//  we use now; hydra_post maps the old locations as it reads posts. We mark
+//  the blobs directory when done so that we only need to look once.
+
+static void
+s_migrate_blobs (void)
+{
+    if (zsys_file_exists (BLOBS_LAYOUT))
+        return;
+
+    size_t moved = 0;
+    zdir_t *dir = zdir_new ("posts/blobs", "-");
+    if (dir) {
+        zfile_t **files = zdir_flatten (dir);
+        uint index;
+        for (index = 0; files [index]; index++) {
+            const char *filename = zfile_filename (files [index], NULL);
+            const char *digest = filename + strlen (BLOBS_DIR);
+            if (strncmp (filename, BLOBS_DIR, strlen (BLOBS_DIR))
+            ||  strlen (digest) != IDENT_SIZE * 2)
+                continue;
+            char *location = hydra_blobs_location (digest);
+            zsys_dir_create (BLOBS_DIR "%.2s", digest);
+            if (rename (filename, location) == 0)
+                moved++;
+            zstr_free (&location);
+        }
+        zdir_flatten_free (&files);
+        zdir_destroy (&dir);
+    }
+    if (moved) {
+        zsys_info ("hydra_ledger: moved %zd blobs to new layout", moved);
+        //  The index snapshot holds the old blob locations
+        zsys_file_delete (INDEX_FILE);
+    }
+    zsys_dir_create ("posts/blobs");
+    FILE *marker = fopen (BLOBS_LAYOUT, "w");
+    if (marker) {
+        fprintf (marker, "2\n");
+        fclose (marker);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Delete any files left in the staging area, which are blobs and post files
+//  that a crash interrupted before they were complete.
+
+static void
+s_clear_staging (void)
+{
+    zdir_t *dir = zdir_new (STAGING_DIR, "-");
+    if (dir) {
+        zfile_t **files = zdir_flatten (dir);
+        uint index;
+        for (index = 0; files [index]; index++)
+            zfile_remove (files [index]);
+        zdir_flatten_free (&files);
+        zdir_destroy (&dir);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Open our pack files, and delete any that a crash interrupted before they
+//  were complete.
+
+static void
+s_load_packs (hydra_ledger_t *self)
+{
+    zdir_t *dir = zdir_new (PACKS_DIR, "-");
+    if (!dir)
+        return;
+    zfile_t **files = zdir_flatten (dir);
+    uint index;
+    for (index = 0; files [index]; index++) {
+        const char *filename = zfile_filename (files [index], NULL);
+        size_t length = strlen (filename);
+        if (length > 4 && streq (filename + length - 4, ".tmp"))
+            zfile_remove (files [index]);
+        else
+        if (length > 5 && streq (filename + length - 5, ".pack")) {
+            hydra_pack_t *pack = hydra_pack_load (filename);
+            if (!pack)
+                continue;
+            self->packs = (hydra_pack_t **) realloc (self->packs,
+                sizeof (hydra_pack_t *) * (self->packs_size + 1));
+            self->packs [self->packs_size++] = pack;
+            size_t number = strtoul (filename + strlen (PACKS_DIR) + 1, NULL, 10);
+            if (self->pack_next <= number)
+                self->pack_next = number + 1;
+        }
+    }
+    zdir_flatten_free (&files);
+    zdir_destroy (&dir);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Open the journal if not already open, and replay it into the ledger,
+//  starting after the index snapshot if we have a valid one. If the journal
+//  is new, migrates any old post files into it instead. Returns 0 if OK, -1
+//  if the journal could not be opened.
+
+static int
+s_open_journal (hydra_ledger_t *self)
+{
+    if (self->journal)
+        return 0;
+
+    zsys_dir_create ("posts");
+    s_clear_staging ();
+    s_migrate_blobs ();
+    s_load_packs (self);
+    if (!zsys_file_exists (JOURNAL_FILE)) {
+        if (s_create_journal (self)) {
+            zsys_error ("hydra_ledger: cannot create %s", JOURNAL_FILE);
+            return -1;
+        }
+        s_load_quarantine (self);
+        return 0;
+    }
+    self->journal = hydra_journal_new (JOURNAL_FILE);
+    if (!self->journal) {
+        zsys_error ("hydra_ledger: cannot open %s", JOURNAL_FILE);
+        return -1;
+    }
+    s_load_snapshot (self);
+    zchunk_t *chunk;
+    if (self->snapshot_size) {
+        //  Skip the last post in the snapshot, which we already checked
+        hydra_journal_seek (self->journal,
+            hydra_snapshot_offset (self->snapshot, self->snapshot_size - 1));
+        chunk = hydra_journal_next (self->journal);
+        zchunk_destroy (&chunk);
+        chunk = hydra_journal_next (self->journal);
+    }
+    else
+        chunk = hydra_journal_first (self->journal);
+
+    s_replay_journal (self, chunk);
+    s_load_quarantine (self);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new ledger instance. You must specify the directory that holds
+//  post files.
+
+hydra_ledger_t *
+hydra_ledger_new (void)
+{
+    hydra_ledger_t *self = (hydra_ledger_t *) zmalloc (sizeof (hydra_ledger_t));
+    if (self) {
+        self->max_size = 256;      //  Arbitrary, this is expanded on demand
+        self->workers = s_cpu_cores ();
+        self->posts = (ledger_post_t *) malloc (sizeof (ledger_post_t) * self->max_size);
+        self->idents = (byte *) malloc (IDENT_SIZE * self->max_size);
+        self->parents = (byte *) malloc (IDENT_SIZE * self->max_size);
+        self->digests = (byte *) malloc (IDENT_SIZE * self->max_size);
+        self->index_limit = self->max_size * 2;
+        self->post_index = (uint32_t *) zmalloc (sizeof (uint32_t) * self->index_limit);
+        self->locations_max = 16384;
+        self->locations = (char *) malloc (self->locations_max);
+        self->filter_blocks = self->max_size / FILTER_POSTS;
+        self->filter = (uint64_t *) zmalloc (
+            sizeof (uint64_t) * FILTER_BLOCK * self->filter_blocks);
+    }
+    if (self->posts && self->idents && self->parents && self->digests
+    &&  self->post_index && self->locations && self->filter)
+        self->cache = zlistx_new ();
+    if (self->cache) {
+        zlistx_set_destructor (self->cache, s_cache_entry_destroy);
+        self->cache_index = zhashx_new ();
+    }
+    if (self->cache_index) {
+        zhashx_set_key_hasher (self->cache_index, s_cache_key_hash);
+        zhashx_set_key_comparator (self->cache_index, s_cache_key_compare);
+        zhashx_set_key_duplicator (self->cache_index, NULL);
+        zhashx_set_key_destructor (self->cache_index, NULL);
+        self->batch_blobs = zlist_new ();
+    }
+    if (self->batch_blobs)
+        zlist_autofree (self->batch_blobs);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy the ledger instance
+
+void
+hydra_ledger_destroy (hydra_ledger_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        hydra_ledger_t *self = *self_p;
+        hydra_journal_destroy (&self->journal);
+        hydra_snapshot_destroy (&self->snapshot);
+        zhashx_destroy (&self->cache_index);
+        zlistx_destroy (&self->cache);
+        hydra_blobs_destroy (&self->blobs);
+        zlist_destroy (&self->batch_blobs);
+        while (self->packs_size)
+            hydra_pack_destroy (&self->packs [--self->packs_size]);
+        free (self->packs);
+        free (self->packs_live);
+        free (self->times);
+        zhashx_destroy (&self->children);
+        free (self->siblings);
+        free (self->column_times);
+        free (self->column_sizes);
+        free (self->column_digests);
+        free (self->column_types);
+        while (self->types_size)
+            free (self->types [--self->types_size]);
+        free (self->types);
+        zhashx_destroy (&self->type_codes);
+        hydra_words_destroy (&self->words);
+        zhashx_destroy (&self->quarantine);
+        if (self->scrub_input)
+            fclose (self->scrub_input);
+        zdigest_destroy (&self->scrub_digest);
+        hydra_post_destroy (&self->scrub_post);
+        //  Free posts held in memory
+        free (self->posts);
+        free (self->idents);
+        free (self->parents);
+        free (self->digests);
+        free (self->post_index);
+        free (self->locations);
+        free (self->filter);
+        //  Free object instance
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return ledger size, i.e. number of posts stored in the ledger.
+
+size_t
+hydra_ledger_size (hydra_ledger_t *self)
+{
+    assert (self);
+    return self->size - self->first;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the number of threads the ledger uses to decode posts when loading.
+//  Defaults to the number of CPU cores; 1 means load on the calling thread.
+
+void
+hydra_ledger_set_workers (hydra_ledger_t *self, size_t workers)
+{
+    assert (self);
+    self->workers = workers? workers: 1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set retention limits on the ledger: the maximum number of posts, total
+//  bytes of post content, and post age in seconds. Zero means no limit.
+//  When the ledger exceeds any limit it evicts its oldest posts, deleting
+//  their content, until it is within all limits again. It does not store
+//  posts older than the age limit. Defaults to no limits.
+
+void
+hydra_ledger_set_retention (hydra_ledger_t *self, size_t max_posts,
+                            size_t max_bytes, int64_t max_age)
+{
+    assert (self);
+    self->max_posts = max_posts;
+    self->max_bytes = max_bytes;
+    self->max_age = max_age;
+    if (self->journal)
+        s_enforce_retention (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Load the ledger data from disk, from the specified directory. Returns the
+//  number of posts loaded, or -1 if there was an error reading the directory.
+//  Not valid if the ledger already has posts loaded.
+
+int
+hydra_ledger_load (hydra_ledger_t *self)
+{
+    assert (self);
+    assert (self->size == 0);
+    assert (!self->journal);
+
+    if (s_open_journal (self))
+        return -1;
+    s_enforce_retention (self);
+    return hydra_ledger_size (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Save a post via the ledger. This saves the post content to disk, appends
+//  the post to the ledger journal, adds the post to the ledger, and then
+//  destroys the post. Returns 0 if OK, -1 if the post could not be saved.
+//  If the ledger already has the post, or evicted it, or the post is older
+//  than the retention age limit, does nothing except destroy it.
+
+int
+hydra_ledger_store (hydra_ledger_t *self, hydra_post_t **post_p)
+{
+    assert (self);
+    assert (post_p && *post_p);
+    hydra_post_t *post = *post_p;
+
+    int rc = s_open_journal (self);
+    if (rc == 0) {
+        const char *refusal = s_refusal (self, post);
+        if (refusal)
+            zsys_warning ("hydra_ledger: %s, ident=%s", refusal, hydra_post_ident (post));
+        else {
+            zsys_info ("hydra_ledger: store post, ident=%s bytes=%zd",
+                       hydra_post_ident (post), hydra_post_content_size (post));
+            rc = s_append_post (self, post);
+            if (rc == 0)
+                s_enforce_retention (self);
+            if (rc == 0 && !self->in_batch) {
+                rc = s_commit (self);
+                if (rc)
+                    s_withhold (self, self->size - 1);
+            }
+        }
+    }
+    hydra_post_destroy (post_p);
+    *post_p = NULL;
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Start a batch of stores. Posts stored until the next hydra_ledger_commit
+//  are indexed and fetchable at once, but are written to disk together when
+//  you commit, which is much faster than storing them one by one.
+
+void
+hydra_ledger_begin (hydra_ledger_t *self)
+{
+    assert (self);
+    assert (!self->in_batch);
+    if (s_open_journal (self) == 0) {
+        hydra_journal_set_buffered (self->journal, true);
+        self->in_batch = true;
+        self->batch_first = self->size;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  End a batch of stores, writing all posts stored since hydra_ledger_begin
+//  to disk. If the ledger is durable, does not return until the disk has
+//  them. Returns 0 if OK, -1 if the posts could not be written, in which
+//  case the ledger no longer serves them.
+
+int
+hydra_ledger_commit (hydra_ledger_t *self)
+{
+    assert (self);
+    if (!self->in_batch)
+        return -1;
+    self->in_batch = false;
+    hydra_journal_set_buffered (self->journal, false);
+    int rc = s_commit (self);
+    if (rc)
+        s_withhold (self, self->batch_first);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set whether the ledger waits until the disk has each post, or each batch
+//  of posts, before it reports the post as stored. This is safer if the
+//  system crashes, and slower. Defaults to false, in which case posts reach
+//  the disk when the operating system decides.
+
+void
+hydra_ledger_set_durable (hydra_ledger_t *self, bool durable)
+{
+    assert (self);
+    self->durable = durable;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return post at specified index; if the index does not refer to a valid
+//  post, or the post is quarantined, returns NULL. Recently fetched posts
+//  come from a cache, so do not touch the disk.
+
+hydra_post_t *
+hydra_ledger_fetch (hydra_ledger_t *self, int index)
+{
+    assert (self);
+    if (index < 0 || index >= hydra_ledger_size (self))
+        return NULL;
+
+    size_t position = self->first + index;
+    if (s_quarantined (self, position))
+        return NULL;
+    void *handle = zhashx_lookup (self->cache_index, (void *) (position + 1));
+    if (handle) {
+        self->cache_hits++;
+        zlistx_move_start (self->cache, handle);
+        cache_entry_t *entry = (cache_entry_t *) zlistx_handle_item (handle);
+        return hydra_post_dup (entry->post);
+    }
+    self->cache_misses++;
+    hydra_post_t *post = NULL;
+    zchunk_t *chunk = hydra_journal_read (self->journal, s_post_offset (self, position));
+    if (chunk) {
+        post = hydra_post_unpack (chunk);
+        zchunk_destroy (&chunk);
+    }
+    if (post) {
+        s_pack_resolve (self, post);
+        s_cache_insert (self, position, hydra_post_dup (post));
+    }
+    return post;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return number of fetches served from the ledger's post cache
+
+size_t
+hydra_ledger_cache_hits (hydra_ledger_t *self)
+{
+    assert (self);
+    return self->cache_hits;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return number of fetches that had to read the post from disk
+
+size_t
+hydra_ledger_cache_misses (hydra_ledger_t *self)
+{
+    assert (self);
+    return self->cache_misses;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Lookup post in ledger and return post index (0 .. size - 1); if the post
+//  does not exist, returns -1.
+
+int
+hydra_ledger_index (hydra_ledger_t *self, const char *post_ident)
+{
+    assert (self);
+    int position = s_find (self, post_ident);
+    return position >= (int) self->first? position - (int) self->first: -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return true if the ledger held the post and evicted it under its
+//  retention limits. The ledger will not store such a post again, so peers
+//  should not send it.
+
+bool
+hydra_ledger_evicted (hydra_ledger_t *self, const char *post_ident)
+{
+    assert (self);
+    int position = s_find (self, post_ident);
+    return position >= 0 && position < (int) self->first;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return false if the ledger definitely does not hold the post, or true if
+//  it probably does. This is faster than hydra_ledger_index, and almost
+//  always right; a few posts in a thousand may give a false "true".
+
+bool
+hydra_ledger_may_contain (hydra_ledger_t *self, const char *post_ident)
+{
+    assert (self);
+    byte ident [IDENT_SIZE];
+    if (s_ident_decode (post_ident, ident))
+        return false;
+    return s_filter_test (self, ident);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return true if the ledger holds content with the specified digest, as
+//  40 hex characters, whether or not a post uses it. Use this to avoid
+//  fetching or writing content we already have.
+
+bool
+hydra_ledger_has_blob (hydra_ledger_t *self, const char *digest)
+{
+    assert (self);
+    assert (digest);
+    return s_pack_find (self, digest, NULL)
+        || hydra_blobs_has (s_blobs (self), digest);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of posts with timestamps from since up to, but not
+//  including, until, in seconds since the epoch.
+
+size_t
+hydra_ledger_range_size (hydra_ledger_t *self, int64_t since, int64_t until)
+{
+    assert (self);
+    if (until <= since)
+        return 0;
+    s_times (self);
+    return s_times_slot (self, until, 0) - s_times_slot (self, since, 0);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Page through the posts with timestamps from since up to, but not
+//  including, until, in seconds since the epoch, oldest first. Skips the
+//  first offset posts in the range, and stores the indexes of at most limit
+//  posts after that into the indexes array. Returns the number of indexes
+//  stored. Posts with the same timestamp come in the order we stored them.
+
+size_t
+hydra_ledger_range (hydra_ledger_t *self, int64_t since, int64_t until,
+                    size_t offset, int *indexes, size_t limit)
+{
+    assert (self);
+    assert (indexes || limit == 0);
+    if (until <= since)
+        return 0;
+    s_times (self);
+    size_t slot = s_times_slot (self, since, 0);
+    size_t end = s_times_slot (self, until, 0);
+    size_t count = 0;
+    //  We skip quarantined posts, so unless there are any, we can go
+    //  straight to the offset
+    if (!self->quarantine) {
+        slot += offset < end - slot? offset: end - slot;
+        offset = 0;
+    }
+    for (; slot < end && count < limit; slot++) {
+        size_t position = self->times [slot].position;
+        if (s_quarantined (self, position))
+            continue;
+        if (offset)
+            offset--;
+        else
+            indexes [count++] = (int) (position - self->first);
+    }
+    return count;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Page through the replies to the specified post, oldest first. Skips the
+//  first offset replies, and stores the indexes of at most limit replies
+//  after that into the indexes array. Returns the number of indexes stored.
+//  The ledger does not need to hold the post itself.
+
+size_t
+hydra_ledger_children (hydra_ledger_t *self, const char *post_ident,
+                       size_t offset, int *indexes, size_t limit)
+{
+    assert (self);
+    assert (indexes || limit == 0);
+    byte ident [IDENT_SIZE];
+    if (s_ident_decode (post_ident, ident))
+        return 0;
+    s_children (self);
+
+    //  The list runs newest first, so count the replies, then fill the
+    //  page from the end
+    size_t replies = 0;
+    int position = s_children_first (self, ident);
+    for (; position >= 0; position = s_children_next (self, position))
+        if (!s_quarantined (self, position))
+            replies++;
+    if (offset >= replies)
+        return 0;
+    size_t count = replies - offset < limit? replies - offset: limit;
+    size_t reply = replies;
+    position = s_children_first (self, ident);
+    for (; position >= 0; position = s_children_next (self, position)) {
+        if (s_quarantined (self, position))
+            continue;
+        reply--;
+        if (reply >= offset && reply < offset + count)
+            indexes [reply - offset] = position - (int) self->first;
+    }
+    return count;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Page through the thread that starts at the specified post: the post, if
+//  the ledger holds it, then each of its replies followed by the replies to
+//  that reply, and so on, oldest first, as a threaded view shows them. Skips
+//  the first offset posts, and stores the indexes of at most limit posts
+//  after that into the indexes array. Returns the number of indexes stored.
+
+size_t
+hydra_ledger_thread (hydra_ledger_t *self, const char *post_ident,
+                     size_t offset, int *indexes, size_t limit)
+{
+    assert (self);
+    assert (indexes || limit == 0);
+    byte ident [IDENT_SIZE];
+    if (s_ident_decode (post_ident, ident))
+        return 0;
+    s_children (self);
+
+    //  Walk the thread depth first. We push the replies to each post newest
+    //  first, so that we pop the oldest first.
+    size_t stack_max = 256;
+    size_t *stack = (size_t *) malloc (sizeof (size_t) * stack_max);
+    size_t depth = 0;
+    size_t count = 0;
+    int position = s_find_ident (self, ident);
+    if (position >= (int) self->first && !s_quarantined (self, position)) {
+        if (offset == 0 && limit)
+            indexes [count++] = position - (int) self->first;
+        else
+        if (offset)
+            offset--;
+    }
+    const byte *parent = ident;
+    while (count < limit) {
+        position = s_children_first (self, parent);
+        for (; position >= 0; position = s_children_next (self, position)) {
+            if (depth == stack_max) {
+                stack_max *= 2;
+                stack = (size_t *) realloc (stack, sizeof (size_t) * stack_max);
+            }
+            stack [depth++] = (size_t) position;
+        }
+        if (depth == 0)
+            break;
+        //  We leave out a quarantined post, but not its replies
+        size_t reply = stack [--depth];
+        if (s_quarantined (self, reply))
+            ;
+        else
+        if (offset)
+            offset--;
+        else
+            indexes [count++] = (int) (reply - self->first);
+        parent = s_post_ident (self, reply);
+    }
+    free (stack);
+    return count;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of posts that match a query. A post matches if it has
+//  the specified MIME type, where "type/*" matches any subtype; content with
+//  the specified digest, as 40 hex characters; a content size from min_size
+//  to max_size bytes; and a timestamp from since up to, but not including,
+//  until, in seconds since the epoch. Pass NULL or 0 for any of these to
+//  match all posts.
+
+size_t
+hydra_ledger_query_size (hydra_ledger_t *self, const char *mime_type,
+                         const char *digest, size_t min_size, size_t max_size,
+                         int64_t since, int64_t until)
+{
+    assert (self);
+    ledger_query_t query;
+    if (s_query_prepare (self, &query, mime_type, digest,
+                         min_size, max_size, since, until))
+        return 0;
+    size_t matches = s_query_run (self, &query, 0, NULL, 0);
+    free (query.types);
+    return matches;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Page through the posts that match a query, in the order we stored them.
+//  The query is as for hydra_ledger_query_size. Skips the first offset
+//  posts that match, and stores the indexes of at most limit posts after
+//  that into the indexes array. Returns the number of indexes stored.
+
+size_t
+hydra_ledger_query (hydra_ledger_t *self, const char *mime_type,
+                    const char *digest, size_t min_size, size_t max_size,
+                    int64_t since, int64_t until,
+                    size_t offset, int *indexes, size_t limit)
+{
+    assert (self);
+    assert (indexes || limit == 0);
+    ledger_query_t query;
+    if (limit == 0
+    ||  s_query_prepare (self, &query, mime_type, digest,
+                         min_size, max_size, since, until))
+        return 0;
+    size_t matches = s_query_run (self, &query, offset, indexes, limit);
+    free (query.types);
+    return matches > offset? (matches - offset < limit? matches - offset: limit): 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Search the posts for the words in the query, in their subject and in
+//  their content if that is plain text, and page through the posts that
+//  hold every word, best match first. Skips the first offset posts found,
+//  and stores the indexes of at most limit posts after that into the
+//  indexes array. Returns the number of indexes stored. Searching does not
+//  read the posts; the first search in a session loads the word index.
+
+size_t
+hydra_ledger_search (hydra_ledger_t *self, const char *query,
+                     size_t offset, int *indexes, size_t limit)
+{
+    assert (self);
+    assert (query);
+    assert (indexes || limit == 0);
+    if (limit == 0 || s_open_journal (self))
+        return 0;
+    s_words (self);
+    uint64_t horizon = self->first < self->size
+        ? (uint64_t) s_post_offset (self, self->first)
+        : hydra_words_cursor (self->words);
+    //  We skip quarantined posts, which are few; if there are any, we
+    //  search from the first result, taking enough to page past them
+    size_t quarantined = self->quarantine? zhashx_size (self->quarantine): 0;
+    size_t wanted = quarantined? offset + limit + quarantined: limit;
+    uint64_t *keys = (uint64_t *) malloc (sizeof (uint64_t) * wanted);
+    size_t found = hydra_words_search (self->words, query, horizon, self->size - self->first,
+                                       quarantined? 0: offset, keys, wanted);
+    if (!quarantined)
+        offset = 0;
+    size_t count = 0;
+    size_t index;
+    for (index = 0; index < found && count < limit; index++) {
+        size_t position = s_offset_position (self, (int64_t) keys [index]);
+        if (position < self->size && s_post_offset (self, position) == (int64_t) keys [index]
+        &&  !s_quarantined (self, position)) {
+            if (offset)
+                offset--;
+            else
+                indexes [count++] = (int) (position - self->first);
+        }
+    }
+    free (keys);
+    return count;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Move the content of posts older than min_age seconds out of their blob
+//  files and into a new pack file, if there are at least min_blobs such
+//  blobs. Packs up to 64MB of content per call, so call this from time to
+//  time to compact the ledger bit by bit. Fetched posts read their content
+//  from packs or blob files as needed. Returns the number of blobs packed,
+//  or -1 if the pack could not be written.
+
+int
+hydra_ledger_compact (hydra_ledger_t *self, int64_t min_age, size_t min_blobs)
+{
+    assert (self);
+    if (s_open_journal (self))
+        return -1;
+
+    //  Collect the blobs to pack. Posts are in roughly time order, so we
+    //  remember where the run of posts we've looked at ends, and start there
+    //  next time.
+    int64_t horizon = (int64_t) time (NULL) - min_age;
+    zhashx_t *digests = zhashx_new ();
+    size_t position = self->pack_cursor > self->first? self->pack_cursor: self->first;
+    size_t cursor = position;
+    size_t bytes = 0;
+    for (; position < self->size && bytes < PACK_MAX_BYTES; position++) {
+        if (s_post_timestamp (self, position) > horizon)
+            continue;
+        if (cursor == position)
+            cursor = position + 1;
+        const char *digest = hydra_blobs_digest (s_post_location (self, position));
+        if (digest
+        &&  !s_pack_find (self, digest, NULL)
+        &&  !zhashx_lookup (digests, digest)) {
+            zhashx_insert (digests, digest, (void *) 1);
+            bytes += s_post_content_size (self, position);
+        }
+    }
+    if (zhashx_size (digests) == 0 || zhashx_size (digests) < min_blobs) {
+        zhashx_destroy (&digests);
+        return 0;
+    }
+    zsys_dir_create (PACKS_DIR);
+    char *filename = zsys_sprintf (PACK_FILE, self->pack_next++);
+    hydra_pack_t *pack = hydra_pack_new (filename);
+    zlist_t *packed = zlist_new ();
+    zlist_autofree (packed);
+    void *item = pack? zhashx_first (digests): NULL;
+    while (item) {
+        //  Blobs we cannot read are left as they are
+        const char *digest = (const char *) zhashx_cursor (digests);
+        char *location = hydra_blobs_location (digest);
+        if (hydra_pack_append (pack, digest, location) == 0)
+            zlist_append (packed, location);
+        zstr_free (&location);
+        item = zhashx_next (digests);
+    }
+    zhashx_destroy (&digests);
+
+    //  Once the disk has the pack, we can delete the blobs in it
+    int rc = 0;
+    if (!pack || hydra_pack_save (pack) || s_file_sync (PACKS_DIR))
+        rc = -1;
+    hydra_pack_destroy (&pack);
+    if (rc == 0 && zlist_size (packed))
+        pack = hydra_pack_load (filename);
+    if (pack) {
+        self->packs = (hydra_pack_t **) realloc (self->packs,
+            sizeof (hydra_pack_t *) * (self->packs_size + 1));
+        if (self->packs_live) {
+            self->packs_live = (size_t *) realloc (self->packs_live,
+                sizeof (size_t) * (self->packs_size + 1));
+            self->packs_live [self->packs_size] = hydra_pack_size (pack);
+        }
+        self->packs [self->packs_size++] = pack;
+        const char *location = (const char *) zlist_first (packed);
+        while (location) {
+            zsys_file_delete (location);
+            location = (const char *) zlist_next (packed);
+        }
+        //  Cached posts still point at the deleted blobs
+        zhashx_purge (self->cache_index);
+        zlistx_purge (self->cache);
+        self->pack_cursor = cursor;
+        rc = (int) hydra_pack_size (pack);
+        zsys_info ("hydra_ledger: packed %d blobs into %s", rc, filename);
+    }
+    else
+        zsys_file_delete (filename);
+    zlist_destroy (&packed);
+    zstr_free (&filename);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Scrub the next posts in the ledger, reading about max_bytes bytes from
+//  disk, and carry on from there next time; call this from time to time to
+//  check the whole ledger bit by bit. We check each post's metadata against
+//  its post ID, and its content against its digest, and quarantine damaged
+//  posts so we no longer fetch or export them. Stops at the end of each
+//  pass over the ledger. Returns the number of bytes read.
+
+size_t
+hydra_ledger_scrub (hydra_ledger_t *self, size_t max_bytes)
+{
+    assert (self);
+    if (s_open_journal (self))
+        return 0;
+
+    size_t bytes = 0;
+    byte *buffer = NULL;
+    while (bytes < max_bytes) {
+        if (self->scrub_post) {
+            //  Hash the next block of the content we are checking
+            if (!buffer)
+                buffer = (byte *) malloc (COPY_BLOCK);
+            size_t wanted = self->scrub_left < COPY_BLOCK? self->scrub_left: COPY_BLOCK;
+            if (wanted > max_bytes - bytes)
+                wanted = max_bytes - bytes;
+            size_t got = fread (buffer, 1, wanted, self->scrub_input);
+            zdigest_update (self->scrub_digest, buffer, got);
+            bytes += got;
+            self->scrub_left -= got;
+            if (got < wanted)
+                s_scrub_close (self, "content is short", true);
+            else
+            if (self->scrub_left == 0)
+                s_scrub_close (self,
+                    strcmp (zdigest_string (self->scrub_digest),
+                            hydra_post_digest (self->scrub_post))
+                    ? "content does not match digest": NULL, true);
+            continue;
+        }
+        if (self->scrub_cursor < self->first)
+            self->scrub_cursor = self->first;
+        if (self->scrub_cursor == self->size) {
+            if (self->size > self->first) {
+                self->scrub_passes++;
+                self->scrub_cursor = self->first;
+            }
+            break;
+        }
+        size_t position = self->scrub_cursor;
+        if (s_quarantined (self, position)) {
+            self->scrub_cursor++;
+            continue;
+        }
+        hydra_post_t *post = NULL;
+        zchunk_t *chunk = hydra_journal_read (self->journal, s_post_offset (self, position));
+        if (chunk) {
+            bytes += zchunk_size (chunk);
+            post = hydra_post_unpack (chunk);
+            zchunk_destroy (&chunk);
+        }
+        const char *damage = s_scrub_metadata (self, position, post);
+        self->scrub_post = post;
+        if (damage)
+            s_scrub_close (self, damage, false);
+        else
+        if (!hydra_post_location (post))
+            s_scrub_close (self, NULL, false);
+        else {
+            damage = s_scrub_open (self);
+            if (damage)
+                s_scrub_close (self, damage, true);
+        }
+    }
+    free (buffer);
+    self->scrub_bytes += bytes;
+    return bytes;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the index of the next post the scrubber will check, which tells
+//  how far it is through the current pass over the ledger
+
+size_t
+hydra_ledger_scrub_cursor (hydra_ledger_t *self)
+{
+    assert (self);
+    return self->scrub_cursor > self->first? self->scrub_cursor - self->first: 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of posts scrubbed
+
+size_t
+hydra_ledger_scrub_posts (hydra_ledger_t *self)
 {
-    //  If the post is new then we store it, otherwise we get rid of it
-    if (zhash_insert (self->post_files, hydra_post_ident (post), filename) == 0) {
-        //  Store post ID in posts_list and bump size
-        zsys_warning ("hydra_ledger: store post, ident=%s", hydra_post_ident (post));
-        if (self->size == self->max_size - 1) {
-            self->max_size *= 2;
-            self->posts_list = (char **) realloc (
-                self->posts_list, sizeof (char *) * self->max_size);
-        }
-        self->posts_list [self->size++] = strdup (hydra_post_ident (post));
-    }
-    else {
-        zsys_warning ("hydra_ledger: duplicate post, ident=%s", hydra_post_ident (post));
-        zsys_warning ("hydra_ledger: deleting filename=%s", filename);
-        char *fullname = zsys_sprintf ("posts/%s", filename);
-        zsys_file_delete (fullname);
-        zstr_free (&fullname);
-    }
+    assert (self);
+    return self->scrub_posts;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Create a new ledger instance. You must specify the directory that holds
-//  post files.
+//  Return the number of bytes read while scrubbing
 
-hydra_ledger_t *
-hydra_ledger_new (void)
+size_t
+hydra_ledger_scrub_bytes (hydra_ledger_t *self)
 {
-    hydra_ledger_t *self = (hydra_ledger_t *) zmalloc (sizeof (hydra_ledger_t));
-    if (self) {
-        self->max_size = 256;      //  Arbitrary, this is expanded on demand
-        self->posts_list = (char **) malloc (sizeof (char *) * self->max_size);
-    }
-    if (self->posts_list)
-        self->post_files = zhash_new ();
-    if (self->post_files)
-        zhash_autofree (self->post_files);
-    return self;
+    assert (self);
+    return self->scrub_bytes;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Destroy the ledger instance
+//  Return the number of passes the scrubber has finished over the ledger
 
-void
-hydra_ledger_destroy (hydra_ledger_t **self_p)
+size_t
+hydra_ledger_scrub_passes (hydra_ledger_t *self)
 {
-    assert (self_p);
-    if (*self_p) {
-        hydra_ledger_t *self = *self_p;
-        zhash_destroy (&self->post_files);
-        //  Free list of post IDs
-        uint post_nbr;
-        for (post_nbr = 0; post_nbr < self->size; post_nbr++)
-            free (self->posts_list [post_nbr]);
-        free (self->posts_list);
-        //  Free object instance
-        free (self);
-        *self_p = NULL;
-    }
+    assert (self);
+    return self->scrub_passes;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Return ledger size, i.e. number of posts stored in the ledger.
+//  Return the number of posts in the ledger that are quarantined
 
 size_t
-hydra_ledger_size (hydra_ledger_t *self)
+hydra_ledger_quarantined (hydra_ledger_t *self)
 {
     assert (self);
-    return self->size;
+    return self->quarantine? zhashx_size (self->quarantine): 0;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Load the ledger data from disk, from the specified directory. Returns the
-//  number of posts loaded, or -1 if there was an error reading the directory.
-//  Not valid if the ledger already has posts loaded.
+//  Write a post to an archive: its packed metadata and checksum, then its
+//  content size and content, which we check against the post digest as we
+//  copy it. Returns 0 if OK, -1 if the content was missing or damaged, or
+//  the archive could not be written.
+
+static int
+s_export_post (hydra_post_t *post, FILE *output)
+{
+    zchunk_t *meta = hydra_post_pack (post);
+    byte header [8];
+    hydra_util_put_number4 (header, (uint32_t) zchunk_size (meta));
+    hydra_util_put_number4 (header + 4,
+        hydra_journal_checksum (zchunk_data (meta), zchunk_size (meta)));
+    int rc = fwrite (header, 1, 8, output) == 8? zchunk_write (meta, output): -1;
+    zchunk_destroy (&meta);
+
+    size_t content_size = hydra_post_content_size (post);
+    hydra_util_put_number8 (header, content_size);
+    if (rc == 0 && fwrite (header, 1, 8, output) != 8)
+        rc = -1;
+    zdigest_t *check = zdigest_new ();
+    size_t offset = 0;
+    while (rc == 0 && offset < content_size) {
+        zchunk_t *chunk = hydra_post_fetch (post, COPY_BLOCK, offset);
+        if (chunk && zchunk_size (chunk)) {
+            zdigest_update (check, zchunk_data (chunk), zchunk_size (chunk));
+            offset += zchunk_size (chunk);
+            rc = zchunk_write (chunk, output);
+        }
+        else
+            rc = -1;
+        zchunk_destroy (&chunk);
+    }
+    if (rc == 0 && *hydra_post_digest (post)
+    &&  strcmp (zdigest_string (check), hydra_post_digest (post)))
+        rc = -1;
+    zdigest_destroy (&check);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Write all posts in the ledger, oldest first, with their content, to the
+//  specified file as a single archive that hydra_ledger_import can read.
+//  Skips quarantined posts, and posts whose content is missing or damaged.
+//  Returns the number of posts exported, or -1 if the archive could not be
+//  written.
 
 int
-hydra_ledger_load (hydra_ledger_t *self)
+hydra_ledger_export (hydra_ledger_t *self, const char *filename)
 {
     assert (self);
-    assert (self->size == 0);
+    assert (filename);
+    if (s_open_journal (self))
+        return -1;
+    FILE *output = fopen (filename, "wb");
+    if (!output) {
+        zsys_error ("hydra_ledger: cannot create %s", filename);
+        return -1;
+    }
+    int rc = fwrite (ARCHIVE_SIGNATURE, 1, ARCHIVE_SIGNATURE_SIZE, output)
+                == ARCHIVE_SIGNATURE_SIZE? 0: -1;
+    int posts = 0;
+    size_t position;
+    for (position = self->first; rc == 0 && position < self->size; position++) {
+        if (s_quarantined (self, position))
+            continue;
+        //  Read posts from the journal, as most will not be fetched again
+        //  and would only flush the cache
+        hydra_post_t *post = NULL;
+        zchunk_t *chunk = hydra_journal_read (self->journal, s_post_offset (self, position));
+        if (chunk) {
+            post = hydra_post_unpack (chunk);
+            zchunk_destroy (&chunk);
+        }
+        if (!post)
+            continue;
+        s_pack_resolve (self, post);
+        int64_t start = hydra_util_file_tell (output);
+        if (s_export_post (post, output) == 0)
+            posts++;
+        else
+        if (ferror (output))
+            rc = -1;
+        else {
+            //  Leave the post out, and write the next one over it
+            zsys_warning ("hydra_ledger: cannot export content, ident=%s",
+                          hydra_post_ident (post));
+            if (start < 0 || hydra_util_file_seek (output, start, SEEK_SET))
+                rc = -1;
+        }
+        hydra_post_destroy (&post);
+    }
+    //  An empty record ends the archive, so we can tell if it's cut short
+    byte trailer [4] = { 0, 0, 0, 0 };
+    if (rc == 0 && fwrite (trailer, 1, 4, output) != 4)
+        rc = -1;
+    if (fclose (output))
+        rc = -1;
+    if (rc) {
+        zsys_error ("hydra_ledger: cannot write %s", filename);
+        zsys_file_delete (filename);
+        return -1;
+    }
+    zsys_info ("hydra_ledger: exported %d posts to %s", posts, filename);
+    return posts;
+}
 
-    //  Load a list of all post files in the posts directory
-    zdir_t *dir = zdir_new ("posts", "-");
-    zfile_t **files = zdir_flatten (dir);
 
-    //  Get yyyy-mm-dd string for checking today's files
-    char *today = zclock_timestr ();
-    today [10] = 0;
+//  --------------------------------------------------------------------------
+//  Read the next post from an archive and store it with its content, unless
+//  we refuse it, and tell the caller if we stored it. Skips content we hold
+//  already. Returns 0 if OK, 1 at the end of the archive, or -1 if the
+//  archive is damaged or the post could not be stored.
 
-    zrex_t *rex = zrex_new ("^(\\d\\d\\d\\d-\\d\\d-\\d\\d)\\((\\d+)\\)$");
-    assert (rex && zrex_valid (rex));
+static int
+s_import_post (hydra_ledger_t *self, FILE *input, bool *stored_p)
+{
+    *stored_p = false;
+    byte header [8];
+    if (fread (header, 1, 4, input) != 4)
+        return -1;              //  Archive was cut short
+    size_t meta_size = hydra_util_get_number4 (header);
+    if (meta_size == 0)
+        return 1;
+    if (meta_size > ARCHIVE_META_MAX || fread (header, 1, 4, input) != 4)
+        return -1;
 
-    //  Now check each post file, and load post IDs into posts list
-    uint index;
-    for (index = 0; files [index]; index++) {
-        zfile_t *file = files [index];
-        char *filename = zfile_filename (file, NULL);
-        assert (memcmp (filename, "posts/", 6) == 0);
-        filename += 6;
-        hydra_post_t *post = hydra_post_load (filename);
-        if (post) {
-            if (zrex_matches (rex, filename) && streq (zrex_hit (rex, 1), today)) {
-                int sequence = atoi (zrex_hit (rex, 2));
-                if (self->sequence < sequence)
-                    self->sequence = sequence;
+    hydra_post_t *post = NULL;
+    zchunk_t *meta = zchunk_read (input, meta_size);
+    if (meta && zchunk_size (meta) == meta_size
+    &&  hydra_journal_checksum (zchunk_data (meta), meta_size) == hydra_util_get_number4 (header))
+        post = hydra_post_unpack (meta);
+    zchunk_destroy (&meta);
+    //  The archive comes from another node, so check the post ID it holds
+    if (!post
+    ||  hydra_post_verify_ident (post)
+    ||  fread (header, 1, 8, input) != 8
+    ||  hydra_util_get_number8 (header) != hydra_post_content_size (post)) {
+        hydra_post_destroy (&post);
+        return -1;
+    }
+    size_t content_size = hydra_post_content_size (post);
+    const char *digest = hydra_post_digest (post);
+    byte binary [IDENT_SIZE];
+    int rc = 0;
+    if ((*digest && s_ident_decode (digest, binary))
+    ||  (!*digest && content_size))
+        rc = -1;                //  Content must have a valid digest
+    else
+    if (s_refusal (self, post))
+        rc = hydra_util_file_seek (input, (int64_t) content_size, SEEK_CUR);
+    else {
+        if (*digest) {
+            //  Posts with the same content share one blob
+            bool new_blob = !hydra_ledger_has_blob (self, digest);
+            if (new_blob)
+                rc = hydra_blobs_copy (digest, input, content_size);
+            else
+                rc = hydra_util_file_seek (input, (int64_t) content_size, SEEK_CUR);
+            if (rc == 0) {
+                char *location = hydra_blobs_location (digest);
+                hydra_post_set_location (post, location);
+                if (self->durable && new_blob)
+                    zlist_append (self->batch_blobs, location);
+                zstr_free (&location);
             }
-            s_have_new_post (self, post, filename);
-            hydra_post_destroy (&post);
+        }
+        if (rc == 0)
+            rc = s_append_post (self, post);
+        if (rc == 0) {
+            s_enforce_retention (self);
+            *stored_p = true;
         }
     }
-    zstr_free (&today);
-    zrex_destroy (&rex);
-    zdir_flatten_free (&files);
-    zdir_destroy (&dir);
-    return self->size;
+    hydra_post_destroy (&post);
+    return rc? -1: 0;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Save a post via the ledger. This saves the post to disk, adds the post to
-//  the ledger, and then destroys the post. Use in place of hydra_post_save
-//  to ensure post filenames are correctly generated.
+//  Store all posts from an archive written by hydra_ledger_export, with
+//  their content, as one batch. This is much faster than receiving the
+//  posts from a peer. Does not store posts the ledger already has, or
+//  evicted, or that are older than the retention age limit, and does not
+//  write content the ledger already holds. Returns the number of posts
+//  stored, or -1 if the archive was missing or damaged; posts read before
+//  the damage stay stored.
 
 int
-hydra_ledger_store (hydra_ledger_t *self, hydra_post_t **post_p)
+hydra_ledger_import (hydra_ledger_t *self, const char *filename)
 {
     assert (self);
-    assert (post_p && *post_p);
-    hydra_post_t *post = *post_p;
+    assert (filename);
+    if (s_open_journal (self))
+        return -1;
+    FILE *input = fopen (filename, "rb");
+    if (!input) {
+        zsys_error ("hydra_ledger: cannot open %s", filename);
+        return -1;
+    }
+    char signature [ARCHIVE_SIGNATURE_SIZE];
+    int rc = fread (signature, 1, ARCHIVE_SIGNATURE_SIZE, input) == ARCHIVE_SIGNATURE_SIZE
+          && memcmp (signature, ARCHIVE_SIGNATURE, ARCHIVE_SIGNATURE_SIZE) == 0? 0: -1;
 
-    //  Get yyyy-mm-dd string for filename
-    char *today = zclock_timestr ();
-    today [10] = 0;
-    char *filename = zsys_sprintf ("%s(%08d)", today, ++self->sequence);
-    zsys_info ("hydrad: store new post filename=%s bytes=%zd",
-               filename, hydra_post_content_size (post));
-    int rc = hydra_post_save (post, filename);
-    s_have_new_post (self, post, filename);
-    hydra_post_destroy (post_p);
-    *post_p = NULL;
-    zstr_free (&filename);
-    zstr_free (&today);
-    return rc;
+    bool batch = !self->in_batch;
+    if (batch)
+        hydra_ledger_begin (self);
+    int posts = 0;
+    while (rc == 0) {
+        bool stored;
+        rc = s_import_post (self, input, &stored);
+        if (stored)
+            posts++;
+    }
+    fclose (input);
+    if (batch && hydra_ledger_commit (self))
+        rc = -1;
+    if (rc == -1) {
+        zsys_error ("hydra_ledger: cannot import %s, stored %d posts", filename, posts);
+        return -1;
+    }
+    zsys_info ("hydra_ledger: imported %d posts from %s", posts, filename);
+    return posts;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Return post at specified index; if the index does not refer to a valid
-//  post, returns NULL.
+//  Save the ledger index to disk, so that the next load only has to replay
+//  posts stored after this point. Call this before destroying a ledger you
+//  have stored posts into. The saved index keeps the IDs of evicted posts,
+//  so the ledger goes on refusing them. Returns 0 if OK, -1 if the index
+//  could not be saved.
 
-hydra_post_t *
-hydra_ledger_fetch (hydra_ledger_t *self, int index)
+int
+hydra_ledger_checkpoint (hydra_ledger_t *self)
 {
-    hydra_post_t *post = NULL;
-    if (index >= 0 && index < self->size) {
-        char *post_ident = self->posts_list [index];
-        char *filename = (char *) zhash_lookup (self->post_files, post_ident);
-        if (filename)
-            post = hydra_post_load (filename);
+    assert (self);
+    if (s_open_journal (self) || hydra_journal_sync (self->journal))
+        return -1;
+
+    //  Evicted posts no longer have content, so we keep no location
+    hydra_snapshot_t *snapshot = hydra_snapshot_new ();
+    size_t position;
+    for (position = 0; position < self->size; position++)
+        hydra_snapshot_append (snapshot,
+            s_post_ident (self, position),
+            s_post_offset (self, position),
+            position < self->first? NULL: s_post_location (self, position),
+            s_post_content_size (self, position),
+            s_post_timestamp (self, position),
+            s_post_parent (self, position),
+            s_post_mime_type (self, position),
+            s_post_digest (self, position));
+    hydra_snapshot_set_evicted (snapshot, self->first);
+    hydra_snapshot_set_content_bytes (snapshot, self->content_bytes);
+    hydra_snapshot_set_filter (snapshot, self->filter, FILTER_BLOCK * self->filter_blocks);
+    int rc = hydra_snapshot_save (snapshot, INDEX_FILE, hydra_journal_size (self->journal));
+    hydra_snapshot_destroy (&snapshot);
+    if (rc == 0)
+        self->unsaved = 0;
+
+    //  Mark the checkpoint in the journal, so that if we lose the snapshot
+    //  we need not hash the content of every post we replay
+    if (rc == 0) {
+        byte record [CHECKPOINT_SIZE] = { CHECKPOINT_RECORD };
+        zchunk_t *chunk = zchunk_new (record, CHECKPOINT_SIZE);
+        if (hydra_journal_append (self->journal, chunk) < 0
+        ||  hydra_journal_flush (self->journal))
+            rc = -1;
+        zchunk_destroy (&chunk);
     }
-    return post;
+
+    //  Save the word index if we loaded it, without the evicted posts
+    if (self->words) {
+        int64_t horizon = self->first < self->size
+            ? s_post_offset (self, self->first)
+            : hydra_journal_size (self->journal);
+        if (hydra_words_save (self->words, WORDS_FILE, (uint64_t) horizon))
+            rc = -1;
+    }
+    return rc;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Lookup post in ledger and return post index (0 .. size - 1); if the post
-//  does not exist, returns -1.
+//  Return the number of posts added to the ledger since its index was last
+//  saved, including posts replayed at load and posts evicted since. Unlike
+//  the ledger size, this goes on counting when retention caps the ledger,
+//  so use it to decide when to checkpoint.
 
-int
-hydra_ledger_index (hydra_ledger_t *self, const char *post_ident)
+size_t
+hydra_ledger_unsaved (hydra_ledger_t *self)
 {
-    if (*post_ident) {
-        uint post_nbr;
-        for (post_nbr = 0; post_nbr < self->size; post_nbr++) {
-            if (streq (post_ident, self->posts_list [post_nbr]))
-                return post_nbr;
-        }
-    }
-    return -1;
+    assert (self);
+    return self->unsaved;
 }
 
 
 //  --------------------------------------------------------------------------
 //  Selftest
 
+//  Return a new post with the specified subject and timestamp, which we
+//  set by way of a post file
+
+static hydra_post_t *
+s_post_at (const char *subject, const char *timestamp)
+{
+    hydra_post_t *post = hydra_post_new (subject);
+    hydra_post_set_content (post, subject);
+    hydra_post_save (post, "timed");
+    hydra_post_destroy (&post);
+    zconfig_t *root = zconfig_load ("posts/timed");
+    zconfig_put (root, "/post/timestamp", timestamp);
+    zconfig_save (root, "posts/timed");
+    zconfig_destroy (&root);
+    post = hydra_post_load ("timed");
+    zsys_file_delete ("posts/timed");
+    return post;
+}
+
+//  Create and enter a directory for one section of the selftest, and return
+//  an empty ledger loaded there. The section destroys the ledger and goes
+//  back up when done.
+
+static hydra_ledger_t *
+s_test_ledger (const char *directory)
+{
+    zsys_dir_create (directory);
+    zsys_dir_change (directory);
+    hydra_ledger_t *ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    return ledger;
+}
+
 void
 hydra_ledger_test (bool verbose)
 {
@@ -234,19 +3439,42 @@ hydra_ledger_test (bool verbose)
     zsys_dir_create (".hydra_test");
     zsys_dir_change (".hydra_test");
 
-    //  Create one pre-existing post
+    //  Create one pre-existing post, with its blob where older nodes kept it
     hydra_post_t *post = hydra_post_new ("Test post 1");
     hydra_post_set_content (post, "Hello, World");
+    hydra_post_save_content (post);
+    char *flat_location = zsys_sprintf ("posts/blobs/%s", hydra_post_digest (post));
+    char *blob_location = strdup (hydra_post_location (post));
+    rename (blob_location, flat_location);
+    hydra_post_set_file (post, flat_location);
     hydra_post_save (post, "20150108_00000001");
     hydra_post_destroy (&post);
 
-    //  Load ledger, it will have the one post
+    //  A migration that crashed part way left a partial journal behind
+    FILE *handle = fopen ("posts/journal.tmp", "wb");
+    assert (handle);
+    fwrite ("HYDRAJ", 1, 6, handle);
+    fclose (handle);
+
+    //  Load ledger, it will migrate the one post into its journal, and its
+    //  blob into the current layout
     hydra_ledger_t *ledger = hydra_ledger_new ();
     assert (ledger);
     assert (hydra_ledger_size (ledger) == 0);
     int rc = hydra_ledger_load (ledger);
     assert (rc == 1);
     assert (hydra_ledger_size (ledger) == 1);
+    assert (!zsys_file_exists ("posts/20150108_00000001"));
+    assert (!zsys_file_exists ("posts/journal.tmp"));
+    assert (!zsys_file_exists (flat_location));
+    post = hydra_ledger_fetch (ledger, 0);
+    assert (streq (hydra_post_location (post), blob_location));
+    char *content = hydra_post_content (post);
+    assert (content && streq (content, "Hello, World"));
+    zstr_free (&content);
+    hydra_post_destroy (&post);
+    zstr_free (&flat_location);
+    zstr_free (&blob_location);
 
     //  Now create second post and save via ledger
     post = hydra_post_new ("Test post 2");
@@ -259,16 +3487,797 @@ hydra_ledger_test (bool verbose)
     assert (hydra_ledger_index (ledger, post_ident) == 1);
     assert (hydra_ledger_index (ledger, "") == -1);
     assert (hydra_ledger_index (ledger, "no such id") == -1);
+    assert (hydra_ledger_may_contain (ledger, post_ident));
+    assert (!hydra_ledger_may_contain (ledger, "no such id"));
 
     //  Test we can load a post via the ledger
     post = hydra_ledger_fetch (ledger, 1);
     assert (post);
     assert (streq (post_ident, hydra_post_ident (post)));
+    hydra_post_destroy (&post);
+
+    //  Fetching the post again comes from the cache
+    assert (hydra_ledger_cache_misses (ledger) == 2);
+    post = hydra_ledger_fetch (ledger, 1);
+    assert (post);
+    assert (streq (post_ident, hydra_post_ident (post)));
+    assert (hydra_ledger_cache_hits (ledger) == 1);
+    assert (hydra_ledger_cache_misses (ledger) == 2);
+    hydra_post_destroy (&post);
+
+    //  Storing the same post again does nothing
+    post = hydra_ledger_fetch (ledger, 1);
+    rc = hydra_ledger_store (ledger, &post);
+    assert (rc == 0);
+    assert (post == NULL);
+    assert (hydra_ledger_size (ledger) == 2);
+    hydra_ledger_destroy (&ledger);
+
+    //  Reload ledger from its journal
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 2);
+    assert (hydra_ledger_index (ledger, post_ident) == 1);
+    post = hydra_ledger_fetch (ledger, 1);
+    assert (post);
+    content = hydra_post_content (post);
+    assert (content);
+    assert (streq (content, "Hello, Again"));
+    zstr_free (&content);
+    hydra_post_destroy (&post);
+
+    //  Checkpoint, then store a third post after the snapshot
+    assert (hydra_ledger_unsaved (ledger) == 2);
+    rc = hydra_ledger_checkpoint (ledger);
+    assert (rc == 0);
+    assert (hydra_ledger_unsaved (ledger) == 0);
+    post = hydra_post_new ("Test post 3");
+    hydra_post_set_content (post, "Hello, Snapshot");
+    char *third_ident = strdup (hydra_post_ident (post));
+    hydra_ledger_store (ledger, &post);
+    assert (hydra_ledger_unsaved (ledger) == 1);
+    hydra_ledger_destroy (&ledger);
+
+    //  Reload ledger from snapshot plus journal tail
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 3);
+    assert (hydra_ledger_index (ledger, post_ident) == 1);
+    assert (hydra_ledger_index (ledger, third_ident) == 2);
+    assert (hydra_ledger_index (ledger, "no such id") == -1);
+    assert (hydra_ledger_may_contain (ledger, post_ident));
+    assert (hydra_ledger_may_contain (ledger, third_ident));
+    post = hydra_ledger_fetch (ledger, 1);
+    assert (post);
+    assert (streq (hydra_post_ident (post), post_ident));
+    hydra_post_destroy (&post);
+    post = hydra_ledger_fetch (ledger, 2);
+    assert (post);
+    assert (streq (hydra_post_ident (post), third_ident));
+    hydra_post_destroy (&post);
+    hydra_ledger_destroy (&ledger);
+
+    //  Loading with several workers gives the same ledger as loading on
+    //  one thread; use enough posts that the work is really split
+    ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    uint post_nbr;
+    for (post_nbr = 0; post_nbr < 3000; post_nbr++) {
+        char subject [32];
+        sprintf (subject, "Load test post %u", post_nbr);
+        post = hydra_post_new (subject);
+        hydra_ledger_store (ledger, &post);
+    }
+    hydra_ledger_destroy (&ledger);
+    zsys_file_delete ("posts/index");
+    //  Only one ledger may hold the journal, so note the serial result
+    //  before we load again
+    char *serial_idents [31];
+    ledger = hydra_ledger_new ();
+    hydra_ledger_set_workers (ledger, 1);
+    hydra_ledger_load (ledger);
+    assert (hydra_ledger_size (ledger) == 3003);
+    for (post_nbr = 0; post_nbr < 3003; post_nbr += 100) {
+        post = hydra_ledger_fetch (ledger, post_nbr);
+        serial_idents [post_nbr / 100] = strdup (hydra_post_ident (post));
+        hydra_post_destroy (&post);
+    }
+    hydra_ledger_destroy (&ledger);
+    zsys_file_delete ("posts/index");
+    ledger = hydra_ledger_new ();
+    hydra_ledger_set_workers (ledger, 4);
+    hydra_ledger_load (ledger);
+    assert (hydra_ledger_size (ledger) == 3003);
+    for (post_nbr = 0; post_nbr < 3003; post_nbr += 100) {
+        post = hydra_ledger_fetch (ledger, post_nbr);
+        assert (streq (hydra_post_ident (post), serial_idents [post_nbr / 100]));
+        assert (hydra_ledger_index (ledger, hydra_post_ident (post)) == post_nbr);
+        assert (hydra_ledger_may_contain (ledger, hydra_post_ident (post)));
+        free (serial_idents [post_nbr / 100]);
+        hydra_post_destroy (&post);
+    }
+    hydra_ledger_destroy (&ledger);
+
+    //  A snapshot that does not match the journal is ignored
+    zsys_file_delete ("posts/journal");
+    hydra_journal_t *journal = hydra_journal_new ("posts/journal");
+    assert (journal);
+    zchunk_t *chunk = zchunk_new (NULL, 4096);
+    memset (zchunk_data (chunk), 0, 4096);
+    zchunk_set (chunk, NULL, 4096);
+    hydra_journal_append (journal, chunk);
+    zchunk_destroy (&chunk);
+    hydra_journal_destroy (&journal);
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 0);
+    assert (hydra_ledger_index (ledger, post_ident) == -1);
     free (post_ident);
+    free (third_ident);
+    hydra_ledger_destroy (&ledger);
+
+    //  Retention limits evict the oldest posts and their content; posts 1
+    //  and 4 share a blob, which must survive until both are gone
+    zsys_file_delete ("posts/journal");
+    zsys_file_delete ("posts/index");
+    ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    char *idents [5];
+    char *locations [5];
+    hydra_post_t *evicted = NULL;
+    hydra_post_t *evicted_again = NULL;
+    for (post_nbr = 0; post_nbr < 5; post_nbr++) {
+        char subject [32];
+        sprintf (subject, "Retention post %u", post_nbr);
+        post = hydra_post_new (subject);
+        if (post_nbr == 1 || post_nbr == 4)
+            hydra_post_set_content (post, "Shared content");
+        else
+            hydra_post_set_content (post, subject);
+        idents [post_nbr] = strdup (hydra_post_ident (post));
+        if (post_nbr == 0) {
+            evicted = hydra_post_dup (post);
+            evicted_again = hydra_post_dup (post);
+        }
+        hydra_ledger_store (ledger, &post);
+        post = hydra_ledger_fetch (ledger, post_nbr);
+        locations [post_nbr] = strdup (hydra_post_location (post));
+        hydra_post_destroy (&post);
+    }
+    //  Posts with the same content share one blob
+    assert (streq (locations [1], locations [4]));
+    assert (hydra_ledger_has_blob (ledger, hydra_blobs_digest (locations [0])));
+    assert (hydra_ledger_has_blob (ledger, hydra_blobs_digest (locations [4])));
+    assert (!hydra_ledger_has_blob (ledger, "0000000000000000000000000000000000000000"));
+    hydra_ledger_set_retention (ledger, 3, 0, 0);
+    assert (hydra_ledger_size (ledger) == 3);
+    assert (hydra_ledger_index (ledger, idents [0]) == -1);
+    assert (hydra_ledger_evicted (ledger, idents [0]));
+    assert (!hydra_ledger_evicted (ledger, idents [2]));
+    assert (hydra_ledger_index (ledger, idents [2]) == 0);
+    assert (hydra_ledger_index (ledger, idents [4]) == 2);
+    post = hydra_ledger_fetch (ledger, 0);
+    assert (streq (hydra_post_ident (post), idents [2]));
+    hydra_post_destroy (&post);
+    assert (!zsys_file_exists (locations [0]));
+    assert (zsys_file_exists (locations [1]));
+    assert (zsys_file_exists (locations [2]));
+    assert (!hydra_ledger_has_blob (ledger, hydra_blobs_digest (locations [0])));
+    assert (hydra_ledger_has_blob (ledger, hydra_blobs_digest (locations [1])));
+
+    //  An evicted post is not stored again
+    rc = hydra_ledger_store (ledger, &evicted);
+    assert (rc == 0);
+    assert (hydra_ledger_size (ledger) == 3);
+    hydra_ledger_destroy (&ledger);
+
+    //  Eviction survives a reload, with and without a snapshot
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 3);
+    assert (hydra_ledger_index (ledger, idents [1]) == -1);
+    assert (hydra_ledger_index (ledger, idents [4]) == 2);
+    hydra_ledger_checkpoint (ledger);
+    hydra_ledger_destroy (&ledger);
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 3);
+    assert (hydra_ledger_index (ledger, idents [2]) == 0);
+
+    //  The snapshot remembers evicted posts, so we still refuse them
+    assert (hydra_ledger_evicted (ledger, idents [0]));
+    assert (hydra_ledger_evicted (ledger, idents [1]));
+    rc = hydra_ledger_store (ledger, &evicted_again);
+    assert (rc == 0);
+    assert (hydra_ledger_size (ledger) == 3);
+    assert (hydra_ledger_index (ledger, idents [0]) == -1);
+    assert (hydra_ledger_index (ledger, idents [2]) == 0);
+
+    //  A byte limit keeps only as many posts as fit
+    hydra_ledger_set_retention (ledger, 0, 20, 0);
+    assert (hydra_ledger_size (ledger) == 1);
+    assert (hydra_ledger_index (ledger, idents [4]) == 0);
+    assert (zsys_file_exists (locations [4]));
+    assert (!zsys_file_exists (locations [3]));
+    for (post_nbr = 0; post_nbr < 5; post_nbr++) {
+        free (idents [post_nbr]);
+        free (locations [post_nbr]);
+    }
+
+    //  A batch of posts is written with one commit, here a durable one
+    hydra_ledger_set_retention (ledger, 0, 0, 0);
+    hydra_ledger_set_durable (ledger, true);
+    hydra_ledger_begin (ledger);
+    for (post_nbr = 0; post_nbr < 10; post_nbr++) {
+        char subject [32];
+        sprintf (subject, "Batch post %u", post_nbr);
+        post = hydra_post_new (subject);
+        hydra_post_set_content (post, subject);
+        hydra_ledger_store (ledger, &post);
+    }
+    assert (hydra_ledger_size (ledger) == 11);
+    post = hydra_ledger_fetch (ledger, 10);
+    assert (post);
+    hydra_post_destroy (&post);
+    rc = hydra_ledger_commit (ledger);
+    assert (rc == 0);
+
+    //  If a batch cannot reach the disk, we stop serving its posts
+    hydra_ledger_begin (ledger);
+    post = hydra_post_new ("Lost post");
+    hydra_post_set_content (post, "Lost post");
+    hydra_ledger_store (ledger, &post);
+    post = hydra_ledger_fetch (ledger, 11);
+    assert (post);
+    zsys_file_delete (hydra_post_location (post));
+    hydra_post_destroy (&post);
+    rc = hydra_ledger_commit (ledger);
+    assert (rc == -1);
+    assert (hydra_ledger_fetch (ledger, 11) == NULL);
+    assert (hydra_ledger_quarantined (ledger) == 1);
+    hydra_ledger_destroy (&ledger);
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 11);
+
+    //  Simulate a crash that damaged the newest blob and left a partial
+    //  one in staging; loading drops the damaged post and cleans up
+    post = hydra_ledger_fetch (ledger, 10);
+    char *damaged_ident = strdup (hydra_post_ident (post));
+    char *damaged_location = strdup (hydra_post_location (post));
+    hydra_ledger_destroy (&ledger);
+    handle = fopen (damaged_location, "wb");
+    assert (handle);
+    fwrite ("Damaged", 1, 7, handle);
+    fclose (handle);
+    handle = fopen ("posts/staging/partial", "wb");
+    assert (handle);
+    fclose (handle);
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 10);
+    assert (hydra_ledger_index (ledger, damaged_ident) == -1);
+    assert (!zsys_file_exists (damaged_location));
+    assert (!zsys_file_exists ("posts/staging/partial"));
+
+    //  The peer can send us the post again
+    hydra_post_set_content (post, "Batch post 9");
+    assert (streq (hydra_post_ident (post), damaged_ident));
+    hydra_ledger_store (ledger, &post);
+    assert (hydra_ledger_index (ledger, damaged_ident) == 10);
+    hydra_ledger_destroy (&ledger);
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 11);
+    assert (hydra_ledger_index (ledger, damaged_ident) == 10);
+
+    //  After a checkpoint has marked the journal, replaying all of it only
+    //  checks that older content is there, and hashes the posts after the
+    //  marker; here we damage content without changing its size
+    hydra_ledger_checkpoint (ledger);
+    post = hydra_post_new ("Unchecked post");
+    hydra_post_set_content (post, "Unchecked post");
+    hydra_ledger_store (ledger, &post);
+    post = hydra_ledger_fetch (ledger, 11);
+    char *unchecked_location = strdup (hydra_post_location (post));
+    hydra_post_destroy (&post);
+    hydra_ledger_destroy (&ledger);
+    zsys_file_delete ("posts/index");
+    handle = fopen (damaged_location, "r+b");
+    assert (handle);
+    fputc ('b', handle);
+    fclose (handle);
+    handle = fopen (unchecked_location, "r+b");
+    assert (handle);
+    fputc ('u', handle);
+    fclose (handle);
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 11);
+    assert (hydra_ledger_index (ledger, damaged_ident) == 10);
+    assert (!zsys_file_exists (unchecked_location));
+    handle = fopen (damaged_location, "r+b");
+    assert (handle);
+    fputc ('B', handle);
+    fclose (handle);
+    free (unchecked_location);
+    free (damaged_ident);
+    free (damaged_location);
+
+    //  Compaction rolls blobs into a pack, and we fetch posts just the same,
+    //  before and after reloading the ledger
+    post = hydra_ledger_fetch (ledger, 3);
+    char *packed_location = strdup (hydra_post_location (post));
+    char *packed_content = hydra_post_content (post);
+    hydra_post_destroy (&post);
+    assert (hydra_ledger_compact (ledger, 0, 100) == 0);
+    rc = hydra_ledger_compact (ledger, 0, 1);
+    assert (rc > 0);
+    assert (hydra_ledger_compact (ledger, 0, 1) == 0);
+    assert (!zsys_file_exists (packed_location));
+    assert (hydra_ledger_has_blob (ledger, hydra_blobs_digest (packed_location)));
+    for (post_nbr = 0; post_nbr < 2; post_nbr++) {
+        post = hydra_ledger_fetch (ledger, 3);
+        assert (streq (hydra_post_location (post), packed_location));
+        assert (hydra_post_verify_content (post) == 0);
+        content = hydra_post_content (post);
+        assert (streq (content, packed_content));
+        zstr_free (&content);
+        hydra_post_destroy (&post);
+        hydra_ledger_destroy (&ledger);
+        ledger = hydra_ledger_new ();
+        rc = hydra_ledger_load (ledger);
+        assert (rc == 11);
+    }
+    //  Posts stored later are not packed until they are old enough
+    post = hydra_post_new ("Loose post");
+    hydra_post_set_content (post, "Loose post");
+    hydra_ledger_store (ledger, &post);
+    assert (hydra_ledger_compact (ledger, 3600, 1) == 0);
+
+    //  Export the ledger, packed content and all, and import it into an
+    //  empty ledger, which then holds the same posts
+    rc = hydra_ledger_export (ledger, "test.archive");
+    assert (rc == 12);
+    hydra_ledger_destroy (&ledger);
+    ledger = s_test_ledger ("import");
+    rc = hydra_ledger_import (ledger, "../test.archive");
+    assert (rc == 12);
+    assert (hydra_ledger_size (ledger) == 12);
+    post = hydra_ledger_fetch (ledger, 3);
+    assert (streq (hydra_post_location (post), packed_location));
+    assert (hydra_post_verify_content (post) == 0);
+    content = hydra_post_content (post);
+    assert (streq (content, packed_content));
+    zstr_free (&content);
+    hydra_post_destroy (&post);
+
+    //  Importing again stores nothing
+    rc = hydra_ledger_import (ledger, "../test.archive");
+    assert (rc == 0);
+    assert (hydra_ledger_size (ledger) == 12);
+    hydra_ledger_destroy (&ledger);
+    ledger = hydra_ledger_new ();
+    rc = hydra_ledger_load (ledger);
+    assert (rc == 12);
+    hydra_ledger_destroy (&ledger);
+
+    //  A damaged archive stores the posts before the damage, and fails
+    zfile_t *file = zfile_new (NULL, "../test.archive");
+    assert (file);
+    zfile_input (file);
+    chunk = zfile_read (file, zfile_cursize (file), 0);
+    zfile_destroy (&file);
+    zchunk_data (chunk) [zchunk_size (chunk) - 5] ^= 1;
+    handle = fopen ("../damaged.archive", "wb");
+    assert (handle);
+    zchunk_write (chunk, handle);
+    fclose (handle);
+    zchunk_destroy (&chunk);
+    zsys_dir_change ("..");
+    ledger = s_test_ledger ("damaged");
+    rc = hydra_ledger_import (ledger, "../damaged.archive");
+    assert (rc == -1);
+    assert (hydra_ledger_size (ledger) == 11);
+    assert (hydra_ledger_import (ledger, "../no such archive") == -1);
+    hydra_ledger_destroy (&ledger);
+    zsys_dir_change ("..");
+
+    //  Posts we store count as unsaved until the next checkpoint, though
+    //  retention holds the ledger size
+    ledger = s_test_ledger ("unsaved");
+    hydra_ledger_set_retention (ledger, 2, 0, 0);
+    for (post_nbr = 0; post_nbr < 5; post_nbr++) {
+        char subject [32];
+        sprintf (subject, "Unsaved post %u", post_nbr);
+        post = hydra_post_new (subject);
+        hydra_post_set_content (post, subject);
+        hydra_ledger_store (ledger, &post);
+    }
+    assert (hydra_ledger_size (ledger) == 2);
+    assert (hydra_ledger_unsaved (ledger) == 5);
+    assert (hydra_ledger_checkpoint (ledger) == 0);
+    assert (hydra_ledger_unsaved (ledger) == 0);
+    hydra_ledger_destroy (&ledger);
+    zsys_dir_change ("..");
+
+    //  Once retention evicts every post whose content is in a pack, we
+    //  delete the pack
+    ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    assert (zsys_file_exists ("posts/packs/000000.pack"));
+    hydra_ledger_set_retention (ledger, 1, 0, 0);
+    assert (!zsys_file_exists ("posts/packs/000000.pack"));
+    post = hydra_ledger_fetch (ledger, 0);
+    assert (post);
+    assert (hydra_post_verify_content (post) == 0);
+    hydra_post_destroy (&post);
+    hydra_ledger_destroy (&ledger);
+    free (packed_location);
+    free (packed_content);
+
+    //  The time index lists posts by timestamp, whatever order we stored
+    //  them in
+    ledger = s_test_ledger ("times");
+    const char *timestamps [] = {
+        "2015-01-08T00:00:03Z", "2015-01-08T00:00:01Z", "2015-01-08T00:00:05Z",
+        "2015-01-08T00:00:02Z", "2015-01-08T00:00:04Z", "2015-01-08T00:00:02Z"
+    };
+    for (post_nbr = 0; post_nbr < 6; post_nbr++) {
+        char subject [32];
+        sprintf (subject, "Timed post %u", post_nbr);
+        post = s_post_at (subject, timestamps [post_nbr]);
+        hydra_ledger_store (ledger, &post);
+    }
+    int64_t epoch = 1420675200;     //  2015-01-08T00:00:00Z
+    int indexes [10];
+    assert (hydra_ledger_range_size (ledger, 0, INT64_MAX) == 6);
+    assert (hydra_ledger_range (ledger, 0, INT64_MAX, 0, indexes, 10) == 6);
+    assert (indexes [0] == 1 && indexes [1] == 3 && indexes [2] == 5);
+    assert (indexes [3] == 0 && indexes [4] == 4 && indexes [5] == 2);
+    assert (hydra_ledger_range_size (ledger, epoch + 2, epoch + 4) == 3);
+    assert (hydra_ledger_range (ledger, epoch + 2, epoch + 4, 1, indexes, 1) == 1);
+    assert (indexes [0] == 5);
+    assert (hydra_ledger_range (ledger, epoch + 2, epoch + 4, 2, indexes, 10) == 1);
+    assert (indexes [0] == 0);
+    assert (hydra_ledger_range (ledger, epoch + 2, epoch + 4, 3, indexes, 10) == 0);
+    assert (hydra_ledger_range_size (ledger, epoch + 6, INT64_MAX) == 0);
+
+    //  Posts stored or evicted later come and go from the index
+    hydra_ledger_set_retention (ledger, 4, 0, 0);
+    post = s_post_at ("Timed post 6", "2015-01-08T00:00:00Z");
+    hydra_ledger_store (ledger, &post);
+    post = s_post_at ("Timed post 7", "2015-01-08T00:00:03Z");
+    hydra_ledger_store (ledger, &post);
+    assert (hydra_ledger_range (ledger, 0, INT64_MAX, 0, indexes, 10) == 4);
+    assert (indexes [0] == 2 && indexes [1] == 1);
+    assert (indexes [2] == 3 && indexes [3] == 0);
+    hydra_ledger_checkpoint (ledger);
+    hydra_ledger_destroy (&ledger);
+    ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    assert (hydra_ledger_range (ledger, 0, INT64_MAX, 0, indexes, 10) == 4);
+    assert (indexes [0] == 2 && indexes [1] == 1);
+    assert (indexes [2] == 3 && indexes [3] == 0);
+    hydra_ledger_destroy (&ledger);
+    zsys_dir_change ("..");
+
+    //  The thread index finds replies, including replies that arrive before
+    //  the post they reply to. We store posts A to D, query, then store the
+    //  rest: E, F, G, and X, where G replies to X.
+    ledger = s_test_ledger ("threads");
+    const char *subjects = "ABCDEFGX";
+    const int parents [] = { -1, 0, 0, 1, 2, 1, 7, -1 };
+    char *thread_idents [8];
+    post = hydra_post_new ("Thread post X");
+    thread_idents [7] = strdup (hydra_post_ident (post));
+    hydra_post_t *late = post;
+    for (post_nbr = 0; post_nbr < 7; post_nbr++) {
+        char subject [32];
+        sprintf (subject, "Thread post %c", subjects [post_nbr]);
+        post = hydra_post_new (subject);
+        if (parents [post_nbr] >= 0)
+            hydra_post_set_parent_id (post, thread_idents [parents [post_nbr]]);
+        thread_idents [post_nbr] = strdup (hydra_post_ident (post));
+        hydra_ledger_store (ledger, &post);
+        if (post_nbr == 3) {
+            assert (hydra_ledger_children (ledger, thread_idents [0], 0, indexes, 10) == 2);
+            assert (indexes [0] == 1 && indexes [1] == 2);
+        }
+    }
+    hydra_ledger_store (ledger, &late);
+    for (post_nbr = 0; post_nbr < 2; post_nbr++) {
+        assert (hydra_ledger_children (ledger, thread_idents [0], 0, indexes, 10) == 2);
+        assert (indexes [0] == 1 && indexes [1] == 2);
+        assert (hydra_ledger_children (ledger, thread_idents [1], 1, indexes, 10) == 1);
+        assert (indexes [0] == 5);
+        assert (hydra_ledger_children (ledger, thread_idents [3], 0, indexes, 10) == 0);
+        assert (hydra_ledger_children (ledger, "no such id", 0, indexes, 10) == 0);
+        assert (hydra_ledger_thread (ledger, thread_idents [0], 0, indexes, 10) == 6);
+        assert (indexes [0] == 0 && indexes [1] == 1 && indexes [2] == 3);
+        assert (indexes [3] == 5 && indexes [4] == 2 && indexes [5] == 4);
+        assert (hydra_ledger_thread (ledger, thread_idents [0], 2, indexes, 3) == 3);
+        assert (indexes [0] == 3 && indexes [1] == 5 && indexes [2] == 2);
+        assert (hydra_ledger_thread (ledger, thread_idents [7], 0, indexes, 10) == 2);
+        assert (indexes [0] == 7 && indexes [1] == 6);
+
+        //  The parent IDs survive a checkpoint and reload
+        hydra_ledger_checkpoint (ledger);
+        hydra_ledger_destroy (&ledger);
+        ledger = hydra_ledger_new ();
+        hydra_ledger_load (ledger);
+    }
+    //  Evicting A and B leaves their replies
+    hydra_ledger_set_retention (ledger, 6, 0, 0);
+    assert (hydra_ledger_children (ledger, thread_idents [0], 0, indexes, 10) == 1);
+    assert (indexes [0] == 0);
+    assert (hydra_ledger_children (ledger, thread_idents [1], 0, indexes, 10) == 2);
+    assert (indexes [0] == 1 && indexes [1] == 3);
+    assert (hydra_ledger_thread (ledger, thread_idents [0], 0, indexes, 10) == 2);
+    assert (indexes [0] == 0 && indexes [1] == 2);
+    for (post_nbr = 0; post_nbr < 8; post_nbr++)
+        free (thread_idents [post_nbr]);
+    hydra_ledger_destroy (&ledger);
+    zsys_dir_change ("..");
+
+    //  Queries filter posts by MIME type, content, size, and time
+    ledger = s_test_ledger ("columns");
+    const char *mime_types [] = { "text/plain", "image/png", "image/jpeg", "text/plain", "" };
+    const char *contents [] = { "a", "bb", "ccc", "bb", "dddd" };
+    char *shared_digest = NULL;
+    for (post_nbr = 0; post_nbr < 5; post_nbr++) {
+        char subject [32];
+        char timestamp [32];
+        sprintf (subject, "Query post %u", post_nbr);
+        sprintf (timestamp, "2015-01-08T00:00:0%uZ", post_nbr + 1);
+        post = s_post_at (subject, timestamp);
+        hydra_post_set_data (post, contents [post_nbr], strlen (contents [post_nbr]));
+        hydra_post_set_mime_type (post, mime_types [post_nbr]);
+        if (post_nbr == 1)
+            shared_digest = strdup (hydra_post_digest (post));
+        hydra_ledger_store (ledger, &post);
+    }
+    for (post_nbr = 0; post_nbr < 2; post_nbr++) {
+        assert (hydra_ledger_query_size (ledger, NULL, NULL, 0, 0, 0, 0) == 5);
+        assert (hydra_ledger_query_size (ledger, "image/*", NULL, 0, 0, 0, 0) == 2);
+        assert (hydra_ledger_query (ledger, "image/*", NULL, 0, 0, 0, 0, 0, indexes, 10) == 2);
+        assert (indexes [0] == 1 && indexes [1] == 2);
+        assert (hydra_ledger_query (ledger, "text/plain", NULL, 0, 0, 0, 0, 0, indexes, 10) == 2);
+        assert (indexes [0] == 0 && indexes [1] == 3);
+        assert (hydra_ledger_query_size (ledger, "image", NULL, 0, 0, 0, 0) == 0);
+        assert (hydra_ledger_query_size (ledger, "video/*", NULL, 0, 0, 0, 0) == 0);
+        assert (hydra_ledger_query (ledger, NULL, shared_digest, 0, 0, 0, 0, 0, indexes, 10) == 2);
+        assert (indexes [0] == 1 && indexes [1] == 3);
+        assert (hydra_ledger_query_size (ledger, NULL, "not a digest", 0, 0, 0, 0) == 0);
+        assert (hydra_ledger_query (ledger, NULL, NULL, 2, 3, 0, 0, 0, indexes, 10) == 3);
+        assert (indexes [0] == 1 && indexes [1] == 2 && indexes [2] == 3);
+        assert (hydra_ledger_query (ledger, NULL, NULL, 3, 0, 0, 0, 0, indexes, 10) == 2);
+        assert (indexes [0] == 2 && indexes [1] == 4);
+        assert (hydra_ledger_query (ledger, NULL, NULL, 0, 0, epoch + 2, epoch + 4, 0, indexes, 10) == 2);
+        assert (indexes [0] == 1 && indexes [1] == 2);
+        assert (hydra_ledger_query (ledger, "text/plain", NULL, 2, 0, 0, 0, 0, indexes, 10) == 1);
+        assert (indexes [0] == 3);
+        assert (hydra_ledger_query (ledger, NULL, NULL, 0, 0, 0, 0, 1, indexes, 2) == 2);
+        assert (indexes [0] == 1 && indexes [1] == 2);
+        assert (hydra_ledger_query (ledger, NULL, NULL, 0, 0, 0, 0, 4, indexes, 10) == 1);
+        assert (indexes [0] == 4);
+        assert (hydra_ledger_query (ledger, NULL, NULL, 0, 0, 0, 0, 5, indexes, 10) == 0);
+
+        //  The MIME types and digests survive a checkpoint and reload
+        hydra_ledger_checkpoint (ledger);
+        hydra_ledger_destroy (&ledger);
+        ledger = hydra_ledger_new ();
+        hydra_ledger_load (ledger);
+    }
+    //  Posts stored or evicted later come and go from the columns
+    hydra_ledger_query_size (ledger, NULL, NULL, 0, 0, 0, 0);
+    post = s_post_at ("Query post 5", "2015-01-08T00:00:06Z");
+    hydra_post_set_data (post, "e", 1);
+    hydra_post_set_mime_type (post, "image/gif");
+    hydra_ledger_store (ledger, &post);
+    assert (hydra_ledger_query (ledger, "image/*", NULL, 0, 0, 0, 0, 0, indexes, 10) == 3);
+    assert (indexes [0] == 1 && indexes [1] == 2 && indexes [2] == 5);
+    hydra_ledger_set_retention (ledger, 4, 0, 0);
+    assert (hydra_ledger_query (ledger, "image/*", NULL, 0, 0, 0, 0, 0, indexes, 10) == 2);
+    assert (indexes [0] == 0 && indexes [1] == 3);
+    assert (hydra_ledger_query (ledger, NULL, shared_digest, 0, 0, 0, 0, 0, indexes, 10) == 1);
+    assert (indexes [0] == 1);
+    free (shared_digest);
+    hydra_ledger_destroy (&ledger);
+    zsys_dir_change ("..");
+
+    //  Search finds posts by the words in their subject and text
+    ledger = s_test_ledger ("search");
+    const char *search_posts [][2] = {
+        { "Weekly garden notes", "tomatoes and beans" },
+        { "Tomatoes", "red tomatoes, green tomatoes" },
+        { "Holiday", NULL },
+        { "Beans again", "nothing here" },
+        { "More tomatoes", "none" },
+        { "Tomatoes", "tomatoes" }
+    };
+    for (post_nbr = 0; post_nbr < 4; post_nbr++) {
+        post = hydra_post_new (search_posts [post_nbr][0]);
+        if (search_posts [post_nbr][1])
+            hydra_post_set_content (post, search_posts [post_nbr][1]);
+        else {
+            //  Words in other content are not indexed
+            hydra_post_set_data (post, "tomatoes", 8);
+            hydra_post_set_mime_type (post, "application/octet-stream");
+        }
+        hydra_ledger_store (ledger, &post);
+    }
+    assert (hydra_ledger_search (ledger, "tomatoes", 0, indexes, 10) == 2);
+    assert (indexes [0] == 1 && indexes [1] == 0);
+    assert (hydra_ledger_search (ledger, "Beans", 0, indexes, 10) == 2);
+    assert (indexes [0] == 3 && indexes [1] == 0);
+    assert (hydra_ledger_search (ledger, "tomatoes beans", 0, indexes, 10) == 1);
+    assert (indexes [0] == 0);
+    assert (hydra_ledger_search (ledger, "holiday", 0, indexes, 10) == 1);
+    assert (indexes [0] == 2);
+    assert (hydra_ledger_search (ledger, "potatoes", 0, indexes, 10) == 0);
+    hydra_ledger_checkpoint (ledger);
+    assert (zsys_file_exists ("posts/words"));
+    hydra_ledger_destroy (&ledger);
+
+    //  The first search after loading adds posts stored since the index
+    //  was saved, and later posts go into the index as we store them
+    ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    post = hydra_post_new (search_posts [4][0]);
+    hydra_post_set_content (post, search_posts [4][1]);
+    hydra_ledger_store (ledger, &post);
+    assert (hydra_ledger_search (ledger, "tomatoes", 0, indexes, 10) == 3);
+    assert (indexes [0] == 1 && indexes [1] == 4 && indexes [2] == 0);
+    post = hydra_post_new (search_posts [5][0]);
+    hydra_post_set_content (post, search_posts [5][1]);
+    hydra_ledger_store (ledger, &post);
+    assert (hydra_ledger_search (ledger, "tomatoes", 0, indexes, 10) == 4);
+    assert (indexes [0] == 1 && indexes [1] == 5);
+    assert (indexes [2] == 4 && indexes [3] == 0);
+    assert (hydra_ledger_search (ledger, "tomatoes", 1, indexes, 2) == 2);
+    assert (indexes [0] == 5 && indexes [1] == 4);
+
+    //  Evicted posts drop out of the results
+    hydra_ledger_set_retention (ledger, 4, 0, 0);
+    for (post_nbr = 0; post_nbr < 2; post_nbr++) {
+        assert (hydra_ledger_search (ledger, "tomatoes", 0, indexes, 10) == 2);
+        assert (indexes [0] == 3 && indexes [1] == 2);
+        hydra_ledger_checkpoint (ledger);
+        hydra_ledger_destroy (&ledger);
+        ledger = hydra_ledger_new ();
+        hydra_ledger_load (ledger);
+    }
+    hydra_ledger_destroy (&ledger);
+    zsys_dir_change ("..");
+
+    //  Scrubbing checks every post, a bit at a time
+    ledger = s_test_ledger ("scrub");
+    assert (hydra_ledger_scrub (ledger, 1000) == 0);
+    assert (hydra_ledger_scrub_passes (ledger) == 0);
+    const char *scrub_contents [] = {
+        "Short content", "Content long enough to take several steps to check", "More content"
+    };
+    //  The second post replies to the first
+    char *scrub_parent = NULL;
+    for (post_nbr = 0; post_nbr < 3; post_nbr++) {
+        post = hydra_post_new ("Scrubbed post");
+        hydra_post_set_content (post, scrub_contents [post_nbr]);
+        if (post_nbr == 0)
+            scrub_parent = strdup (hydra_post_ident (post));
+        else
+        if (post_nbr == 1)
+            hydra_post_set_parent_id (post, scrub_parent);
+        hydra_ledger_store (ledger, &post);
+    }
+    assert (hydra_ledger_scrub (ledger, 1000000) > 0);
+    assert (hydra_ledger_scrub_passes (ledger) == 1);
+    assert (hydra_ledger_scrub_posts (ledger) == 3);
+    assert (hydra_ledger_scrub_cursor (ledger) == 0);
+    assert (hydra_ledger_quarantined (ledger) == 0);
+
+    //  Damage the content of the second post, and scrub again in small
+    //  steps, so we hash its content over several calls
+    post = hydra_ledger_fetch (ledger, 1);
+    char *damaged_blob = strdup (hydra_post_location (post));
+    char *damaged_digest = strdup (hydra_post_digest (post));
     hydra_post_destroy (&post);
+    handle = fopen (damaged_blob, "r+b");
+    assert (handle);
+    fputc ('c', handle);
+    fclose (handle);
+    size_t scrub_steps = 0;
+    while (hydra_ledger_scrub_passes (ledger) == 1) {
+        assert (hydra_ledger_scrub (ledger, 16) > 0);
+        scrub_steps++;
+    }
+    assert (scrub_steps > 6);
+    assert (hydra_ledger_scrub_posts (ledger) == 6);
+    assert (hydra_ledger_quarantined (ledger) == 1);
+    assert (hydra_ledger_size (ledger) == 3);
+    assert (hydra_ledger_fetch (ledger, 1) == NULL);
+    assert (!hydra_ledger_has_blob (ledger, damaged_digest));
+    post = hydra_ledger_fetch (ledger, 2);
+    assert (post);
+    hydra_post_destroy (&post);
+    assert (hydra_ledger_export (ledger, "archive") == 2);
+
+    //  Nor do ranges, queries, searches, or threads list it
+    assert (hydra_ledger_range (ledger, 0, INT64_MAX, 0, indexes, 10) == 2);
+    assert (indexes [0] != 1 && indexes [1] != 1);
+    assert (hydra_ledger_range (ledger, 0, INT64_MAX, 1, indexes, 10) == 1);
+    assert (hydra_ledger_query (ledger, NULL, NULL, 0, 0, 0, 0, 0, indexes, 10) == 2);
+    assert (indexes [0] == 0 && indexes [1] == 2);
+    assert (hydra_ledger_query_size (ledger, NULL, NULL, 0, 0, 0, 0) == 2);
+    assert (hydra_ledger_search (ledger, "scrubbed", 0, indexes, 10) == 2);
+    assert (indexes [0] != 1 && indexes [1] != 1);
+    assert (hydra_ledger_search (ledger, "scrubbed", 1, indexes, 10) == 1);
+    assert (hydra_ledger_children (ledger, scrub_parent, 0, indexes, 10) == 0);
+    assert (hydra_ledger_thread (ledger, scrub_parent, 0, indexes, 10) == 1);
+    assert (indexes [0] == 0);
+    zstr_free (&scrub_parent);
+
+    //  The damaged blob is set aside, and the post stays quarantined when
+    //  we reload; good content with the same digest gets a new blob
+    assert (!zsys_file_exists (damaged_blob));
+    char *aside = zsys_sprintf ("posts/quarantine/%s", damaged_digest);
+    assert (zsys_file_exists (aside));
+    zstr_free (&aside);
+    hydra_ledger_checkpoint (ledger);
+    hydra_ledger_destroy (&ledger);
+    ledger = hydra_ledger_new ();
+    hydra_ledger_load (ledger);
+    assert (hydra_ledger_quarantined (ledger) == 1);
+    assert (hydra_ledger_fetch (ledger, 1) == NULL);
+    post = hydra_post_new ("Scrubbed post again");
+    hydra_post_set_content (post, scrub_contents [1]);
+    hydra_ledger_store (ledger, &post);
+    assert (zsys_file_exists (damaged_blob));
+    hydra_ledger_scrub (ledger, 1000000);
+    assert (hydra_ledger_scrub_passes (ledger) == 1);
+    assert (hydra_ledger_quarantined (ledger) == 1);
+    post = hydra_ledger_fetch (ledger, 3);
+    assert (post);
+    assert (hydra_post_verify_content (post) == 0);
+    hydra_post_destroy (&post);
+    zstr_free (&damaged_blob);
+    zstr_free (&damaged_digest);
 
-    //  Done, destroy ledger
+    //  When posts share a damaged blob, each is quarantined and drops its
+    //  reference, so a good copy stored later outlives them
+    const char *shared_subjects [] = { "Shared post", "Another shared post" };
+    for (post_nbr = 0; post_nbr < 2; post_nbr++) {
+        post = hydra_post_new (shared_subjects [post_nbr]);
+        hydra_post_set_content (post, "Shared content");
+        hydra_ledger_store (ledger, &post);
+    }
+    post = hydra_ledger_fetch (ledger, 4);
+    damaged_blob = strdup (hydra_post_location (post));
+    damaged_digest = strdup (hydra_post_digest (post));
+    hydra_post_destroy (&post);
+    handle = fopen (damaged_blob, "r+b");
+    assert (handle);
+    fputc ('s', handle);
+    fclose (handle);
+    while (hydra_ledger_scrub_passes (ledger) == 1)
+        hydra_ledger_scrub (ledger, 1000000);
+    assert (hydra_ledger_quarantined (ledger) == 3);
+    assert (!hydra_ledger_has_blob (ledger, damaged_digest));
+    post = hydra_post_new ("Shared post again");
+    hydra_post_set_content (post, "Shared content");
+    hydra_ledger_store (ledger, &post);
+    assert (hydra_ledger_has_blob (ledger, damaged_digest));
+    hydra_ledger_set_retention (ledger, 1, 0, 0);
+    assert (hydra_ledger_size (ledger) == 1);
+    assert (zsys_file_exists (damaged_blob));
+    post = hydra_ledger_fetch (ledger, 0);
+    assert (post);
+    assert (hydra_post_verify_content (post) == 0);
+    hydra_post_destroy (&post);
+    zstr_free (&damaged_blob);
+    zstr_free (&damaged_digest);
     hydra_ledger_destroy (&ledger);
+    zsys_dir_change ("..");
 
     //  Delete the test directory
     zsys_dir_change ("..");
@@ -0,0 +1,509 @@
+/*  =========================================================================
+    hydra_pack - pack file holding many blobs
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    A pack file holds the content of many blobs, so a node with many old
+    posts needs a few large files instead of one file per blob. The ledger
+    rolls old blobs into packs, and reads packed content by offset.
+@discuss
+    The file is a 32-byte header, then the content of each blob in the
+    order we appended them, then an index with one record per blob, sorted
+    by digest. Each index record is the 20-byte binary digest, the offset
+    of the content in the file, and the content size. The header holds the
+    number of blobs and the offset of the index. Numbers are in network
+    byte order.
+
+    We map the pack into memory and find blobs by binary search over the
+    index. A pack never changes once saved. We build it in a temporary
+    file, check each blob against its digest as we copy it in, and sync
+    and rename the file when done, so a pack is complete or absent.
+@end
+*/
+
+#include "hydra_classes.h"
+#if !defined (__WINDOWS__)
+#   include <sys/mman.h>
+#endif
+
+#define PACK_HEADER         "HYDRAK\x00\x01"
+#define PACK_HEADER_SIZE    32
+#define RECORD_SIZE         36
+#define DIGEST_SIZE         20      //  SHA1 digest, binary
+#define COPY_BLOCK          65536   //  Bytes copied at once when appending
+
+//  Index record layout, per blob
+#define RECORD_DIGEST       0
+#define RECORD_OFFSET       20
+#define RECORD_CONTENT_SIZE 28
+
+//  Structure of our class
+
+struct _hydra_pack_t {
+    char *filename;             //  Pack filename
+    byte *data;                 //  Mapped file data, if mapped
+    size_t data_size;           //  Size of file data
+    byte *index;                //  Index records, sorted by digest
+    size_t size;                //  Number of blobs in pack
+    FILE *handle;               //  When building, temporary file
+    char *tempname;             //  When building, temporary filename
+    size_t data_end;            //  When building, end of blob content
+    size_t max_size;            //  When building, index records allocated
+};
+
+
+//  --------------------------------------------------------------------------
+//  Convert a digest from 40 hex chars to 20 binary bytes. Returns 0 if OK,
+//  -1 if the string is not a valid digest.
+
+static int
+s_digest_decode (const char *digest, byte *binary)
+{
+    if (!digest || strlen (digest) != DIGEST_SIZE * 2)
+        return -1;
+    uint index;
+    for (index = 0; index < DIGEST_SIZE * 2; index++) {
+        char ch = digest [index];
+        int value = ch >= '0' && ch <= '9'? ch - '0':
+                    ch >= 'A' && ch <= 'F'? ch - 'A' + 10:
+                    ch >= 'a' && ch <= 'f'? ch - 'a' + 10: -1;
+        if (value < 0)
+            return -1;
+        if (index % 2)
+            binary [index / 2] |= (byte) value;
+        else
+            binary [index / 2] = (byte) (value << 4);
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new pack file with the specified name, to append blobs to and
+//  then save. Returns NULL if the file could not be created.
+
+hydra_pack_t *
+hydra_pack_new (const char *filename)
+{
+    assert (filename);
+    hydra_pack_t *self = (hydra_pack_t *) zmalloc (sizeof (hydra_pack_t));
+    self->filename = strdup (filename);
+    self->tempname = zsys_sprintf ("%s.tmp", filename);
+    self->handle = fopen (self->tempname, "w+b");
+    self->max_size = 256;       //  Arbitrary, this is expanded on demand
+    self->index = (byte *) malloc (RECORD_SIZE * self->max_size);
+    self->data_end = PACK_HEADER_SIZE;
+    byte header [PACK_HEADER_SIZE] = { 0 };
+    if (!self->handle
+    ||  fwrite (header, 1, PACK_HEADER_SIZE, self->handle) != PACK_HEADER_SIZE) {
+        zsys_error ("hydra_pack: cannot create %s: %s", filename, strerror (errno));
+        hydra_pack_destroy (&self);
+    }
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Check that the content of every blob in the index lies between the header
+//  and the index, so that reads by offset cannot leave the file
+
+static bool
+s_pack_valid (hydra_pack_t *self, size_t index_offset)
+{
+    size_t position;
+    for (position = 0; position < self->size; position++) {
+        byte *record = self->index + position * RECORD_SIZE;
+        uint64_t offset = hydra_util_get_number8 (record + RECORD_OFFSET);
+        uint64_t content_size = hydra_util_get_number8 (record + RECORD_CONTENT_SIZE);
+        if (offset < PACK_HEADER_SIZE
+        ||  offset > index_offset
+        ||  content_size > index_offset - offset)
+            return false;
+    }
+    return true;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Open the pack in the specified file, mapping its index into memory.
+//  Returns NULL if the file does not exist or is not a valid pack.
+
+hydra_pack_t *
+hydra_pack_load (const char *filename)
+{
+    assert (filename);
+    FILE *handle = fopen (filename, "rb");
+    if (!handle)
+        return NULL;
+    fseek (handle, 0, SEEK_END);
+    long data_size = ftell (handle);
+    byte header [PACK_HEADER_SIZE];
+    fseek (handle, 0, SEEK_SET);
+    if (data_size < PACK_HEADER_SIZE
+    ||  fread (header, 1, PACK_HEADER_SIZE, handle) != PACK_HEADER_SIZE
+    ||  memcmp (header, PACK_HEADER, 8)) {
+        zsys_warning ("hydra_pack: %s is not a valid pack", filename);
+        fclose (handle);
+        return NULL;
+    }
+    hydra_pack_t *self = (hydra_pack_t *) zmalloc (sizeof (hydra_pack_t));
+    self->filename = strdup (filename);
+    self->data_size = (size_t) data_size;
+    self->size = (size_t) hydra_util_get_number8 (header + 8);
+    size_t index_offset = (size_t) hydra_util_get_number8 (header + 16);
+    bool valid = index_offset >= PACK_HEADER_SIZE
+              && index_offset <= self->data_size
+              && self->size == (self->data_size - index_offset) / RECORD_SIZE
+              && self->data_size == index_offset + self->size * RECORD_SIZE;
+#if defined (__WINDOWS__)
+    //  No mmap, so read just the index
+    if (valid) {
+        self->index = (byte *) malloc (self->size * RECORD_SIZE + 1);
+        fseek (handle, (long) index_offset, SEEK_SET);
+        if (fread (self->index, RECORD_SIZE, self->size, handle) != self->size)
+            valid = false;
+    }
+#else
+    if (valid) {
+        self->data = (byte *) mmap (NULL, self->data_size, PROT_READ, MAP_SHARED,
+                                    fileno (handle), 0);
+        if (self->data == MAP_FAILED) {
+            self->data = NULL;
+            valid = false;
+        }
+        else
+            self->index = self->data + index_offset;
+    }
+#endif
+    fclose (handle);
+    if (valid)
+        valid = s_pack_valid (self, index_offset);
+    if (!valid) {
+        zsys_warning ("hydra_pack: %s is not a valid pack", filename);
+        hydra_pack_destroy (&self);
+    }
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy the pack. If we were building the pack and did not save it,
+//  deletes the partial file.
+
+void
+hydra_pack_destroy (hydra_pack_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        hydra_pack_t *self = *self_p;
+        if (self->tempname) {
+            //  Pack we were building
+            if (self->handle)
+                fclose (self->handle);
+            zsys_file_delete (self->tempname);
+            free (self->tempname);
+            free (self->index);
+        }
+#if defined (__WINDOWS__)
+        else
+            free (self->index);
+#else
+        else
+        if (self->data)
+            munmap (self->data, self->data_size);
+        else
+            free (self->index);     //  Pack we built and saved
+#endif
+        free (self->filename);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Append a blob to a pack we are building, copying its content from the
+//  specified file. The digest is the content SHA1 digest, as 40 hex chars.
+//  Returns 0 if OK, -1 if the blob could not be copied, in which case the
+//  pack is left as it was.
+
+int
+hydra_pack_append (hydra_pack_t *self, const char *digest, const char *filename)
+{
+    assert (self);
+    assert (self->handle);
+    assert (filename);
+    byte binary [DIGEST_SIZE];
+    if (s_digest_decode (digest, binary))
+        return -1;
+    FILE *input = fopen (filename, "rb");
+    if (!input)
+        return -1;
+
+    //  Copy the blob after the last good one, checking its digest as we go
+    int rc = fseek (self->handle, (long) self->data_end, SEEK_SET);
+    zdigest_t *check = zdigest_new ();
+    byte *buffer = (byte *) malloc (COPY_BLOCK);
+    size_t content_size = 0;
+    while (rc == 0) {
+        size_t bytes = fread (buffer, 1, COPY_BLOCK, input);
+        if (bytes == 0)
+            break;
+        zdigest_update (check, buffer, bytes);
+        if (fwrite (buffer, 1, bytes, self->handle) != bytes)
+            rc = -1;
+        content_size += bytes;
+    }
+    if (ferror (input) || strcmp (zdigest_string (check), digest))
+        rc = -1;
+    free (buffer);
+    zdigest_destroy (&check);
+    fclose (input);
+    if (rc)
+        return -1;
+
+    if (self->size == self->max_size) {
+        self->max_size *= 2;
+        self->index = (byte *) realloc (self->index, RECORD_SIZE * self->max_size);
+    }
+    byte *record = self->index + self->size * RECORD_SIZE;
+    memcpy (record + RECORD_DIGEST, binary, DIGEST_SIZE);
+    hydra_util_put_number8 (record + RECORD_OFFSET, self->data_end);
+    hydra_util_put_number8 (record + RECORD_CONTENT_SIZE, content_size);
+    self->data_end += content_size;
+    self->size++;
+    return 0;
+}
+
+
+static int
+s_compare_records (const void *item1, const void *item2)
+{
+    return memcmp (item1, item2, DIGEST_SIZE);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Save a pack we have built, writing its index and waiting until the disk
+//  has the file. Writes a temporary file and then renames it. Returns 0 if
+//  OK, -1 if the file could not be written.
+
+int
+hydra_pack_save (hydra_pack_t *self)
+{
+    assert (self);
+    assert (self->handle);
+
+    byte header [PACK_HEADER_SIZE] = { 0 };
+    memcpy (header, PACK_HEADER, 8);
+    hydra_util_put_number8 (header + 8, self->size);
+    hydra_util_put_number8 (header + 16, self->data_end);
+    qsort (self->index, self->size, RECORD_SIZE, s_compare_records);
+
+    int rc = 0;
+    if (fseek (self->handle, (long) self->data_end, SEEK_SET)
+    ||  fwrite (self->index, RECORD_SIZE, self->size, self->handle) != self->size
+    ||  fseek (self->handle, 0, SEEK_SET)
+    ||  fwrite (header, 1, PACK_HEADER_SIZE, self->handle) != PACK_HEADER_SIZE)
+        rc = -1;
+    if (hydra_util_file_close (self->handle, true))
+        rc = -1;
+    self->handle = NULL;
+    if (rc == 0)
+        rc = hydra_util_file_publish (self->tempname, self->filename);
+    if (rc)
+        zsys_error ("hydra_pack: cannot write %s: %s", self->filename, strerror (errno));
+    else
+        zstr_free (&self->tempname);
+    return rc? -1: 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the pack filename
+
+const char *
+hydra_pack_filename (hydra_pack_t *self)
+{
+    assert (self);
+    return self->filename;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return number of blobs in the pack
+
+size_t
+hydra_pack_size (hydra_pack_t *self)
+{
+    assert (self);
+    return self->size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Lookup blob by its digest, as 40 hex chars, and return its position in
+//  the pack index; if the pack does not hold the blob, returns -1.
+
+int
+hydra_pack_find (hydra_pack_t *self, const char *digest)
+{
+    assert (self);
+    assert (!self->tempname);
+    byte binary [DIGEST_SIZE];
+    if (s_digest_decode (digest, binary))
+        return -1;
+    byte *record = (byte *) bsearch (binary, self->index, self->size,
+                                     RECORD_SIZE, s_compare_records);
+    return record? (int) ((record - self->index) / RECORD_SIZE): -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return digest of the blob at the specified position, as 40 hex chars.
+//  Caller must free the returned string.
+
+char *
+hydra_pack_digest (hydra_pack_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    const byte *binary = self->index + position * RECORD_SIZE + RECORD_DIGEST;
+    char *digest = (char *) zmalloc (DIGEST_SIZE * 2 + 1);
+    uint index;
+    for (index = 0; index < DIGEST_SIZE; index++) {
+        digest [index * 2] = "0123456789ABCDEF" [binary [index] >> 4];
+        digest [index * 2 + 1] = "0123456789ABCDEF" [binary [index] & 15];
+    }
+    return digest;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return offset in the pack file of the blob at the specified position
+
+size_t
+hydra_pack_offset (hydra_pack_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return (size_t) hydra_util_get_number8 (self->index + position * RECORD_SIZE + RECORD_OFFSET);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return content size of the blob at the specified position
+
+size_t
+hydra_pack_content_size (hydra_pack_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return (size_t) hydra_util_get_number8 (self->index + position * RECORD_SIZE + RECORD_CONTENT_SIZE);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+hydra_pack_test (bool verbose)
+{
+    printf (" * hydra_pack: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zsys_dir_create (".hydra_test");
+    zsys_dir_change (".hydra_test");
+
+    //  Write a few blobs to pack
+    const char *contents [] = { "Hello, World", "", "Some more content" };
+    char *digests [3];
+    uint blob_nbr;
+    for (blob_nbr = 0; blob_nbr < 3; blob_nbr++) {
+        zdigest_t *digest = zdigest_new ();
+        zdigest_update (digest, (byte *) contents [blob_nbr], strlen (contents [blob_nbr]));
+        digests [blob_nbr] = strdup (zdigest_string (digest));
+        zdigest_destroy (&digest);
+        FILE *handle = fopen (digests [blob_nbr], "wb");
+        assert (handle);
+        fwrite (contents [blob_nbr], 1, strlen (contents [blob_nbr]), handle);
+        fclose (handle);
+    }
+    hydra_pack_t *pack = hydra_pack_new ("test.pack");
+    assert (pack);
+    for (blob_nbr = 0; blob_nbr < 3; blob_nbr++)
+        assert (hydra_pack_append (pack, digests [blob_nbr], digests [blob_nbr]) == 0);
+
+    //  A blob that does not match its digest is refused
+    assert (hydra_pack_append (pack, digests [0], digests [2]) == -1);
+    assert (hydra_pack_append (pack, digests [0], "nosuchfile") == -1);
+    assert (hydra_pack_save (pack) == 0);
+    hydra_pack_destroy (&pack);
+    assert (!zsys_file_exists ("test.pack.tmp"));
+
+    //  Read the blobs back by offset
+    pack = hydra_pack_load ("test.pack");
+    assert (pack);
+    assert (hydra_pack_size (pack) == 3);
+    assert (streq (hydra_pack_filename (pack), "test.pack"));
+    for (blob_nbr = 0; blob_nbr < 3; blob_nbr++) {
+        int position = hydra_pack_find (pack, digests [blob_nbr]);
+        assert (position >= 0);
+        char *digest = hydra_pack_digest (pack, position);
+        assert (streq (digest, digests [blob_nbr]));
+        zstr_free (&digest);
+        size_t size = hydra_pack_content_size (pack, position);
+        assert (size == strlen (contents [blob_nbr]));
+        zfile_t *file = zfile_new (NULL, "test.pack");
+        assert (zfile_input (file) == 0);
+        zchunk_t *chunk = zfile_read (file, size, hydra_pack_offset (pack, position));
+        assert (chunk && zchunk_size (chunk) == size);
+        assert (memcmp (zchunk_data (chunk), contents [blob_nbr], size) == 0);
+        zchunk_destroy (&chunk);
+        zfile_destroy (&file);
+    }
+    assert (hydra_pack_find (pack, "0000000000000000000000000000000000000000") == -1);
+    assert (hydra_pack_find (pack, "not a digest") == -1);
+    hydra_pack_destroy (&pack);
+
+    //  A pack whose index points past the blob content is not valid; the
+    //  index follows the 29 bytes of content
+    FILE *handle = fopen ("test.pack", "r+b");
+    assert (handle);
+    fseek (handle, PACK_HEADER_SIZE + 29 + RECORD_CONTENT_SIZE, SEEK_SET);
+    fwrite ("\x00\x00\x00\x00\x00\x01\x00\x00", 1, 8, handle);
+    fclose (handle);
+    assert (hydra_pack_load ("test.pack") == NULL);
+
+    //  An unsaved pack leaves nothing behind, and is not a valid pack
+    pack = hydra_pack_new ("partial.pack");
+    assert (hydra_pack_append (pack, digests [0], digests [0]) == 0);
+    hydra_pack_destroy (&pack);
+    assert (!zsys_file_exists ("partial.pack.tmp"));
+    assert (hydra_pack_load ("partial.pack") == NULL);
+    assert (hydra_pack_load (digests [0]) == NULL);
+
+    for (blob_nbr = 0; blob_nbr < 3; blob_nbr++)
+        free (digests [blob_nbr]);
+
+    //  Delete the test directory
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (".hydra_test", NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
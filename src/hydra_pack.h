@@ -0,0 +1,84 @@
+/*  =========================================================================
+    hydra_pack - pack file holding many blobs
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef HYDRA_PACK_H_INCLUDED
+#define HYDRA_PACK_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new pack file with the specified name, to append blobs to and
+//  then save. Returns NULL if the file could not be created.
+HYDRA_PRIVATE hydra_pack_t *
+    hydra_pack_new (const char *filename);
+
+//  Open the pack in the specified file, mapping its index into memory.
+//  Returns NULL if the file does not exist or is not a valid pack.
+HYDRA_PRIVATE hydra_pack_t *
+    hydra_pack_load (const char *filename);
+
+//  Destroy the pack. If we were building the pack and did not save it,
+//  deletes the partial file.
+HYDRA_PRIVATE void
+    hydra_pack_destroy (hydra_pack_t **self_p);
+
+//  Append a blob to a pack we are building, copying its content from the
+//  specified file. The digest is the content SHA1 digest, as 40 hex chars.
+//  Returns 0 if OK, -1 if the blob could not be copied, in which case the
+//  pack is left as it was.
+HYDRA_PRIVATE int
+    hydra_pack_append (hydra_pack_t *self, const char *digest, const char *filename);
+
+//  Save a pack we have built, writing its index and waiting until the disk
+//  has the file. Writes a temporary file and then renames it. Returns 0 if
+//  OK, -1 if the file could not be written.
+HYDRA_PRIVATE int
+    hydra_pack_save (hydra_pack_t *self);
+
+//  Return the pack filename
+HYDRA_PRIVATE const char *
+    hydra_pack_filename (hydra_pack_t *self);
+
+//  Return number of blobs in the pack
+HYDRA_PRIVATE size_t
+    hydra_pack_size (hydra_pack_t *self);
+
+//  Lookup blob by its digest, as 40 hex chars, and return its position in
+//  the pack index; if the pack does not hold the blob, returns -1.
+HYDRA_PRIVATE int
+    hydra_pack_find (hydra_pack_t *self, const char *digest);
+
+//  Return digest of the blob at the specified position, as 40 hex chars.
+//  Caller must free the returned string.
+HYDRA_PRIVATE char *
+    hydra_pack_digest (hydra_pack_t *self, size_t position);
+
+//  Return offset in the pack file of the blob at the specified position
+HYDRA_PRIVATE size_t
+    hydra_pack_offset (hydra_pack_t *self, size_t position);
+
+//  Return content size of the blob at the specified position
+HYDRA_PRIVATE size_t
+    hydra_pack_content_size (hydra_pack_t *self, size_t position);
+
+//  Self test of this class
+HYDRA_PRIVATE void
+    hydra_pack_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -22,18 +22,27 @@
 #include "hydra_classes.h"
 
 #define ID_SIZE     40          //  Size of SHA1 digest as text string
+#define BLOBS_DIR   "posts/blobs/"
+
+//  Files this large or larger are hashed on a second thread as we import
+//  them; below this, starting the thread costs more than it saves
+#define PARALLEL_IMPORT_MIN     4 * 1024 * 1024
 
 //  Structure of our class
 
 struct _hydra_post_t {
     char ident [ID_SIZE + 1];   //  SHA1 (subject ":" timestamp ":" parent_id
                                 //        ":" mime_type ":" digest)
+    bool ident_valid;           //  Ident is up to date with the fields
+    size_t ident_hashes;        //  How often we calculated the ident
     char *subject;              //  Post subject
     char timestamp [21];        //  Timestamp yyyy-mm-ddThh:mm:ssZ
     char parent_id [ID_SIZE + 1];   //  Parent ID, if any
     char *mime_type;            //  MIME type
     char *location;             //  Content filename, or
     zchunk_t *content;          //  Content chunk
+    char *pack;                 //  Pack file holding content, if packed
+    size_t pack_offset;         //  Offset of content in pack file
     char digest [ID_SIZE + 1];  //  Content SHA1 digest
     size_t content_size;        //  Content size
 };
@@ -70,6 +79,7 @@ hydra_post_destroy (hydra_post_t **self_p)
         zstr_free (&self->mime_type);
         zstr_free (&self->location);
         zchunk_destroy (&self->content);
+        zstr_free (&self->pack);
         free (self);
         *self_p = NULL;
     }
@@ -77,13 +87,11 @@ hydra_post_destroy (hydra_post_t **self_p)
 
 
 //  --------------------------------------------------------------------------
-//  Recalculate the post ID based on subject, timestamp, parent id, MIME
-//  type, and content digest, and return post ID to caller.
+//  Calculate the post ID from the post fields, into the caller's buffer
 
-const char *
-hydra_post_ident (hydra_post_t *self)
+static void
+s_ident_calculate (hydra_post_t *self, char *ident)
 {
-    assert (self);
     zdigest_t *digest = zdigest_new ();
     if (digest) {
         char *digest_text = zsys_sprintf ("%s:%s:%s:%s:%s",
@@ -91,14 +99,64 @@ hydra_post_ident (hydra_post_t *self)
             self->mime_type? self->mime_type: "", self->digest);
         zdigest_update (digest, (byte *) digest_text, strlen (digest_text));
         assert (strlen (zdigest_string (digest)) == ID_SIZE);
-        strcpy (self->ident, zdigest_string (digest));
+        strcpy (ident, zdigest_string (digest));
         zstr_free (&digest_text);
         zdigest_destroy (&digest);
+        self->ident_hashes++;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the post ID, which is the SHA1 digest of the subject, timestamp,
+//  parent id, MIME type, and content digest. We calculate the ID when first
+//  asked, and again only after a change to any of these fields. A post
+//  unpacked from the ledger keeps the ID it was packed with; use
+//  hydra_post_verify_ident to check that against the fields.
+
+const char *
+hydra_post_ident (hydra_post_t *self)
+{
+    assert (self);
+    if (!self->ident_valid) {
+        s_ident_calculate (self, self->ident);
+        self->ident_valid = true;
     }
     return self->ident;
 }
 
 
+//  --------------------------------------------------------------------------
+//  Check the post ID against the post fields, calculating it again. Returns
+//  0 if OK, -1 if the post holds a post ID that does not match its fields.
+//  Use this on posts from any source you do not trust.
+
+int
+hydra_post_verify_ident (hydra_post_t *self)
+{
+    assert (self);
+    char ident [ID_SIZE + 1];
+    s_ident_calculate (self, ident);
+    if (*self->ident && strcmp (ident, self->ident))
+        return -1;
+    strcpy (self->ident, ident);
+    self->ident_valid = true;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return how often we calculated the ID of this post, so we can check we
+//  do not hash it again on every call.
+
+size_t
+hydra_post_ident_hashes (hydra_post_t *self)
+{
+    assert (self);
+    return self->ident_hashes;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return the post subject, if set
 
@@ -176,9 +234,38 @@ hydra_post_content_size (hydra_post_t *self)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Return the name of the file that holds the post content: its pack file
+//  if the content is packed, else its location. Returns NULL if the post
+//  holds its content in memory, or has none.
+
+const char *
+hydra_post_content_file (hydra_post_t *self)
+{
+    assert (self);
+    if (self->content)
+        return NULL;
+    return self->pack? self->pack: self->location;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the offset of the post content in the file that holds it, which
+//  is zero unless the content is packed.
+
+size_t
+hydra_post_content_offset (hydra_post_t *self)
+{
+    assert (self);
+    return self->pack && !self->content? self->pack_offset: 0;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return the post content as a string. Returns NULL if the MIME type is
 //  not "text/plain". The caller must destroy the string when finished with it.
+//  This reads all the content into memory; to read large content a window
+//  at a time, use hydra_post_reader.
 
 char *
 hydra_post_content (hydra_post_t *self)
@@ -188,7 +275,7 @@ hydra_post_content (hydra_post_t *self)
     if (self->mime_type && streq (self->mime_type, "text/plain")) {
         if (self->content)
             return zchunk_strdup (self->content);
-        zchunk_t *chunk = hydra_post_fetch (self, 0, 0); // TODO: limit max size
+        zchunk_t *chunk = hydra_post_fetch (self, 0, 0);
         if (chunk) {
             content = zchunk_strdup (chunk);
         }
@@ -207,6 +294,7 @@ hydra_post_set_parent_id (hydra_post_t *self, const char *parent_id)
     assert (self);
     assert (strlen (parent_id) == 0 || strlen (parent_id) == ID_SIZE);
     strcpy (self->parent_id, parent_id);
+    self->ident_valid = false;
 }
 
 
@@ -219,6 +307,7 @@ hydra_post_set_mime_type (hydra_post_t *self, const char *mime_type)
     assert (self);
     free (self->mime_type);
     self->mime_type = strdup (mime_type);
+    self->ident_valid = false;
 }
 
 
@@ -249,6 +338,7 @@ hydra_post_set_data (hydra_post_t *self, const void *data, size_t size)
     self->content = zchunk_new (data, size);
     strcpy (self->digest, zchunk_digest (self->content));
     self->content_size = zchunk_size (self->content);
+    self->ident_valid = false;
 }
 
 
@@ -267,6 +357,7 @@ hydra_post_set_file (hydra_post_t *self, const char *location)
     int rc = 0;
     self->location = strdup (location);
     zchunk_destroy (&self->content);
+    self->ident_valid = false;
     zfile_t *file = zfile_new (NULL, self->location);
     if (file && zfile_is_readable (file)) {
         self->content_size = zfile_cursize (file);
@@ -280,6 +371,172 @@ hydra_post_set_file (hydra_post_t *self, const char *location)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Copy the specified file into the blob store, and set the post content to
+//  the copy. Unlike hydra_post_set_file, the post then owns its content, and
+//  the application may change or delete the file. We hash the file as we
+//  copy it, so read it only once, and hash large files on a second thread.
+//  Returns 0 if OK, -1 if the file was unreadable or could not be copied.
+
+int
+hydra_post_import_file (hydra_post_t *self, const char *location)
+{
+    assert (self);
+    assert (location);
+    ssize_t file_size = zsys_file_size (location);
+    FILE *input = fopen (location, "rb");
+    if (!input)
+        return -1;
+    size_t size;
+    char *digest = hydra_blobs_import (input, file_size >= PARALLEL_IMPORT_MIN, &size);
+    fclose (input);
+    if (!digest)
+        return -1;
+
+    zchunk_destroy (&self->content);
+    zstr_free (&self->pack);
+    self->pack_offset = 0;
+    free (self->location);
+    self->location = hydra_blobs_location (digest);
+    strcpy (self->digest, digest);
+    self->content_size = size;
+    self->ident_valid = false;
+    zstr_free (&digest);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Read the post content from the specified pack file, starting at the
+//  specified offset, rather than from its location. The location still
+//  names the post blob. Note: for internal use only.
+
+void
+hydra_post_set_pack (hydra_post_t *self, const char *pack, size_t offset)
+{
+    assert (self);
+    assert (pack);
+    free (self->pack);
+    self->pack = strdup (pack);
+    self->pack_offset = offset;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the post content location to the specified file, which already holds
+//  the post content, without reading it. Any content held in memory or in a
+//  pack is dropped. Note: for internal use only.
+
+void
+hydra_post_set_location (hydra_post_t *self, const char *location)
+{
+    assert (self);
+    assert (location);
+    free (self->location);
+    self->location = strdup (location);
+    zchunk_destroy (&self->content);
+    zstr_free (&self->pack);
+    self->pack_offset = 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Older nodes kept all blobs in posts/blobs; map such a location to where
+//  the blob lives now, in place.
+
+static void
+s_location_upgrade (char **location_p)
+{
+    const char *digest = *location_p + strlen (BLOBS_DIR);
+    if (strncmp (*location_p, BLOBS_DIR, strlen (BLOBS_DIR)) == 0
+    &&  strlen (digest) == ID_SIZE) {
+        char *location = hydra_blobs_location (digest);
+        free (*location_p);
+        *location_p = location;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Save the post content to disk, if it is held in memory, in the blobs
+//  subdirectory, and set the location property to point to it. Returns 0
+//  if OK, -1 if the blob could not be written. Does nothing if the content
+//  was already saved or points to an existing file. We write the blob in
+//  posts/staging and then rename it, so a blob is always complete. If we
+//  already have a blob with the same content, we use that and write nothing.
+
+int
+hydra_post_save_content (hydra_post_t *self)
+{
+    assert (self);
+    if (self->content) {
+        assert (!self->location);
+        if (hydra_blobs_insert (self->digest, self->content))
+            return -1;
+        self->location = hydra_blobs_location (self->digest);
+        zchunk_destroy (&self->content);
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Check packed content against the post digest, reading it in blocks.
+//  Returns 0 if OK, -1 if the content is missing or damaged.
+
+static int
+s_verify_packed (hydra_post_t *self)
+{
+    FILE *input = fopen (self->pack, "rb");
+    if (!input)
+        return -1;
+    zdigest_t *digest = zdigest_new ();
+    byte buffer [8192];
+    size_t remaining = self->content_size;
+    int rc = fseek (input, (long) self->pack_offset, SEEK_SET);
+    while (rc == 0 && remaining) {
+        size_t bytes = fread (buffer, 1,
+            remaining < sizeof (buffer)? remaining: sizeof (buffer), input);
+        if (bytes == 0)
+            rc = -1;
+        zdigest_update (digest, buffer, bytes);
+        remaining -= bytes;
+    }
+    if (rc == 0 && strcmp (zdigest_string (digest), self->digest))
+        rc = -1;
+    zdigest_destroy (&digest);
+    fclose (input);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Check that the post content on disk is complete and matches the post
+//  digest. Returns 0 if OK, or if the content is held in memory or there is
+//  none; -1 if the content file is missing or damaged.
+
+int
+hydra_post_verify_content (hydra_post_t *self)
+{
+    assert (self);
+    if (self->content || !self->location)
+        return 0;
+    if (self->pack)
+        return s_verify_packed (self);
+
+    int rc = -1;
+    zfile_t *file = zfile_new (NULL, self->location);
+    if (file && zfile_is_readable (file)
+    &&  zfile_cursize (file) == (off_t) self->content_size) {
+        const char *digest = zfile_digest (file);
+        if (digest && streq (digest, self->digest))
+            rc = 0;
+    }
+    zfile_destroy (&file);
+    return rc;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Save the post to disk under the specified filename. Returns 0 if OK, -1
 //  if the file could not be created. Posts are always stored in the "posts"
@@ -291,20 +548,14 @@ hydra_post_save (hydra_post_t *self, const char *filename)
     assert (self);
     assert (filename);
 
-    //  Creeate subdirectories if necessary
+    //  Create subdirectories if necessary
     zsys_dir_create ("posts");
-    zsys_dir_create ("posts/blobs");
 
     //  If post content hasn't yet been serialised, write it to disk in the
     //  blobs directory and set the location property to point to it.
-    if (self->content) {
-        assert (!self->location);
-        self->location = zsys_sprintf ("posts/blobs/%s", self->digest);
-        FILE *output = fopen (self->location, "wb");
-        zchunk_write (self->content, output);
-        zchunk_destroy (&self->content);
-        fclose (output);
-    }
+    if (hydra_post_save_content (self))
+        return -1;
+
     zconfig_t *root = zconfig_new ("root", NULL);
     zconfig_put (root, "/post/ident", hydra_post_ident (self));
     zconfig_put (root, "/post/subject", self->subject);
@@ -314,9 +565,18 @@ hydra_post_save (hydra_post_t *self, const char *filename)
     zconfig_put (root, "/post/digest", self->digest);
     zconfig_put (root, "/post/location", self->location);
     zconfig_putf (root, "/post/content-size", "%ld", self->content_size);
-    zconfig_savef (root, "posts/%s", filename);
+
+    //  Write to staging area and then rename, so the file is always complete
+    zsys_dir_create ("posts/staging");
+    char *staged = zsys_sprintf ("posts/staging/%s", filename);
+    char *final = zsys_sprintf ("posts/%s", filename);
+    int rc = zconfig_save (root, staged);
+    if (rc == 0)
+        rc = hydra_util_file_publish (staged, final);
+    zstr_free (&staged);
+    zstr_free (&final);
     zconfig_destroy (&root);
-    return 0;
+    return rc;
 }
 
 
@@ -353,6 +613,7 @@ hydra_post_load (const char *filename)
         strcpy (self->parent_id, parent_id);
         self->mime_type = strdup (mime_type);
         self->location = strdup (location);
+        s_location_upgrade (&self->location);
         strcpy (self->digest, digest);
         self->content_size = atoll (zconfig_resolve (root, "/post/content-size", "0"));
         zchunk_destroy (&self->content);
@@ -362,6 +623,181 @@ hydra_post_load (const char *filename)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Binary encoding macros for pack and unpack; numbers are in network
+//  byte order, as in hydra_proto
+
+#define PACK_VERSION    1       //  Bump when the packed layout changes
+
+#define PUT_NUMBER1(host) { \
+    *needle++ = (byte) (host); \
+}
+#define PUT_NUMBER4(host) { \
+    needle [0] = (byte) (((host) >> 24) & 255); \
+    needle [1] = (byte) (((host) >> 16) & 255); \
+    needle [2] = (byte) (((host) >> 8)  & 255); \
+    needle [3] = (byte) (((host))       & 255); \
+    needle += 4; \
+}
+#define PUT_NUMBER8(host) { \
+    PUT_NUMBER4 ((uint64_t) (host) >> 32); \
+    PUT_NUMBER4 ((uint64_t) (host) & 0xFFFFFFFF); \
+}
+#define PUT_STRING(host) { \
+    size_t string_size = strlen (host); \
+    PUT_NUMBER1 (string_size); \
+    memcpy (needle, (host), string_size); \
+    needle += string_size; \
+}
+#define PUT_LONGSTR(host) { \
+    size_t string_size = strlen (host); \
+    PUT_NUMBER4 (string_size); \
+    memcpy (needle, (host), string_size); \
+    needle += string_size; \
+}
+#define GET_NUMBER1(host) { \
+    if (needle + 1 > ceiling) \
+        goto malformed; \
+    (host) = *needle++; \
+}
+#define GET_NUMBER4(host) { \
+    if (needle + 4 > ceiling) \
+        goto malformed; \
+    (host) = ((uint32_t) (needle [0]) << 24) \
+           + ((uint32_t) (needle [1]) << 16) \
+           + ((uint32_t) (needle [2]) << 8) \
+           +  (uint32_t) (needle [3]); \
+    needle += 4; \
+}
+#define GET_NUMBER8(host) { \
+    uint32_t high, low; \
+    GET_NUMBER4 (high); \
+    GET_NUMBER4 (low); \
+    (host) = ((uint64_t) high << 32) + low; \
+}
+//  Gets a string into a fixed buffer, which must be exactly string_size
+//  (or empty, if optional), as all our fixed fields are digests or times
+#define GET_FIXSTR(host,fixed_size,optional) { \
+    size_t string_size; \
+    GET_NUMBER1 (string_size); \
+    if ((string_size != (fixed_size) && !((optional) && string_size == 0)) \
+    ||  needle + string_size > ceiling) \
+        goto malformed; \
+    memcpy ((host), needle, string_size); \
+    (host) [string_size] = 0; \
+    needle += string_size; \
+}
+#define GET_LONGSTR(host) { \
+    size_t string_size; \
+    GET_NUMBER4 (string_size); \
+    if (needle + string_size > ceiling) \
+        goto malformed; \
+    free ((host)); \
+    (host) = (char *) malloc (string_size + 1); \
+    memcpy ((host), needle, string_size); \
+    (host) [string_size] = 0; \
+    needle += string_size; \
+}
+
+
+//  --------------------------------------------------------------------------
+//  Pack the post metadata into a binary chunk, for storage in the ledger
+//  journal. The post content must already be saved to disk. Returns a new
+//  chunk which the caller must destroy.
+
+zchunk_t *
+hydra_post_pack (hydra_post_t *self)
+{
+    assert (self);
+    assert (!self->content);
+    const char *mime_type = self->mime_type? self->mime_type: "";
+    const char *location = self->location? self->location: "";
+    hydra_post_ident (self);
+
+    //  Version, five short strings, two long strings, and content size
+    size_t frame_size = 1
+        + 1 + strlen (self->ident)
+        + 4 + strlen (self->subject)
+        + 1 + strlen (self->timestamp)
+        + 1 + strlen (self->parent_id)
+        + 1 + strlen (mime_type)
+        + 1 + strlen (self->digest)
+        + 4 + strlen (location)
+        + 8;
+    assert (strlen (mime_type) < 256);
+    zchunk_t *chunk = zchunk_new (NULL, frame_size);
+    byte *needle = zchunk_data (chunk);
+
+    PUT_NUMBER1 (PACK_VERSION);
+    PUT_STRING  (self->ident);
+    PUT_LONGSTR (self->subject);
+    PUT_STRING  (self->timestamp);
+    PUT_STRING  (self->parent_id);
+    PUT_STRING  (mime_type);
+    PUT_STRING  (self->digest);
+    PUT_LONGSTR (location);
+    PUT_NUMBER8 (self->content_size);
+
+    assert (needle == zchunk_data (chunk) + frame_size);
+    zchunk_set (chunk, NULL, frame_size);
+    return chunk;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new post from a chunk produced by hydra_post_pack. Returns NULL
+//  if the chunk is not a valid packed post.
+
+hydra_post_t *
+hydra_post_unpack (zchunk_t *chunk)
+{
+    assert (chunk);
+    byte *needle = zchunk_data (chunk);
+    byte *ceiling = needle + zchunk_size (chunk);
+
+    //  Don't use hydra_post_new, as we may run in several threads at once
+    //  and it calls gmtime, which is not thread safe
+    hydra_post_t *self = (hydra_post_t *) zmalloc (sizeof (hydra_post_t));
+    char mime_type [256];
+    uint64_t content_size;
+    byte version;
+    GET_NUMBER1 (version);
+    if (version != PACK_VERSION)
+        goto malformed;
+    GET_FIXSTR  (self->ident, ID_SIZE, false);
+    GET_LONGSTR (self->subject);
+    GET_FIXSTR  (self->timestamp, 20, false);
+    GET_FIXSTR  (self->parent_id, ID_SIZE, true);
+    {
+        //  MIME type is the one variable-length short string
+        size_t string_size;
+        GET_NUMBER1 (string_size);
+        if (needle + string_size > ceiling)
+            goto malformed;
+        memcpy (mime_type, needle, string_size);
+        mime_type [string_size] = 0;
+        needle += string_size;
+    }
+    GET_FIXSTR  (self->digest, ID_SIZE, true);
+    GET_LONGSTR (self->location);
+    GET_NUMBER8 (content_size);
+    //  We packed the post ID with the fields, so trust it
+    self->ident_valid = true;
+    self->mime_type = strdup (mime_type);
+    self->content_size = (size_t) content_size;
+    if (*self->location == 0)
+        zstr_free (&self->location);
+    else
+        s_location_upgrade (&self->location);
+    return self;
+
+    malformed:
+        zsys_warning ("hydra_post: malformed packed post");
+        hydra_post_destroy (&self);
+        return NULL;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Encode a post metadata to a hydra_proto message
 
@@ -371,7 +807,7 @@ hydra_post_encode (hydra_post_t *self, hydra_proto_t *proto)
     assert (self);
     assert (proto);
     
-    hydra_proto_set_ident (proto, self->ident);
+    hydra_proto_set_ident (proto, hydra_post_ident (self));
     hydra_proto_set_subject (proto, self->subject);
     hydra_proto_set_timestamp (proto, self->timestamp);
     hydra_proto_set_parent_id (proto, self->parent_id);
@@ -418,12 +854,23 @@ hydra_post_fetch (hydra_post_t *self, size_t size, size_t offset)
     if (size == 0)
         size = self->content_size;
     
-    zfile_t *file = zfile_new (NULL, self->location);
+    //  Packed content sits among other blobs, so don't read past its end
+    const char *filename = self->location;
+    if (self->pack) {
+        filename = self->pack;
+        if (offset > self->content_size)
+            offset = self->content_size;
+        if (size > self->content_size - offset)
+            size = self->content_size - offset;
+        offset += self->pack_offset;
+    }
+    zfile_t *file = zfile_new (NULL, filename);
     if (zfile_input (file) == 0) {
         zchunk_t *chunk = zfile_read (file, size, offset);
         zfile_destroy (&file);
         return chunk;
     }
+    zfile_destroy (&file);
     return NULL;
 }
 
@@ -439,6 +886,7 @@ hydra_post_dup (hydra_post_t *self)
     hydra_post_t *copy = hydra_post_new (self->subject);
     if (copy) {
         strcpy (copy->ident, self->ident);
+        copy->ident_valid = self->ident_valid;
         strcpy (copy->timestamp, self->timestamp);
         strcpy (copy->parent_id, self->parent_id);
         if (self->mime_type)
@@ -448,6 +896,9 @@ hydra_post_dup (hydra_post_t *self)
         strcpy (copy->digest, self->digest);
         copy->content_size = self->content_size;
         copy->content = zchunk_dup (self->content);
+        if (self->pack)
+            copy->pack = strdup (self->pack);
+        copy->pack_offset = self->pack_offset;
     }
     return copy;
 }
@@ -460,7 +911,7 @@ void
 hydra_post_print (hydra_post_t *self)
 {
     assert (self);
-    printf ("POST   ident: %s\n", self->ident);
+    printf ("POST   ident: %s\n", hydra_post_ident (self));
     printf ("     subject: %s\n", self->subject);
     printf ("   timestamp: %s\n", self->timestamp);
     printf ("   parent-id: %s\n", self->parent_id);
@@ -501,6 +952,11 @@ hydra_post_test (bool verbose)
     post = hydra_post_load ("testpost");
     assert (post);
     assert (hydra_post_content_size (post) == 12);
+    //  Blobs are filed under the first two digits of their digest
+    char *location = zsys_sprintf ("posts/blobs/%.2s/%s",
+        hydra_post_digest (post), hydra_post_digest (post));
+    assert (streq (hydra_post_location (post), location));
+    zstr_free (&location);
     if (verbose)
         hydra_post_print (post);
     content = hydra_post_content (post);
@@ -515,9 +971,109 @@ hydra_post_test (bool verbose)
 
     hydra_post_t *copy = hydra_post_dup (post);
     assert (streq (hydra_post_ident (copy), hydra_post_ident (post)));
-    hydra_post_destroy (&post);
     hydra_post_destroy (&copy);
 
+    //  Pack and unpack post, as the ledger journal does
+    chunk = hydra_post_pack (post);
+    assert (chunk);
+    copy = hydra_post_unpack (chunk);
+    assert (copy);
+    assert (streq (hydra_post_ident (copy), hydra_post_ident (post)));
+    assert (streq (hydra_post_location (copy), hydra_post_location (post)));
+    assert (hydra_post_content_size (copy) == 12);
+    hydra_post_destroy (&copy);
+    //  Truncated data is rejected
+    zchunk_t *truncated = zchunk_new (zchunk_data (chunk), zchunk_size (chunk) - 1);
+    copy = hydra_post_unpack (truncated);
+    assert (copy == NULL);
+    zchunk_destroy (&truncated);
+    //  A damaged field keeps the packed post ID, which no longer checks out
+    byte *subject = zchunk_data (chunk);
+    while (memcmp (subject, "Test post", 9))
+        subject++;
+    *subject = 'B';
+    copy = hydra_post_unpack (chunk);
+    assert (copy);
+    assert (streq (hydra_post_ident (copy), hydra_post_ident (post)));
+    assert (hydra_post_verify_ident (copy) == -1);
+    hydra_post_destroy (&copy);
+    zchunk_destroy (&chunk);
+
+    //  We calculate the post ID once, and again after a field changes
+    copy = hydra_post_new ("Ident test");
+    char *ident = strdup (hydra_post_ident (copy));
+    assert (streq (hydra_post_ident (copy), ident));
+    assert (hydra_post_ident_hashes (copy) == 1);
+    hydra_post_set_mime_type (copy, "text/html");
+    assert (strneq (hydra_post_ident (copy), ident));
+    assert (strneq (hydra_post_ident (copy), ident));
+    assert (hydra_post_ident_hashes (copy) == 2);
+    assert (hydra_post_verify_ident (copy) == 0);
+    assert (hydra_post_ident_hashes (copy) == 3);
+    zstr_free (&ident);
+    hydra_post_destroy (&copy);
+
+    //  Saved content checks out until the blob is damaged
+    assert (hydra_post_verify_content (post) == 0);
+    FILE *handle = fopen (hydra_post_location (post), "wb");
+    assert (handle);
+    fwrite ("Hello, Wurld", 1, 12, handle);
+    fclose (handle);
+    assert (hydra_post_verify_content (post) == -1);
+
+    //  Packed content is read from its offset in the pack, and no further
+    handle = fopen ("test.pack", "wb");
+    assert (handle);
+    fwrite ("....Hello, World....", 1, 20, handle);
+    fclose (handle);
+    hydra_post_set_pack (post, "test.pack", 4);
+    assert (hydra_post_verify_content (post) == 0);
+    copy = hydra_post_dup (post);
+    chunk = hydra_post_fetch (copy, 0, 0);
+    assert (chunk && zchunk_size (chunk) == 12);
+    assert (memcmp (zchunk_data (chunk), "Hello, World", 12) == 0);
+    zchunk_destroy (&chunk);
+    chunk = hydra_post_fetch (copy, 100, 7);
+    assert (chunk && zchunk_size (chunk) == 5);
+    assert (memcmp (zchunk_data (chunk), "World", 5) == 0);
+    zchunk_destroy (&chunk);
+    hydra_post_destroy (&copy);
+    hydra_post_set_pack (post, "test.pack", 5);
+    assert (hydra_post_verify_content (post) == -1);
+
+    //  Pointing the post at a file that holds its content reads it there
+    handle = fopen ("test.blob", "wb");
+    assert (handle);
+    fwrite ("Hello, World", 1, 12, handle);
+    fclose (handle);
+    hydra_post_set_location (post, "test.blob");
+    assert (streq (hydra_post_location (post), "test.blob"));
+    assert (hydra_post_verify_content (post) == 0);
+    content = hydra_post_content (post);
+    assert (streq (content, "Hello, World"));
+    zstr_free (&content);
+
+    //  Importing a file copies it into the blob store, with the same
+    //  digest as pointing at it, and the post no longer needs the file
+    handle = fopen ("test.import", "wb");
+    assert (handle);
+    fwrite ("Hello, Import", 1, 13, handle);
+    fclose (handle);
+    hydra_post_set_file (post, "test.import");
+    char digest [ID_SIZE + 1];
+    strcpy (digest, hydra_post_digest (post));
+    assert (hydra_post_import_file (post, "test.import") == 0);
+    assert (streq (hydra_post_digest (post), digest));
+    assert (hydra_post_content_size (post) == 13);
+    assert (hydra_blobs_digest (hydra_post_location (post)));
+    zsys_file_delete ("test.import");
+    assert (hydra_post_verify_content (post) == 0);
+    content = hydra_post_content (post);
+    assert (streq (content, "Hello, Import"));
+    zstr_free (&content);
+    assert (hydra_post_import_file (post, "test.import") == -1);
+    hydra_post_destroy (&post);
+
     //  Delete the test directory
     zsys_dir_change ("..");
     zdir_t *dir = zdir_new (".hydra_test", NULL);
@@ -0,0 +1,35 @@
+/*  =========================================================================
+    hydra_post_private - post methods for use inside the library
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef HYDRA_POST_PRIVATE_H_INCLUDED
+#define HYDRA_POST_PRIVATE_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  Return how often we calculated the ID of this post, so we can check we
+//  do not hash it again on every call.
+HYDRA_PRIVATE size_t
+    hydra_post_ident_hashes (hydra_post_t *self);
+
+//  Read the post content from the specified pack file, starting at the
+//  specified offset, rather than from its location. The location still
+//  names the post blob.
+HYDRA_PRIVATE void
+    hydra_post_set_pack (hydra_post_t *self, const char *pack, size_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,424 @@
+/*  =========================================================================
+    hydra_post_reader - read post content a window at a time
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    Reads the content of a post in windows of a fixed size, so that we can
+    stream large content, such as video, in constant memory. You can seek
+    to any offset in the content and read on from there.
+@discuss
+    The reader maps the content into memory where it can, and copies each
+    window out of the map; pages the kernel has read ahead for us cost no
+    system call. If we cannot map the file, or on Windows, we read it with
+    stdio instead. Packed content sits among other blobs in its pack, so we
+    map just the pages that hold it, and never read past its end.
+
+    If the post holds its content in memory, the reader takes a copy, so
+    the post may go while we read.
+
+    A view is a chunk that points into the mapping instead of holding a
+    copy, so the server can send a large chunk of content with one copy,
+    into the outgoing frame, rather than two. This needs zchunk_frommem, a
+    draft czmq method, so we only make views when built against czmq 4.1
+    or later with CZMQ_BUILD_DRAFT_API defined; otherwise a view is a copy
+    like any other chunk. Each view holds a reference to the mapping, so
+    the mapping lasts until the reader and all its views are gone.
+@end
+*/
+
+#include "hydra_classes.h"
+#if !defined (__WINDOWS__)
+#   include <sys/mman.h>
+#endif
+
+#define WINDOW_SIZE     65536       //  Default window size
+
+//  We can wrap mapped content in a chunk without copying it
+#if !defined (__WINDOWS__) && defined (CZMQ_BUILD_DRAFT_API) \
+&&  CZMQ_VERSION >= CZMQ_MAKE_VERSION (4, 1, 0)
+#   define ZERO_COPY
+#endif
+
+//  Mapped pages, shared by the reader and the views it hands out
+
+typedef struct {
+    byte *data;                 //  Mapped pages holding content
+    size_t size;                //  Size of mapped pages
+    size_t refs;                //  Reader and views using the mapping
+} mapping_t;
+
+//  Structure of our class
+
+struct _hydra_post_reader_t {
+    size_t size;                //  Content size
+    size_t offset;              //  Offset of next window in content
+    size_t window_size;         //  Most bytes we return at once
+    FILE *handle;               //  File holding content, if not mapped
+    size_t file_offset;         //  Offset of content in file
+    mapping_t *mapping;         //  Mapped pages holding content, if any
+    const byte *data;           //  Content in map or chunk, if any
+    zchunk_t *chunk;            //  Content held in memory, if any
+};
+
+
+//  --------------------------------------------------------------------------
+//  Create a reader for the post content, returning at most window_size
+//  bytes at a time; zero means 64KB. Reads from the post's blob file, or
+//  pack file, or from memory if the post holds its content there. Returns
+//  NULL if the content file is missing or too short.
+
+hydra_post_reader_t *
+hydra_post_reader_new (hydra_post_t *post, size_t window_size)
+{
+    assert (post);
+    hydra_post_reader_t *self = (hydra_post_reader_t *) zmalloc (sizeof (hydra_post_reader_t));
+    assert (self);
+    self->size = hydra_post_content_size (post);
+    self->window_size = window_size? window_size: WINDOW_SIZE;
+    const char *filename = hydra_post_content_file (post);
+    if (!filename) {
+        //  Content is in memory, or there is none
+        if (self->size) {
+            self->chunk = hydra_post_fetch (post, 0, 0);
+            if (self->chunk && zchunk_size (self->chunk) == self->size)
+                self->data = zchunk_data (self->chunk);
+            else
+                hydra_post_reader_destroy (&self);
+        }
+        return self;
+    }
+    self->file_offset = hydra_post_content_offset (post);
+    self->handle = fopen (filename, "rb");
+    if (!self->handle
+    ||  fseek (self->handle, 0, SEEK_END)
+    ||  ftell (self->handle) < (long) (self->file_offset + self->size)) {
+        hydra_post_reader_destroy (&self);
+        return NULL;
+    }
+#if !defined (__WINDOWS__)
+    //  Map from the start of the page that holds the content
+    if (self->size) {
+        size_t page_size = (size_t) sysconf (_SC_PAGESIZE);
+        size_t map_offset = self->file_offset - self->file_offset % page_size;
+        size_t map_size = self->file_offset - map_offset + self->size;
+        byte *map = (byte *) mmap (NULL, map_size, PROT_READ, MAP_SHARED,
+                                   fileno (self->handle), (off_t) map_offset);
+        if (map != MAP_FAILED) {
+            self->mapping = (mapping_t *) zmalloc (sizeof (mapping_t));
+            assert (self->mapping);
+            self->mapping->data = map;
+            self->mapping->size = map_size;
+            self->mapping->refs = 1;
+            self->data = map + self->file_offset - map_offset;
+            fclose (self->handle);
+            self->handle = NULL;
+        }
+    }
+#endif
+    if (self->handle && fseek (self->handle, (long) self->file_offset, SEEK_SET))
+        hydra_post_reader_destroy (&self);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Drop a reference to the mapping, and unmap it if that was the last one.
+//  Views may be destroyed in any thread, so we count atomically.
+
+#if !defined (__WINDOWS__)
+static void
+s_mapping_release (mapping_t *mapping)
+{
+    if (__sync_sub_and_fetch (&mapping->refs, 1) == 0) {
+        munmap (mapping->data, mapping->size);
+        free (mapping);
+    }
+}
+#endif
+
+#if defined (ZERO_COPY)
+static void
+s_view_release (void **hint_p)
+{
+    s_mapping_release ((mapping_t *) *hint_p);
+    *hint_p = NULL;
+}
+#endif
+
+
+//  --------------------------------------------------------------------------
+//  Destroy the reader. Views of its content stay valid.
+
+void
+hydra_post_reader_destroy (hydra_post_reader_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        hydra_post_reader_t *self = *self_p;
+#if !defined (__WINDOWS__)
+        if (self->mapping)
+            s_mapping_release (self->mapping);
+#endif
+        if (self->handle)
+            fclose (self->handle);
+        zchunk_destroy (&self->chunk);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the size of the content
+
+size_t
+hydra_post_reader_size (hydra_post_reader_t *self)
+{
+    assert (self);
+    return self->size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the offset in the content of the next window we'll read
+
+size_t
+hydra_post_reader_tell (hydra_post_reader_t *self)
+{
+    assert (self);
+    return self->offset;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Move to the specified offset in the content, so the next window starts
+//  there. Returns 0 if OK, -1 if the offset is past the end of the content.
+
+int
+hydra_post_reader_seek (hydra_post_reader_t *self, size_t offset)
+{
+    assert (self);
+    if (offset > self->size)
+        return -1;
+    if (self->handle
+    &&  fseek (self->handle, (long) (self->file_offset + offset), SEEK_SET))
+        return -1;
+    self->offset = offset;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Read the next window of content. Returns NULL at the end of the content,
+//  or if the content file could not be read.
+//  The caller must destroy the chunk when finished with it.
+
+zchunk_t *
+hydra_post_reader_read (hydra_post_reader_t *self)
+{
+    assert (self);
+    if (self->offset == self->size)
+        return NULL;
+    return hydra_post_reader_fetch (self, self->window_size, self->offset);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Read size bytes of content starting at the specified offset, and leave
+//  the reader after them. A size of 0 means the rest of the content. We
+//  never read past the end of the content, so at the end this returns an
+//  empty chunk. Returns NULL if the content file could not be read.
+//  The caller must destroy the chunk when finished with it.
+
+zchunk_t *
+hydra_post_reader_fetch (hydra_post_reader_t *self, size_t size, size_t offset)
+{
+    assert (self);
+    if (offset > self->size)
+        offset = self->size;
+    if (size == 0 || size > self->size - offset)
+        size = self->size - offset;
+    if (offset != self->offset && hydra_post_reader_seek (self, offset))
+        return NULL;
+
+    zchunk_t *chunk;
+    if (self->data)
+        chunk = zchunk_new (self->data + offset, size);
+    else {
+        chunk = zchunk_new (NULL, size);
+        if (fread (zchunk_data (chunk), 1, size, self->handle) != size)
+            zchunk_destroy (&chunk);
+    }
+    if (chunk)
+        self->offset += size;
+    return chunk;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return a view of size bytes of content starting at the specified offset,
+//  and leave the reader after them, as hydra_post_reader_fetch does. Where
+//  the content is mapped, the view points into the mapping rather than
+//  holding a copy; it stays valid after the reader is destroyed, and you
+//  must not modify it. Otherwise returns a copy.
+//  The caller must destroy the chunk when finished with it.
+
+zchunk_t *
+hydra_post_reader_view (hydra_post_reader_t *self, size_t size, size_t offset)
+{
+    assert (self);
+#if defined (ZERO_COPY)
+    if (self->mapping) {
+        if (offset > self->size)
+            offset = self->size;
+        if (size == 0 || size > self->size - offset)
+            size = self->size - offset;
+        __sync_add_and_fetch (&self->mapping->refs, 1);
+        self->offset = offset + size;
+        return zchunk_frommem ((void *) (self->data + offset), size,
+                               s_view_release, self->mapping);
+    }
+#endif
+    return hydra_post_reader_fetch (self, size, offset);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+hydra_post_reader_test (bool verbose)
+{
+    printf (" * hydra_post_reader: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zsys_dir_create (".hydra_test");
+    zsys_dir_change (".hydra_test");
+
+    //  Read content from a blob, a few bytes at a time
+    hydra_post_t *post = hydra_post_new ("Reader post");
+    hydra_post_set_content (post, "Hello, World");
+    hydra_post_reader_t *reader = hydra_post_reader_new (post, 5);
+    assert (reader);
+    assert (hydra_post_reader_size (reader) == 12);
+    zchunk_t *chunk = hydra_post_reader_read (reader);
+    assert (chunk && zchunk_size (chunk) == 5);
+    assert (memcmp (zchunk_data (chunk), "Hello", 5) == 0);
+    zchunk_destroy (&chunk);
+    hydra_post_reader_destroy (&reader);
+    assert (hydra_post_save_content (post) == 0);
+    reader = hydra_post_reader_new (post, 5);
+    assert (reader);
+    const char *windows [] = { "Hello", ", Wor", "ld" };
+    uint window_nbr;
+    for (window_nbr = 0; window_nbr < 3; window_nbr++) {
+        chunk = hydra_post_reader_read (reader);
+        assert (chunk);
+        assert (zchunk_size (chunk) == strlen (windows [window_nbr]));
+        assert (memcmp (zchunk_data (chunk), windows [window_nbr], zchunk_size (chunk)) == 0);
+        zchunk_destroy (&chunk);
+    }
+    assert (hydra_post_reader_tell (reader) == 12);
+    assert (hydra_post_reader_read (reader) == NULL);
+
+    //  Seek back into the content and read on from there
+    assert (hydra_post_reader_seek (reader, 7) == 0);
+    chunk = hydra_post_reader_read (reader);
+    assert (chunk && zchunk_size (chunk) == 5);
+    assert (memcmp (zchunk_data (chunk), "World", 5) == 0);
+    zchunk_destroy (&chunk);
+    assert (hydra_post_reader_seek (reader, 13) == -1);
+
+    //  Fetch any part of the content, whatever the window size
+    chunk = hydra_post_reader_fetch (reader, 0, 0);
+    assert (chunk && zchunk_size (chunk) == 12);
+    zchunk_destroy (&chunk);
+    chunk = hydra_post_reader_fetch (reader, 100, 10);
+    assert (chunk && zchunk_size (chunk) == 2);
+    assert (memcmp (zchunk_data (chunk), "ld", 2) == 0);
+    zchunk_destroy (&chunk);
+    assert (hydra_post_reader_tell (reader) == 12);
+    chunk = hydra_post_reader_fetch (reader, 5, 20);
+    assert (chunk && zchunk_size (chunk) == 0);
+    zchunk_destroy (&chunk);
+
+    //  A view outlives its reader
+    chunk = hydra_post_reader_view (reader, 5, 7);
+    assert (chunk && zchunk_size (chunk) == 5);
+    assert (hydra_post_reader_tell (reader) == 12);
+    zchunk_t *second = hydra_post_reader_view (reader, 0, 0);
+    assert (second && zchunk_size (second) == 12);
+    hydra_post_reader_destroy (&reader);
+    assert (memcmp (zchunk_data (chunk), "World", 5) == 0);
+    zchunk_destroy (&chunk);
+    assert (memcmp (zchunk_data (second), "Hello, World", 12) == 0);
+    zchunk_destroy (&second);
+    reader = hydra_post_reader_new (post, 5);
+    assert (reader);
+    hydra_post_reader_destroy (&reader);
+
+    //  Packed content is read from its offset in the pack, and no further
+    FILE *handle = fopen ("test.pack", "wb");
+    assert (handle);
+    fwrite ("....Hello, World....", 1, 20, handle);
+    fclose (handle);
+    hydra_post_set_pack (post, "test.pack", 4);
+    reader = hydra_post_reader_new (post, 0);
+    assert (reader);
+    chunk = hydra_post_reader_read (reader);
+    assert (chunk && zchunk_size (chunk) == 12);
+    assert (memcmp (zchunk_data (chunk), "Hello, World", 12) == 0);
+    zchunk_destroy (&chunk);
+    assert (hydra_post_reader_read (reader) == NULL);
+    hydra_post_reader_destroy (&reader);
+
+    //  A pack too short to hold the content gives no reader
+    hydra_post_set_pack (post, "test.pack", 10);
+    reader = hydra_post_reader_new (post, 0);
+    assert (reader == NULL);
+    hydra_post_destroy (&post);
+
+    //  Large content streams in full windows
+    size_t large_size = 1024 * 1024 + 100;
+    byte *large = (byte *) malloc (large_size);
+    size_t byte_nbr;
+    for (byte_nbr = 0; byte_nbr < large_size; byte_nbr++)
+        large [byte_nbr] = (byte) (byte_nbr * 7);
+    post = hydra_post_new ("Large post");
+    hydra_post_set_data (post, large, large_size);
+    assert (hydra_post_save_content (post) == 0);
+    reader = hydra_post_reader_new (post, 65536);
+    assert (reader);
+    size_t offset = 0;
+    while ((chunk = hydra_post_reader_read (reader))) {
+        assert (zchunk_size (chunk) <= 65536);
+        assert (memcmp (zchunk_data (chunk), large + offset, zchunk_size (chunk)) == 0);
+        offset += zchunk_size (chunk);
+        zchunk_destroy (&chunk);
+    }
+    assert (offset == large_size);
+    hydra_post_reader_destroy (&reader);
+    hydra_post_destroy (&post);
+    free (large);
+
+    //  Delete the test directory
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (".hydra_test", NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
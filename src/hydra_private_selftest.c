@@ -28,6 +28,14 @@
 void
 hydra_private_selftest (bool verbose)
 {
+// Tests for stable private classes:
+    hydra_util_test (verbose);
+    hydra_journal_test (verbose);
+    hydra_snapshot_test (verbose);
+    hydra_blobs_test (verbose);
+    hydra_pack_test (verbose);
+    hydra_words_test (verbose);
+    hydra_views_test (verbose);
 }
 /*
 ################################################################################
@@ -35,6 +35,7 @@ all_tests [] = {
     { "hydra_client", hydra_client_test },
     { "hydra_post", hydra_post_test },
     { "hydra_ledger", hydra_ledger_test },
+    { "hydra_post_reader", hydra_post_reader_test },
 #endif // HYDRA_BUILD_DRAFT_API
 #ifdef HYDRA_BUILD_DRAFT_API
     { "private_classes", hydra_private_selftest },
@@ -109,6 +110,7 @@ main (int argc, char **argv)
             puts ("    hydra_client\t\t- draft");
             puts ("    hydra_post\t\t- draft");
             puts ("    hydra_ledger\t\t- draft");
+            puts ("    hydra_post_reader\t\t- draft");
             puts ("    private_classes\t- draft");
             return 0;
         }
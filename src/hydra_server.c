@@ -31,6 +31,33 @@
 //  We should use chunking / credit based flow control for larger files
 #define CONTENT_MAX_SIZE    10 * 1024 * 1024
 
+//  Most posts we store from the sink in one batch, so that a busy sink does
+//  not stop us answering clients
+#define SINK_BATCH_MAX      256
+
+//  How often we look for old blobs to roll into pack files, in msecs, and
+//  the fewest blobs worth making a new pack for. Posts are old enough to
+//  pack after 30 days unless hydra.cfg says otherwise.
+#define PACK_INTERVAL       60 * 1000
+#define PACK_MIN_BLOBS      1000
+#define PACK_AGE            "2592000"
+
+//  How often we scrub the ledger for damaged posts, in msecs, and how many
+//  bytes a second we read doing it unless hydra.cfg says otherwise. Each
+//  step reads little, so scrubbing never holds up clients for long.
+#define SCRUB_INTERVAL      1000
+#define SCRUB_RATE          "1048576"
+
+//  How often we checkpoint the ledger index, in msecs, if at least so many
+//  posts arrived since the last checkpoint. After a crash, startup then
+//  replays at most one interval of journal, not everything since we started.
+#define CHECKPOINT_INTERVAL (5 * 60 * 1000)
+#define CHECKPOINT_MIN_POSTS 1000
+
+//  Most post contents we keep open for clients pulling chunks, unless
+//  hydra.cfg says otherwise. Each holds a file descriptor or a mapping.
+#define VIEWS_LIMIT         "64"
+
 //  ---------------------------------------------------------------------------
 //  Forward declarations for the two main classes we use here
 
@@ -45,6 +72,11 @@ struct _server_t {
     zconfig_t *config;          //  Current loaded configuration
     hydra_ledger_t *ledger;     //  Posts ledger
     zsock_t *sink;              //  Sink socket
+    zsock_t *lookup;            //  Ledger lookups from client actors
+    int64_t pack_age;           //  Pack blobs of posts this old, or 0
+    size_t scrub_rate;          //  Bytes a second we scrub, or 0
+    int64_t scrub_usecs;        //  Time spent scrubbing
+    hydra_views_t *views;       //  Post content open for chunk requests
 };
 
 //  ---------------------------------------------------------------------------
@@ -63,8 +95,16 @@ struct _client_t {
 
 static int
     s_server_handle_sink (zloop_t *loop, zsock_t *reader, void *argument);
+static int
+    s_server_handle_lookup (zloop_t *loop, zsock_t *reader, void *argument);
 static zmsg_t *
     s_server_store_post (server_t *self, zmsg_t *msg);
+static int
+    s_server_compact (zloop_t *loop, int timer_id, void *argument);
+static int
+    s_server_scrub (zloop_t *loop, int timer_id, void *argument);
+static int
+    s_server_checkpoint (zloop_t *loop, int timer_id, void *argument);
 
 //  Allocate properties and structures for a new server instance.
 //  Return 0 if OK, or -1 if there was an error.
@@ -90,11 +130,32 @@ server_initialize (server_t *self)
     self->sink = zsock_new (ZMQ_PULL);
     zsock_bind (self->sink, "inproc://%s", identity);
     engine_handle_socket (self, self->sink, s_server_handle_sink);
-    zconfig_destroy (&config);
-    
-     //  Load post ledger
+
+    //  Create and bind lookup socket; client actors ask us whether we
+    //  already hold a post, rather than each loading its own ledger
+    self->lookup = zsock_new (ZMQ_ROUTER);
+    zsock_bind (self->lookup, "inproc://%s-ledger", identity);
+    engine_handle_socket (self, self->lookup, s_server_handle_lookup);
+
+     //  Load post ledger, applying any retention limits from hydra.cfg
     self->ledger = hydra_ledger_new ();
+    hydra_ledger_set_retention (self->ledger,
+        atol (zconfig_resolve (config, "/hydra/retention/posts", "0")),
+        atol (zconfig_resolve (config, "/hydra/retention/bytes", "0")),
+        atol (zconfig_resolve (config, "/hydra/retention/age", "0")));
+    hydra_ledger_set_durable (self->ledger,
+        atoi (zconfig_resolve (config, "/hydra/durable", "0")) != 0);
+    self->pack_age = atol (zconfig_resolve (config, "/hydra/pack/age", PACK_AGE));
+    if (self->pack_age)
+        engine_set_monitor (self, PACK_INTERVAL, s_server_compact);
+    self->scrub_rate = atol (zconfig_resolve (config, "/hydra/scrub/rate", SCRUB_RATE));
+    if (self->scrub_rate)
+        engine_set_monitor (self, SCRUB_INTERVAL, s_server_scrub);
+    size_t views_limit = atol (zconfig_resolve (config, "/hydra/views/limit", VIEWS_LIMIT));
+    self->views = hydra_views_new (views_limit? views_limit: 1);
+    zconfig_destroy (&config);
     hydra_ledger_load (self->ledger);
+    engine_set_monitor (self, CHECKPOINT_INTERVAL, s_server_checkpoint);
     return 0;
 }
 
@@ -103,13 +164,20 @@ server_initialize (server_t *self)
 static void
 server_terminate (server_t *self)
 {
+    //  Save ledger index so next startup only replays new posts
+    hydra_ledger_checkpoint (self->ledger);
     hydra_ledger_destroy (&self->ledger);
+    hydra_views_destroy (&self->views);
     zsock_destroy (&self->sink);
+    zsock_destroy (&self->lookup);
 }
 
 //  Process server API method, return reply message if any
 //  SINK - create and bind sink PULL socket, return inproc endpoint
 //  POST - store post
+//  EXPORT - write all posts to archive file, return number of posts
+//  IMPORT - store all posts from archive file, return number of posts
+//  SCRUB - return scrubber progress and throughput
 
 static zmsg_t *
 server_method (server_t *self, const char *method, zmsg_t *msg)
@@ -123,10 +191,38 @@ server_method (server_t *self, const char *method, zmsg_t *msg)
     if (streq (method, "POST"))
         reply = s_server_store_post (self, msg);
     else
+    if (streq (method, "EXPORT")) {
+        char *filename = zmsg_popstr (msg);
+        reply = zmsg_new ();
+        zmsg_addstrf (reply, "%d", hydra_ledger_export (self->ledger, filename));
+        zstr_free (&filename);
+    }
+    else
+    if (streq (method, "IMPORT")) {
+        char *filename = zmsg_popstr (msg);
+        reply = zmsg_new ();
+        zmsg_addstrf (reply, "%d", hydra_ledger_import (self->ledger, filename));
+        zstr_free (&filename);
+    }
+    else
     if (streq (method, "NICKNAME")) {
         reply = zmsg_new ();
         zmsg_addstr (reply, zconfig_resolve (self->config, "/hydra/nickname", ""));
     }
+    else
+    if (streq (method, "SCRUB")) {
+        //  Throughput is over the time we spent scrubbing, not idle time
+        size_t bytes = hydra_ledger_scrub_bytes (self->ledger);
+        reply = zmsg_new ();
+        zmsg_addstrf (reply,
+            "posts=%zu bytes=%zu passes=%zu progress=%zu/%zu quarantined=%zu rate=%.0f",
+            hydra_ledger_scrub_posts (self->ledger), bytes,
+            hydra_ledger_scrub_passes (self->ledger),
+            hydra_ledger_scrub_cursor (self->ledger),
+            hydra_ledger_size (self->ledger),
+            hydra_ledger_quarantined (self->ledger),
+            self->scrub_usecs? bytes * 1000000.0 / self->scrub_usecs: 0.0);
+    }
     else {
         zsys_error ("unknown server method '%s' - failure", method);
         assert (false);
@@ -148,6 +244,7 @@ s_server_store_post (server_t *self, zmsg_t *msg)
     hydra_post_set_mime_type (post, mime_type);
     zstr_free (&mime_type);
 
+    int rc = 0;
     char *arg_type = zmsg_popstr (msg);
     if (streq (arg_type, "string")) {
         char *content = zmsg_popstr (msg);
@@ -156,8 +253,12 @@ s_server_store_post (server_t *self, zmsg_t *msg)
     }
     else
     if (streq (arg_type, "file")) {
+        //  Copy the file into the store, so the post survives the caller
+        //  changing or deleting it
         char *filename = zmsg_popstr (msg);
-        hydra_post_set_file (post, filename);
+        rc = hydra_post_import_file (post, filename);
+        if (rc)
+            zsys_error ("hydra_server: cannot import '%s'", filename);
         zstr_free (&filename);
     }
     else
@@ -173,20 +274,118 @@ s_server_store_post (server_t *self, zmsg_t *msg)
     zstr_free (&arg_type);
     zstr_free (&subject);
 
+    //  An empty post ID tells the caller we could not store the post
     zmsg_t *reply = zmsg_new ();
-    zmsg_addstr (reply, hydra_post_ident (post));
-    hydra_ledger_store (self->ledger, &post);
+    if (rc) {
+        zmsg_addstr (reply, "");
+        hydra_post_destroy (&post);
+    }
+    else {
+        zmsg_addstr (reply, hydra_post_ident (post));
+        hydra_ledger_store (self->ledger, &post);
+    }
     return reply;
 }
 
 static int
 s_server_handle_sink (zloop_t *loop, zsock_t *reader, void *argument)
 {
-    //  Message is a single post object passed by reference
+    //  Each message is a single post object passed by reference. We take
+    //  all posts waiting on the sink and write them to disk as one batch.
     server_t *self = (server_t *) argument;
-    hydra_post_t *post;
-    zsock_recv (reader, "p", &post);
-    hydra_ledger_store (self->ledger, &post);
+    int64_t start = zclock_usecs ();
+    size_t posts = 0;
+    hydra_ledger_begin (self->ledger);
+    do {
+        hydra_post_t *post;
+        if (zsock_recv (reader, "p", &post))
+            break;
+        hydra_ledger_store (self->ledger, &post);
+        posts++;
+    } while (posts < SINK_BATCH_MAX && (zsock_events (reader) & ZMQ_POLLIN));
+    if (hydra_ledger_commit (self->ledger))
+        zsys_error ("hydra_server: cannot write %zd posts to ledger", posts);
+    else
+    if (engine_verbose (self))
+        zsys_info ("hydra_server: stored %zd posts in %ld usecs",
+                   posts, (long) (zclock_usecs () - start));
+    return 0;
+}
+
+//  Roll the blobs of old posts into a pack file, a bit at a time, so that
+//  a long-lived node does not keep one file per post
+
+static int
+s_server_compact (zloop_t *loop, int timer_id, void *argument)
+{
+    server_t *self = (server_t *) argument;
+    int64_t start = zclock_usecs ();
+    int blobs = hydra_ledger_compact (self->ledger, self->pack_age, PACK_MIN_BLOBS);
+    if (blobs > 0 && engine_verbose (self))
+        zsys_info ("hydra_server: packed %d blobs in %ld usecs",
+                   blobs, (long) (zclock_usecs () - start));
+    return 0;
+}
+
+//  Scrub the ledger for damaged posts, a few at a time, and report each
+//  pass over the ledger
+
+static int
+s_server_scrub (zloop_t *loop, int timer_id, void *argument)
+{
+    server_t *self = (server_t *) argument;
+    size_t passes = hydra_ledger_scrub_passes (self->ledger);
+    int64_t start = zclock_usecs ();
+    hydra_ledger_scrub (self->ledger, self->scrub_rate * SCRUB_INTERVAL / 1000);
+    self->scrub_usecs += zclock_usecs () - start;
+    if (hydra_ledger_scrub_passes (self->ledger) > passes && engine_verbose (self))
+        zsys_info ("hydra_server: scrubbed %zu posts, %zu bytes in %ld usecs, %zu quarantined",
+                   hydra_ledger_scrub_posts (self->ledger),
+                   hydra_ledger_scrub_bytes (self->ledger),
+                   (long) self->scrub_usecs,
+                   hydra_ledger_quarantined (self->ledger));
+    return 0;
+}
+
+//  Save the ledger index if enough posts arrived since we last saved it, so
+//  a crash does not cost a long replay at the next start. We count posts
+//  stored, not the ledger size, which stops growing under retention limits.
+
+static int
+s_server_checkpoint (zloop_t *loop, int timer_id, void *argument)
+{
+    server_t *self = (server_t *) argument;
+    size_t unsaved = hydra_ledger_unsaved (self->ledger);
+    if (unsaved < CHECKPOINT_MIN_POSTS)
+        return 0;
+    int64_t start = zclock_usecs ();
+    if (hydra_ledger_checkpoint (self->ledger) == 0 && engine_verbose (self))
+        zsys_info ("hydra_server: saved index after %zu new posts in %ld usecs",
+                   unsaved, (long) (zclock_usecs () - start));
+    return 0;
+}
+
+static int
+s_server_handle_lookup (zloop_t *loop, zsock_t *reader, void *argument)
+{
+    //  Request is INDEX + post ID; we reply with the post ID and its index
+    //  in our ledger, -2 if we evicted it, or -1 if we never had it
+    server_t *self = (server_t *) argument;
+    zframe_t *routing_id;
+    char *command, *post_ident;
+    if (zsock_recv (reader, "fss", &routing_id, &command, &post_ident) == 0) {
+        if (streq (command, "INDEX")) {
+            int index = hydra_ledger_index (self->ledger, post_ident);
+            if (index == -1 && hydra_ledger_evicted (self->ledger, post_ident))
+                index = -2;
+            zsock_send (reader, "fsi", routing_id, post_ident, index);
+        }
+        else
+            zsys_error ("unknown ledger lookup '%s' - ignored", command);
+        zframe_destroy (&routing_id);
+        zstr_free (&command);
+        zstr_free (&post_ident);
+    }
     return 0;
 }
 
@@ -233,14 +432,13 @@ static void
 fetch_next_older_post (client_t *self)
 {
     hydra_post_destroy (&self->post);
-    if (streq (hydra_proto_ident (self->message), "HEAD"))
-        self->post = hydra_ledger_fetch (self->ledger, hydra_ledger_size (self->ledger) - 1);
-    else {
-        //  Fetch post before (older than) specified one
-        int index = hydra_ledger_index (self->ledger, hydra_proto_ident (self->message));
-        if (index > 0)
-            self->post = hydra_ledger_fetch (self->ledger, index - 1);
-    }
+    //  Fetch post before (older than) HEAD or the specified one, skipping
+    //  quarantined posts, which the ledger won't fetch
+    int index = streq (hydra_proto_ident (self->message), "HEAD")
+        ? (int) hydra_ledger_size (self->ledger)
+        : hydra_ledger_index (self->ledger, hydra_proto_ident (self->message));
+    while (!self->post && index-- > 0)
+        self->post = hydra_ledger_fetch (self->ledger, index);
     if (self->post)
         hydra_proto_set_ident (self->message, hydra_post_ident (self->post));
     else
@@ -256,14 +454,15 @@ static void
 fetch_next_newer_post (client_t *self)
 {
     hydra_post_destroy (&self->post);
-    if (streq (hydra_proto_ident (self->message), "TAIL"))
-        self->post = hydra_ledger_fetch (self->ledger, 0);
-    else {
-        //  Fetch post after (newer than) specified one
-        int index = hydra_ledger_index (self->ledger, hydra_proto_ident (self->message));
-        if (index >= 0)
-            self->post = hydra_ledger_fetch (self->ledger, index + 1);
-    }
+    //  Fetch post after (newer than) TAIL or the specified one, skipping
+    //  quarantined posts, which the ledger won't fetch
+    bool from_tail = streq (hydra_proto_ident (self->message), "TAIL");
+    int index = from_tail
+        ? -1
+        : hydra_ledger_index (self->ledger, hydra_proto_ident (self->message));
+    if (from_tail || index >= 0)
+        while (!self->post && ++index < (int) hydra_ledger_size (self->ledger))
+            self->post = hydra_ledger_fetch (self->ledger, index);
     if (self->post)
         hydra_proto_set_ident (self->message, hydra_post_ident (self->post));
     else
@@ -290,8 +489,23 @@ fetch_post_metadata (client_t *self)
 static void
 fetch_post_content_chunk (client_t *self)
 {
-    zchunk_t *chunk = hydra_post_fetch (self->post,
+    //  Read through the server's open views, so a client pulling a post in
+    //  chunks does not cost us an open and close per chunk
+    hydra_views_t *views = self->server->views;
+    zchunk_t *chunk = hydra_views_fetch (views, self->post,
         hydra_proto_octets (self->message), hydra_proto_offset (self->message));
+    if (!chunk) {
+        //  The content may have moved into a pack since we fetched the
+        //  post, so ask the ledger where it is now
+        int index = hydra_ledger_index (self->ledger, hydra_post_ident (self->post));
+        hydra_post_t *post = hydra_ledger_fetch (self->ledger, index);
+        if (post) {
+            hydra_post_destroy (&self->post);
+            self->post = post;
+            chunk = hydra_views_fetch (views, self->post,
+                hydra_proto_octets (self->message), hydra_proto_offset (self->message));
+        }
+    }
     hydra_proto_set_content (self->message, &chunk);
 }
 
@@ -335,8 +549,29 @@ hydra_server_test (bool verbose)
     hydra_proto_recv (message, client);
     assert (hydra_proto_id (message) == HYDRA_PROTO_HELLO_OK);
     hydra_proto_destroy (&message);
-    
     zsock_destroy (&client);
+
+    //  Client actors look up posts in the server ledger over inproc
+    zconfig_t *config = zconfig_load ("hydra.cfg");
+    assert (config);
+    zsock_t *lookup = zsock_new (ZMQ_DEALER);
+    assert (lookup);
+    zsock_set_rcvtimeo (lookup, 2000);
+    int rc = zsock_connect (lookup, "inproc://%s-ledger",
+                            zconfig_resolve (config, "/hydra/identity", NULL));
+    assert (rc == 0);
+    const char *unknown = "0000000000000000000000000000000000000000";
+    zsock_send (lookup, "ss", "INDEX", unknown);
+    char *post_ident;
+    int index;
+    rc = zsock_recv (lookup, "si", &post_ident, &index);
+    assert (rc == 0);
+    assert (streq (post_ident, unknown));
+    assert (index == -1);
+    zstr_free (&post_ident);
+    zsock_destroy (&lookup);
+    zconfig_destroy (&config);
+
     zactor_destroy (&server);
     //  @end
     printf ("OK\n");
@@ -0,0 +1,727 @@
+/*  =========================================================================
+    hydra_snapshot - memory-mapped snapshot of the ledger index
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    A snapshot holds the ledger index as it was at some point in the
+    journal: for each post, its ID, journal offset, content location,
+    content size, timestamp, parent post ID, MIME type, and content digest.
+    The ledger maps the snapshot into memory at startup and replays only
+    the journal records written after it, so startup time does not depend
+    on the size of the ledger.
+@discuss
+    The snapshot starts with the posts the ledger evicted, and the header
+    says how many there are. We keep their IDs so that the ledger refuses
+    them if peers offer them again.
+
+    The file is a 56-byte header, then one fixed-size record per post in
+    ledger order, then a table of record positions sorted by post ID, then
+    a string table holding the content locations and MIME types, each MIME
+    type held once, and last the ledger's Bloom filter. Numbers are in
+    network byte order. Post IDs are held as 20 binary bytes, and we look
+    them up by binary search over the sorted table, so we never have to
+    load the snapshot into the heap. The header also holds the total size
+    of the content the ledger holds, so that the ledger does not have to
+    add that up, nor rebuild its filter, when it loads.
+
+    Loading checks only the header and the file size, so that it takes the
+    same time however many posts the snapshot holds. Lookups check each
+    position and string offset as they use it, so a damaged snapshot can
+    give wrong answers, but never makes us read outside the file.
+
+    We create a snapshot by appending posts to an empty instance and then
+    saving it. Saving writes a temporary file and renames it, so readers
+    either see the old snapshot or the new one. Snapshots written before
+    we held all these fields have an older header, and we reject them; the
+    ledger then replays its journal and saves a new snapshot.
+@end
+*/
+
+#include "hydra_classes.h"
+#if !defined (__WINDOWS__)
+#   include <sys/mman.h>
+#endif
+
+#define SNAPSHOT_HEADER         "HYDRAX\x00\x05"
+#define SNAPSHOT_HEADER_SIZE    56
+#define RECORD_SIZE             96
+#define IDENT_SIZE              20      //  SHA1 digest, binary
+
+//  Record layout, per post
+#define RECORD_IDENT            0
+#define RECORD_LOCATION         20      //  String table offset + 1, or 0
+#define RECORD_OFFSET           24
+#define RECORD_CONTENT_SIZE     32
+#define RECORD_TIMESTAMP        40
+#define RECORD_PARENT           48      //  Parent ID, or zeros
+#define RECORD_MIME_TYPE        68      //  String table offset + 1, or 0
+#define RECORD_DIGEST           72      //  Content digest; then 4 spare
+
+//  Structure of our class
+
+struct _hydra_snapshot_t {
+    byte *data;                 //  Mapped or built file data
+    size_t data_size;           //  Size of data
+    bool mapped;                //  Data is mapped from disk
+    size_t size;                //  Number of posts in snapshot
+    int64_t journal_size;       //  Journal size when snapshot was made
+    size_t evicted;             //  Posts at start that the ledger evicted
+    uint64_t content_bytes;     //  Content size of posts not evicted
+    byte *filter;               //  Bloom filter, in network byte order
+    size_t filter_size;         //  Words in Bloom filter
+    byte *records;              //  Array of post records
+    byte *sorted;               //  Positions sorted by post ID
+    char *strings;              //  String table
+    size_t strings_size;        //  Size of string table
+    size_t max_size;            //  When building, records allocated
+    size_t strings_max;         //  When building, string table allocated
+    zhashx_t *mime_types;       //  When building, string table offset + 1
+                                //  of each MIME type we hold
+};
+
+
+//  Return the string in the string table at the offset + 1 held at the
+//  needle, or NULL if there is none
+
+static const char *
+s_string (hydra_snapshot_t *self, const byte *needle)
+{
+    uint32_t string_ref = hydra_util_get_number4 (needle);
+    if (string_ref == 0 || string_ref > self->strings_size)
+        return NULL;
+    return self->strings + string_ref - 1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new empty snapshot, to append posts to and then save.
+
+hydra_snapshot_t *
+hydra_snapshot_new (void)
+{
+    hydra_snapshot_t *self = (hydra_snapshot_t *) zmalloc (sizeof (hydra_snapshot_t));
+    if (self) {
+        self->max_size = 256;       //  Arbitrary, this is expanded on demand
+        self->records = (byte *) malloc (RECORD_SIZE * self->max_size);
+        self->strings_max = 4096;
+        self->strings = (char *) malloc (self->strings_max);
+        self->mime_types = zhashx_new ();
+    }
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Open the snapshot in the specified file, mapping it into memory. Returns
+//  NULL if the file does not exist or is not a valid snapshot.
+
+hydra_snapshot_t *
+hydra_snapshot_load (const char *filename)
+{
+    assert (filename);
+    FILE *handle = fopen (filename, "rb");
+    if (!handle)
+        return NULL;
+    fseek (handle, 0, SEEK_END);
+    long data_size = ftell (handle);
+    if (data_size < SNAPSHOT_HEADER_SIZE) {
+        fclose (handle);
+        return NULL;
+    }
+    hydra_snapshot_t *self = (hydra_snapshot_t *) zmalloc (sizeof (hydra_snapshot_t));
+    self->data_size = (size_t) data_size;
+#if defined (__WINDOWS__)
+    //  No mmap, so read whole file
+    self->data = (byte *) malloc (self->data_size);
+    fseek (handle, 0, SEEK_SET);
+    if (fread (self->data, 1, self->data_size, handle) != self->data_size) {
+        free (self->data);
+        self->data = NULL;
+    }
+#else
+    self->data = (byte *) mmap (NULL, self->data_size, PROT_READ, MAP_SHARED,
+                                fileno (handle), 0);
+    if (self->data == MAP_FAILED)
+        self->data = NULL;
+    else
+        self->mapped = true;
+#endif
+    fclose (handle);
+
+    //  Check header and that file size matches contents
+    if (self->data && memcmp (self->data, SNAPSHOT_HEADER, 8) == 0) {
+        self->size = (size_t) hydra_util_get_number8 (self->data + 8);
+        self->journal_size = (int64_t) hydra_util_get_number8 (self->data + 16);
+        self->strings_size = (size_t) hydra_util_get_number8 (self->data + 24);
+        self->evicted = (size_t) hydra_util_get_number8 (self->data + 32);
+        self->content_bytes = hydra_util_get_number8 (self->data + 40);
+        self->filter_size = (size_t) hydra_util_get_number8 (self->data + 48);
+        self->records = self->data + SNAPSHOT_HEADER_SIZE;
+        self->sorted = self->records + self->size * RECORD_SIZE;
+        self->strings = (char *) self->sorted + self->size * 4;
+        self->filter = (byte *) self->strings + self->strings_size;
+        if (self->size < UINT32_MAX
+        &&  self->evicted <= self->size
+        &&  self->strings_size < self->data_size
+        &&  self->filter_size < self->data_size / 8
+        &&  self->data_size == SNAPSHOT_HEADER_SIZE
+                             + self->size * (RECORD_SIZE + 4) + self->strings_size
+                             + self->filter_size * 8
+        &&  (self->strings_size == 0 || self->strings [self->strings_size - 1] == 0))
+            return self;
+    }
+    zsys_warning ("hydra_snapshot: %s is not a valid snapshot", filename);
+    hydra_snapshot_destroy (&self);
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy the snapshot
+
+void
+hydra_snapshot_destroy (hydra_snapshot_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        hydra_snapshot_t *self = *self_p;
+        if (self->data) {
+#if !defined (__WINDOWS__)
+            if (self->mapped)
+                munmap (self->data, self->data_size);
+            else
+#endif
+            free (self->data);
+        }
+        else {
+            //  Snapshot we were building
+            free (self->records);
+            free (self->strings);
+            free (self->filter);
+            zhashx_destroy (&self->mime_types);
+        }
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Copy a string into the string table of a snapshot we are building, and
+//  return its offset + 1
+
+static uint32_t
+s_string_store (hydra_snapshot_t *self, const char *string)
+{
+    size_t string_size = strlen (string) + 1;
+    while (self->strings_size + string_size > self->strings_max) {
+        self->strings_max *= 2;
+        self->strings = (char *) realloc (self->strings, self->strings_max);
+    }
+    memcpy (self->strings + self->strings_size, string, string_size);
+    self->strings_size += string_size;
+    return (uint32_t) (self->strings_size - string_size) + 1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Append a post to a snapshot we are building. The post ID, parent ID, and
+//  content digest are 20-byte binary SHA1 digests. The location, parent,
+//  and MIME type may be NULL.
+
+void
+hydra_snapshot_append (hydra_snapshot_t *self, const byte *ident,
+                       int64_t offset, const char *location,
+                       size_t content_size, int64_t timestamp,
+                       const byte *parent, const char *mime_type,
+                       const byte *digest)
+{
+    assert (self);
+    assert (!self->data);
+    assert (ident);
+    assert (digest);
+    if (self->size == self->max_size) {
+        self->max_size *= 2;
+        self->records = (byte *) realloc (self->records, RECORD_SIZE * self->max_size);
+    }
+    byte *record = self->records + self->size * RECORD_SIZE;
+    memcpy (record + RECORD_IDENT, ident, IDENT_SIZE);
+
+    //  Most posts share a few MIME types, so we store each of those once
+    uint32_t mime_type_ref = 0;
+    if (mime_type && *mime_type) {
+        mime_type_ref = (uint32_t) (size_t) zhashx_lookup (self->mime_types, mime_type);
+        if (!mime_type_ref) {
+            mime_type_ref = s_string_store (self, mime_type);
+            zhashx_insert (self->mime_types, mime_type, (void *) (size_t) mime_type_ref);
+        }
+    }
+    hydra_util_put_number4 (record + RECORD_LOCATION, location? s_string_store (self, location): 0);
+    hydra_util_put_number8 (record + RECORD_OFFSET, (uint64_t) offset);
+    hydra_util_put_number8 (record + RECORD_CONTENT_SIZE, (uint64_t) content_size);
+    hydra_util_put_number8 (record + RECORD_TIMESTAMP, (uint64_t) timestamp);
+    memset (record + RECORD_PARENT, 0, RECORD_SIZE - RECORD_PARENT);
+    if (parent)
+        memcpy (record + RECORD_PARENT, parent, IDENT_SIZE);
+    hydra_util_put_number4 (record + RECORD_MIME_TYPE, mime_type_ref);
+    memcpy (record + RECORD_DIGEST, digest, IDENT_SIZE);
+    self->size++;
+}
+
+
+//  Sort entry for building the sorted table
+typedef struct {
+    const byte *ident;
+    uint32_t position;
+} sort_entry_t;
+
+static int
+s_compare_entries (const void *item1, const void *item2)
+{
+    const sort_entry_t *entry1 = (const sort_entry_t *) item1;
+    const sort_entry_t *entry2 = (const sort_entry_t *) item2;
+    return memcmp (entry1->ident, entry2->ident, IDENT_SIZE);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Save a snapshot we have built to the specified file, recording the size
+//  of the journal it reflects. Writes a temporary file and then renames it.
+//  Returns 0 if OK, -1 if the file could not be written.
+
+int
+hydra_snapshot_save (hydra_snapshot_t *self, const char *filename, int64_t journal_size)
+{
+    assert (self);
+    assert (!self->data);
+    assert (filename);
+
+    byte header [SNAPSHOT_HEADER_SIZE];
+    memcpy (header, SNAPSHOT_HEADER, 8);
+    hydra_util_put_number8 (header + 8, self->size);
+    hydra_util_put_number8 (header + 16, (uint64_t) journal_size);
+    hydra_util_put_number8 (header + 24, self->strings_size);
+    hydra_util_put_number8 (header + 32, self->evicted);
+    hydra_util_put_number8 (header + 40, self->content_bytes);
+    hydra_util_put_number8 (header + 48, self->filter_size);
+
+    //  Sort positions by post ID
+    sort_entry_t *entries = (sort_entry_t *) malloc (sizeof (sort_entry_t) * (self->size + 1));
+    byte *sorted = (byte *) malloc (4 * (self->size + 1));
+    uint32_t position;
+    for (position = 0; position < self->size; position++) {
+        entries [position].ident = self->records + position * RECORD_SIZE + RECORD_IDENT;
+        entries [position].position = position;
+    }
+    qsort (entries, self->size, sizeof (sort_entry_t), s_compare_entries);
+    for (position = 0; position < self->size; position++)
+        hydra_util_put_number4 (sorted + position * 4, entries [position].position);
+    free (entries);
+
+    char *tempname = zsys_sprintf ("%s.tmp", filename);
+    FILE *handle = fopen (tempname, "wb");
+    int rc = handle? 0: -1;
+    if (handle) {
+        if (fwrite (header, 1, SNAPSHOT_HEADER_SIZE, handle) != SNAPSHOT_HEADER_SIZE
+        ||  fwrite (self->records, RECORD_SIZE, self->size, handle) != self->size
+        ||  fwrite (sorted, 4, self->size, handle) != self->size
+        ||  fwrite (self->strings, 1, self->strings_size, handle) != self->strings_size
+        ||  fwrite (self->filter, 8, self->filter_size, handle) != self->filter_size)
+            rc = -1;
+        if (hydra_util_file_close (handle, true))
+            rc = -1;
+    }
+    if (rc == 0)
+        rc = hydra_util_file_publish (tempname, filename);
+    if (rc) {
+        zsys_error ("hydra_snapshot: cannot write %s: %s", filename, strerror (errno));
+        zsys_file_delete (tempname);
+    }
+    zstr_free (&tempname);
+    free (sorted);
+    return rc? -1: 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return number of posts in the snapshot
+
+size_t
+hydra_snapshot_size (hydra_snapshot_t *self)
+{
+    assert (self);
+    return self->size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return size of the journal when the snapshot was saved; records after
+//  this point in the journal are not in the snapshot.
+
+int64_t
+hydra_snapshot_journal_size (hydra_snapshot_t *self)
+{
+    assert (self);
+    return self->journal_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set how many posts at the start of a snapshot we are building the ledger
+//  has evicted. Defaults to none.
+
+void
+hydra_snapshot_set_evicted (hydra_snapshot_t *self, size_t evicted)
+{
+    assert (self);
+    assert (!self->data);
+    self->evicted = evicted;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return how many posts at the start of the snapshot the ledger evicted
+
+size_t
+hydra_snapshot_evicted (hydra_snapshot_t *self)
+{
+    assert (self);
+    return self->evicted;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the total content size of the posts in a snapshot we are building,
+//  not counting those the ledger evicted.
+
+void
+hydra_snapshot_set_content_bytes (hydra_snapshot_t *self, uint64_t content_bytes)
+{
+    assert (self);
+    assert (!self->data);
+    self->content_bytes = content_bytes;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the total content size of the posts the ledger had not evicted
+
+uint64_t
+hydra_snapshot_content_bytes (hydra_snapshot_t *self)
+{
+    assert (self);
+    return self->content_bytes;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the Bloom filter of a snapshot we are building, as an array of the
+//  specified number of 64-bit words. We copy the filter.
+
+void
+hydra_snapshot_set_filter (hydra_snapshot_t *self, const uint64_t *filter, size_t size)
+{
+    assert (self);
+    assert (!self->data);
+    assert (filter || size == 0);
+    free (self->filter);
+    self->filter = (byte *) malloc (size * 8 + 1);
+    size_t word;
+    for (word = 0; word < size; word++)
+        hydra_util_put_number8 (self->filter + word * 8, filter [word]);
+    self->filter_size = size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of 64-bit words in the snapshot's Bloom filter, or 0
+//  if it has none
+
+size_t
+hydra_snapshot_filter_size (hydra_snapshot_t *self)
+{
+    assert (self);
+    return self->filter_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Copy the snapshot's Bloom filter into the specified array, which must
+//  hold hydra_snapshot_filter_size words.
+
+void
+hydra_snapshot_filter (hydra_snapshot_t *self, uint64_t *filter)
+{
+    assert (self);
+    assert (filter || self->filter_size == 0);
+    size_t word;
+    for (word = 0; word < self->filter_size; word++)
+        filter [word] = hydra_util_get_number8 (self->filter + word * 8);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Lookup post in snapshot by its 20-byte binary ID and return its position
+//  (0 .. size - 1); if the post does not exist, returns -1.
+
+int
+hydra_snapshot_find (hydra_snapshot_t *self, const byte *ident)
+{
+    assert (self);
+    assert (self->sorted);
+    size_t lower = 0;
+    size_t upper = self->size;
+    while (lower < upper) {
+        size_t middle = lower + (upper - lower) / 2;
+        uint32_t position = hydra_util_get_number4 (self->sorted + middle * 4);
+        if (position >= self->size)
+            return -1;          //  Damaged snapshot
+        int cmp = memcmp (ident, self->records + position * RECORD_SIZE + RECORD_IDENT,
+                          IDENT_SIZE);
+        if (cmp == 0)
+            return (int) position;
+        if (cmp < 0)
+            upper = middle;
+        else
+            lower = middle + 1;
+    }
+    return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return post ID at specified position, as a 20-byte binary SHA1 digest
+
+const byte *
+hydra_snapshot_ident (hydra_snapshot_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return self->records + position * RECORD_SIZE + RECORD_IDENT;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return journal offset of post at specified position
+
+int64_t
+hydra_snapshot_offset (hydra_snapshot_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return (int64_t) hydra_util_get_number8 (self->records + position * RECORD_SIZE + RECORD_OFFSET);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return content location of post at specified position, or NULL if the
+//  post has no location.
+
+const char *
+hydra_snapshot_location (hydra_snapshot_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return s_string (self, self->records + position * RECORD_SIZE + RECORD_LOCATION);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return content size of post at specified position
+
+size_t
+hydra_snapshot_content_size (hydra_snapshot_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return (size_t) hydra_util_get_number8 (self->records + position * RECORD_SIZE + RECORD_CONTENT_SIZE);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return timestamp of post at specified position, in seconds since the
+//  epoch.
+
+int64_t
+hydra_snapshot_timestamp (hydra_snapshot_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return (int64_t) hydra_util_get_number8 (self->records + position * RECORD_SIZE + RECORD_TIMESTAMP);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return parent ID of post at specified position, as a 20-byte binary SHA1
+//  digest, or NULL if the post has no parent.
+
+const byte *
+hydra_snapshot_parent (hydra_snapshot_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    const byte *parent = self->records + position * RECORD_SIZE + RECORD_PARENT;
+    size_t byte_nbr;
+    for (byte_nbr = 0; byte_nbr < IDENT_SIZE; byte_nbr++)
+        if (parent [byte_nbr])
+            return parent;
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return MIME type of post at specified position, or NULL if the post has
+//  no MIME type.
+
+const char *
+hydra_snapshot_mime_type (hydra_snapshot_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return s_string (self, self->records + position * RECORD_SIZE + RECORD_MIME_TYPE);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return content digest of post at specified position, as a 20-byte binary
+//  SHA1 digest.
+
+const byte *
+hydra_snapshot_digest (hydra_snapshot_t *self, size_t position)
+{
+    assert (self);
+    assert (position < self->size);
+    return self->records + position * RECORD_SIZE + RECORD_DIGEST;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+hydra_snapshot_test (bool verbose)
+{
+    printf (" * hydra_snapshot: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zsys_dir_create (".hydra_test");
+    zsys_dir_change (".hydra_test");
+
+    byte ident1 [IDENT_SIZE];
+    byte ident2 [IDENT_SIZE];
+    byte ident3 [IDENT_SIZE];
+    byte ident4 [IDENT_SIZE];
+    memset (ident1, 0x0F, IDENT_SIZE);
+    memset (ident2, 0x0A, IDENT_SIZE);
+    memset (ident3, 0x0F, IDENT_SIZE);
+    ident3 [IDENT_SIZE - 1] = 0x10;
+    memset (ident4, 0x0B, IDENT_SIZE);
+    hydra_snapshot_t *snapshot = hydra_snapshot_new ();
+    assert (snapshot);
+    hydra_snapshot_append (snapshot, ident1, 8, "posts/blobs/1", 100, 1420675200,
+                           NULL, "text/plain", ident3);
+    hydra_snapshot_append (snapshot, ident2, 200, NULL, 0, 1420675201,
+                           ident1, NULL, ident3);
+    hydra_snapshot_append (snapshot, ident4, 300, NULL, 0, 1420675202,
+                           NULL, "text/plain", ident3);
+    assert (hydra_snapshot_size (snapshot) == 3);
+    hydra_snapshot_set_evicted (snapshot, 1);
+    hydra_snapshot_set_content_bytes (snapshot, 100);
+    uint64_t filter [2] = { 0x0102030405060708ULL, 0xF0E0D0C0B0A09080ULL };
+    hydra_snapshot_set_filter (snapshot, filter, 2);
+    int rc = hydra_snapshot_save (snapshot, "snapshot", 400);
+    assert (rc == 0);
+    hydra_snapshot_destroy (&snapshot);
+
+    snapshot = hydra_snapshot_load ("snapshot");
+    assert (snapshot);
+    assert (hydra_snapshot_size (snapshot) == 3);
+    assert (hydra_snapshot_journal_size (snapshot) == 400);
+    assert (hydra_snapshot_evicted (snapshot) == 1);
+    assert (hydra_snapshot_content_bytes (snapshot) == 100);
+    assert (hydra_snapshot_filter_size (snapshot) == 2);
+    uint64_t loaded_filter [2];
+    hydra_snapshot_filter (snapshot, loaded_filter);
+    assert (memcmp (loaded_filter, filter, sizeof (filter)) == 0);
+    assert (hydra_snapshot_find (snapshot, ident1) == 0);
+    assert (hydra_snapshot_find (snapshot, ident2) == 1);
+    assert (hydra_snapshot_find (snapshot, ident3) == -1);
+    assert (memcmp (hydra_snapshot_ident (snapshot, 1), ident2, IDENT_SIZE) == 0);
+    assert (hydra_snapshot_offset (snapshot, 1) == 200);
+    assert (streq (hydra_snapshot_location (snapshot, 0), "posts/blobs/1"));
+    assert (hydra_snapshot_location (snapshot, 1) == NULL);
+    assert (hydra_snapshot_content_size (snapshot, 0) == 100);
+    assert (hydra_snapshot_timestamp (snapshot, 1) == 1420675201);
+    assert (hydra_snapshot_parent (snapshot, 0) == NULL);
+    assert (memcmp (hydra_snapshot_parent (snapshot, 1), ident1, IDENT_SIZE) == 0);
+    assert (streq (hydra_snapshot_mime_type (snapshot, 0), "text/plain"));
+    assert (hydra_snapshot_mime_type (snapshot, 1) == NULL);
+    //  Posts with the same MIME type share one string
+    assert (hydra_snapshot_mime_type (snapshot, 2) == hydra_snapshot_mime_type (snapshot, 0));
+    assert (memcmp (hydra_snapshot_digest (snapshot, 1), ident3, IDENT_SIZE) == 0);
+    hydra_snapshot_destroy (&snapshot);
+
+    //  A snapshot whose positions or string offsets point outside it still
+    //  loads, but lookups do not leave it; damage a sorted position, then a
+    //  MIME type, restoring each one after
+    long damage [] = {
+        SNAPSHOT_HEADER_SIZE + 3 * RECORD_SIZE,
+        SNAPSHOT_HEADER_SIZE + RECORD_MIME_TYPE
+    };
+    uint damage_nbr;
+    for (damage_nbr = 0; damage_nbr < 2; damage_nbr++) {
+        byte original [4];
+        FILE *handle = fopen ("snapshot", "r+b");
+        assert (handle);
+        fseek (handle, damage [damage_nbr], SEEK_SET);
+        assert (fread (original, 1, 4, handle) == 4);
+        fseek (handle, damage [damage_nbr], SEEK_SET);
+        fwrite ("\x00\x01\x00\x00", 1, 4, handle);
+        fclose (handle);
+        snapshot = hydra_snapshot_load ("snapshot");
+        assert (snapshot);
+        if (damage_nbr == 0)
+            assert (hydra_snapshot_find (snapshot, ident2) == -1);
+        else
+            assert (hydra_snapshot_mime_type (snapshot, 0) == NULL);
+        hydra_snapshot_destroy (&snapshot);
+        handle = fopen ("snapshot", "r+b");
+        assert (handle);
+        fseek (handle, damage [damage_nbr], SEEK_SET);
+        fwrite (original, 1, 4, handle);
+        fclose (handle);
+    }
+    snapshot = hydra_snapshot_load ("snapshot");
+    assert (snapshot);
+    hydra_snapshot_destroy (&snapshot);
+
+    //  A damaged snapshot is rejected
+    FILE *handle = fopen ("snapshot", "ab");
+    assert (handle);
+    fwrite ("x", 1, 1, handle);
+    fclose (handle);
+    snapshot = hydra_snapshot_load ("snapshot");
+    assert (snapshot == NULL);
+    assert (hydra_snapshot_load ("nosuchfile") == NULL);
+
+    //  Delete the test directory
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (".hydra_test", NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,144 @@
+/*  =========================================================================
+    hydra_snapshot - memory-mapped snapshot of the ledger index
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef HYDRA_SNAPSHOT_H_INCLUDED
+#define HYDRA_SNAPSHOT_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new empty snapshot, to append posts to and then save.
+HYDRA_PRIVATE hydra_snapshot_t *
+    hydra_snapshot_new (void);
+
+//  Open the snapshot in the specified file, mapping it into memory. Returns
+//  NULL if the file does not exist or is not a valid snapshot.
+HYDRA_PRIVATE hydra_snapshot_t *
+    hydra_snapshot_load (const char *filename);
+
+//  Destroy the snapshot
+HYDRA_PRIVATE void
+    hydra_snapshot_destroy (hydra_snapshot_t **self_p);
+
+//  Append a post to a snapshot we are building. The post ID, parent ID, and
+//  content digest are 20-byte binary SHA1 digests. The location, parent,
+//  and MIME type may be NULL.
+HYDRA_PRIVATE void
+    hydra_snapshot_append (hydra_snapshot_t *self, const byte *ident,
+                           int64_t offset, const char *location,
+                           size_t content_size, int64_t timestamp,
+                           const byte *parent, const char *mime_type,
+                           const byte *digest);
+
+//  Save a snapshot we have built to the specified file, recording the size
+//  of the journal it reflects. Writes a temporary file and then renames it.
+//  Returns 0 if OK, -1 if the file could not be written.
+HYDRA_PRIVATE int
+    hydra_snapshot_save (hydra_snapshot_t *self, const char *filename,
+                         int64_t journal_size);
+
+//  Return number of posts in the snapshot
+HYDRA_PRIVATE size_t
+    hydra_snapshot_size (hydra_snapshot_t *self);
+
+//  Return size of the journal when the snapshot was saved; records after
+//  this point in the journal are not in the snapshot.
+HYDRA_PRIVATE int64_t
+    hydra_snapshot_journal_size (hydra_snapshot_t *self);
+
+//  Set how many posts at the start of a snapshot we are building the ledger
+//  has evicted. Defaults to none.
+HYDRA_PRIVATE void
+    hydra_snapshot_set_evicted (hydra_snapshot_t *self, size_t evicted);
+
+//  Return how many posts at the start of the snapshot the ledger evicted
+HYDRA_PRIVATE size_t
+    hydra_snapshot_evicted (hydra_snapshot_t *self);
+
+//  Set the total content size of the posts in a snapshot we are building,
+//  not counting those the ledger evicted.
+HYDRA_PRIVATE void
+    hydra_snapshot_set_content_bytes (hydra_snapshot_t *self, uint64_t content_bytes);
+
+//  Return the total content size of the posts the ledger had not evicted
+HYDRA_PRIVATE uint64_t
+    hydra_snapshot_content_bytes (hydra_snapshot_t *self);
+
+//  Set the Bloom filter of a snapshot we are building, as an array of the
+//  specified number of 64-bit words. We copy the filter.
+HYDRA_PRIVATE void
+    hydra_snapshot_set_filter (hydra_snapshot_t *self, const uint64_t *filter, size_t size);
+
+//  Return the number of 64-bit words in the snapshot's Bloom filter, or 0
+//  if it has none
+HYDRA_PRIVATE size_t
+    hydra_snapshot_filter_size (hydra_snapshot_t *self);
+
+//  Copy the snapshot's Bloom filter into the specified array, which must
+//  hold hydra_snapshot_filter_size words.
+HYDRA_PRIVATE void
+    hydra_snapshot_filter (hydra_snapshot_t *self, uint64_t *filter);
+
+//  Lookup post in snapshot by its 20-byte binary ID and return its position
+//  (0 .. size - 1); if the post does not exist, returns -1.
+HYDRA_PRIVATE int
+    hydra_snapshot_find (hydra_snapshot_t *self, const byte *ident);
+
+//  Return post ID at specified position, as a 20-byte binary SHA1 digest
+HYDRA_PRIVATE const byte *
+    hydra_snapshot_ident (hydra_snapshot_t *self, size_t position);
+
+//  Return journal offset of post at specified position
+HYDRA_PRIVATE int64_t
+    hydra_snapshot_offset (hydra_snapshot_t *self, size_t position);
+
+//  Return content location of post at specified position, or NULL if the
+//  post has no location.
+HYDRA_PRIVATE const char *
+    hydra_snapshot_location (hydra_snapshot_t *self, size_t position);
+
+//  Return content size of post at specified position
+HYDRA_PRIVATE size_t
+    hydra_snapshot_content_size (hydra_snapshot_t *self, size_t position);
+
+//  Return timestamp of post at specified position, in seconds since the
+//  epoch.
+HYDRA_PRIVATE int64_t
+    hydra_snapshot_timestamp (hydra_snapshot_t *self, size_t position);
+
+//  Return parent ID of post at specified position, as a 20-byte binary SHA1
+//  digest, or NULL if the post has no parent.
+HYDRA_PRIVATE const byte *
+    hydra_snapshot_parent (hydra_snapshot_t *self, size_t position);
+
+//  Return MIME type of post at specified position, or NULL if the post has
+//  no MIME type.
+HYDRA_PRIVATE const char *
+    hydra_snapshot_mime_type (hydra_snapshot_t *self, size_t position);
+
+//  Return content digest of post at specified position, as a 20-byte binary
+//  SHA1 digest.
+HYDRA_PRIVATE const byte *
+    hydra_snapshot_digest (hydra_snapshot_t *self, size_t position);
+
+//  Self test of this class
+HYDRA_PRIVATE void
+    hydra_snapshot_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
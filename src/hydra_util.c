@@ -0,0 +1,240 @@
+/*  =========================================================================
+    hydra_util - number encoding and file helpers
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    Helpers that the journal, snapshot, pack, and word index files share:
+    encoding numbers, seeking in large files, and writing a file so it is
+    complete or absent.
+@discuss
+    All our file formats hold numbers in network byte order, so files move
+    between hosts.
+
+    An export archive holds the whole ledger, so can pass 2GB, and fseek
+    and ftell take a long, which is 32 bits on Windows and on 32-bit hosts.
+    We seek with 64-bit offsets instead, using fseeko, which needs
+    _FILE_OFFSET_BITS set to 64 on 32-bit POSIX hosts, or _fseeki64 on
+    Windows.
+
+    We write a file that must never be seen half-written under a temporary
+    name, close it, and rename it over the final name. A rename within a
+    directory is atomic, so readers see the old file or the new one. Files
+    we cannot rebuild are synced to disk before the rename.
+@end
+*/
+
+#include "hydra_classes.h"
+
+
+//  --------------------------------------------------------------------------
+//  Store a 32-bit number at the needle, in network byte order
+
+void
+hydra_util_put_number4 (byte *needle, uint32_t value)
+{
+    needle [0] = (byte) ((value >> 24) & 255);
+    needle [1] = (byte) ((value >> 16) & 255);
+    needle [2] = (byte) ((value >> 8)  & 255);
+    needle [3] = (byte) ((value)       & 255);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Store a 64-bit number at the needle, in network byte order
+
+void
+hydra_util_put_number8 (byte *needle, uint64_t value)
+{
+    hydra_util_put_number4 (needle, (uint32_t) (value >> 32));
+    hydra_util_put_number4 (needle + 4, (uint32_t) (value & 0xFFFFFFFF));
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the 32-bit number at the needle, in network byte order
+
+uint32_t
+hydra_util_get_number4 (const byte *needle)
+{
+    return ((uint32_t) (needle [0]) << 24)
+         + ((uint32_t) (needle [1]) << 16)
+         + ((uint32_t) (needle [2]) << 8)
+         +  (uint32_t) (needle [3]);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the 64-bit number at the needle, in network byte order
+
+uint64_t
+hydra_util_get_number8 (const byte *needle)
+{
+    return ((uint64_t) hydra_util_get_number4 (needle) << 32)
+         + hydra_util_get_number4 (needle + 4);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Move the file position to the offset, counted as fseek counts it, from
+//  whence. Works for offsets past 2GB. Returns 0 if OK, -1 if that failed.
+
+int
+hydra_util_file_seek (FILE *handle, int64_t offset, int whence)
+{
+    assert (handle);
+#if defined (__WINDOWS__)
+    return _fseeki64 (handle, offset, whence)? -1: 0;
+#else
+    return fseeko (handle, (off_t) offset, whence)? -1: 0;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the file position, which may be past 2GB, or -1 if that failed
+
+int64_t
+hydra_util_file_tell (FILE *handle)
+{
+    assert (handle);
+#if defined (__WINDOWS__)
+    return (int64_t) _ftelli64 (handle);
+#else
+    return (int64_t) ftello (handle);
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Flush and close a file we wrote, first waiting until the disk has it if
+//  sync is true. Returns 0 if OK, -1 if any step failed.
+
+int
+hydra_util_file_close (FILE *handle, bool sync)
+{
+    assert (handle);
+    int rc = fflush (handle);
+#if defined (__WINDOWS__)
+    if (rc == 0 && sync)
+        rc = _commit (_fileno (handle));
+#else
+    if (rc == 0 && sync)
+        rc = fsync (fileno (handle));
+#endif
+    if (fclose (handle))
+        rc = -1;
+    return rc? -1: 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Rename a file, replacing any file already at the new name. Returns 0 if
+//  OK, -1 if that failed, leaving errno set.
+
+int
+hydra_util_file_rename (const char *oldname, const char *newname)
+{
+#if defined (__WINDOWS__)
+    //  Windows won't rename over an existing file
+    remove (newname);
+#endif
+    return rename (oldname, newname)? -1: 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Move a fully written temporary file to its final name, replacing any
+//  file already there. Returns 0 if OK, -1 if that failed, in which case
+//  deletes the temporary file.
+
+int
+hydra_util_file_publish (const char *tempname, const char *filename)
+{
+    if (hydra_util_file_rename (tempname, filename)) {
+        int saved_errno = errno;
+        remove (tempname);
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+hydra_util_test (bool verbose)
+{
+    printf (" * hydra_util: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zsys_dir_create (".hydra_test");
+    zsys_dir_change (".hydra_test");
+
+    //  Numbers go out and come back in network byte order
+    byte buffer [8];
+    hydra_util_put_number4 (buffer, 0x01020304);
+    assert (buffer [0] == 1 && buffer [3] == 4);
+    assert (hydra_util_get_number4 (buffer) == 0x01020304);
+    hydra_util_put_number8 (buffer, 0x0102030405060708ULL);
+    assert (buffer [0] == 1 && buffer [7] == 8);
+    assert (hydra_util_get_number8 (buffer) == 0x0102030405060708ULL);
+
+    //  We can seek forwards and back, and find where we are
+    FILE *handle = fopen ("test.txt", "wb");
+    assert (handle);
+    fwrite ("0123456789", 1, 10, handle);
+    assert (hydra_util_file_seek (handle, 4, SEEK_SET) == 0);
+    assert (hydra_util_file_tell (handle) == 4);
+    assert (hydra_util_file_seek (handle, 3, SEEK_CUR) == 0);
+    assert (hydra_util_file_tell (handle) == 7);
+    assert (hydra_util_file_seek (handle, -1, SEEK_SET) == -1);
+    assert (hydra_util_file_close (handle, false) == 0);
+
+    //  Publishing a file replaces the old one
+    handle = fopen ("test.txt", "wb");
+    assert (handle);
+    fwrite ("old", 1, 3, handle);
+    assert (hydra_util_file_close (handle, false) == 0);
+    handle = fopen ("test.tmp", "wb");
+    assert (handle);
+    fwrite ("new", 1, 3, handle);
+    assert (hydra_util_file_close (handle, true) == 0);
+    assert (hydra_util_file_publish ("test.tmp", "test.txt") == 0);
+    assert (!zsys_file_exists ("test.tmp"));
+    handle = fopen ("test.txt", "rb");
+    assert (handle);
+    char text [4] = { 0 };
+    assert (fread (text, 1, 3, handle) == 3);
+    fclose (handle);
+    assert (streq (text, "new"));
+
+    //  A failed publish deletes the temporary file
+    handle = fopen ("test.tmp", "wb");
+    assert (handle);
+    assert (hydra_util_file_close (handle, false) == 0);
+    assert (hydra_util_file_publish ("test.tmp", "nosuchdir/test.txt") == -1);
+    assert (!zsys_file_exists ("test.tmp"));
+
+    //  Delete the test directory
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (".hydra_test", NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
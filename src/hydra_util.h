@@ -0,0 +1,71 @@
+/*  =========================================================================
+    hydra_util - number encoding and file helpers
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef HYDRA_UTIL_H_INCLUDED
+#define HYDRA_UTIL_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Store a 32-bit number at the needle, in network byte order
+HYDRA_PRIVATE void
+    hydra_util_put_number4 (byte *needle, uint32_t value);
+
+//  Store a 64-bit number at the needle, in network byte order
+HYDRA_PRIVATE void
+    hydra_util_put_number8 (byte *needle, uint64_t value);
+
+//  Return the 32-bit number at the needle, in network byte order
+HYDRA_PRIVATE uint32_t
+    hydra_util_get_number4 (const byte *needle);
+
+//  Return the 64-bit number at the needle, in network byte order
+HYDRA_PRIVATE uint64_t
+    hydra_util_get_number8 (const byte *needle);
+
+//  Move the file position to the offset, counted as fseek counts it, from
+//  whence. Works for offsets past 2GB. Returns 0 if OK, -1 if that failed.
+HYDRA_PRIVATE int
+    hydra_util_file_seek (FILE *handle, int64_t offset, int whence);
+
+//  Return the file position, which may be past 2GB, or -1 if that failed
+HYDRA_PRIVATE int64_t
+    hydra_util_file_tell (FILE *handle);
+
+//  Flush and close a file we wrote, first waiting until the disk has it if
+//  sync is true. Returns 0 if OK, -1 if any step failed.
+HYDRA_PRIVATE int
+    hydra_util_file_close (FILE *handle, bool sync);
+
+//  Rename a file, replacing any file already at the new name. Returns 0 if
+//  OK, -1 if that failed, leaving errno set.
+HYDRA_PRIVATE int
+    hydra_util_file_rename (const char *oldname, const char *newname);
+
+//  Move a fully written temporary file to its final name, replacing any
+//  file already there. Returns 0 if OK, -1 if that failed, in which case
+//  deletes the temporary file.
+HYDRA_PRIVATE int
+    hydra_util_file_publish (const char *tempname, const char *filename);
+
+//  Self test of this class
+HYDRA_PRIVATE void
+    hydra_util_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
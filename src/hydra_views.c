@@ -0,0 +1,269 @@
+/*  =========================================================================
+    hydra_views - cache of open post content, by digest
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    Keeps the content of recently served posts open, so that a client that
+    pulls a large post in chunks does not cost us an open and a close per
+    chunk. Each view is a post reader, which maps the content where it can
+    and otherwise holds the file open. We key views by content digest, so
+    posts with the same content share a view.
+@discuss
+    We keep at most a fixed number of views, and close the least recently
+    used one to make room for a new one. This bounds the file descriptors
+    and mappings we hold, however many posts clients are pulling.
+
+    A digest names the content and not the file, so a view stays good when
+    the ledger packs a blob or deletes it: the reader keeps the mapping or
+    the open file it started with. Blobs and packs never change once
+    written. Content files that belong to the application must not shrink
+    while we serve them, as reading a mapping past the end of its file
+    fails hard.
+@end
+*/
+
+#include "hydra_classes.h"
+
+//  One view of post content
+
+typedef struct {
+    char *digest;               //  Content digest
+    hydra_post_reader_t *reader;
+} view_t;
+
+//  Structure of our class
+
+struct _hydra_views_t {
+    zlistx_t *views;            //  Views, most recently used first
+    zhashx_t *index;            //  Maps digest to views list handle
+    size_t limit;               //  Most views we keep open
+    size_t hits;                //  Fetches served from an open view
+    size_t misses;              //  Fetches that had to open a view
+};
+
+static void
+s_view_destroy (void **item_p)
+{
+    view_t *view = (view_t *) *item_p;
+    if (view) {
+        hydra_post_reader_destroy (&view->reader);
+        free (view->digest);
+        free (view);
+        *item_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new view cache, holding at most limit views open
+
+hydra_views_t *
+hydra_views_new (size_t limit)
+{
+    assert (limit);
+    hydra_views_t *self = (hydra_views_t *) zmalloc (sizeof (hydra_views_t));
+    assert (self);
+    self->limit = limit;
+    self->views = zlistx_new ();
+    self->index = zhashx_new ();
+    if (!self->views || !self->index)
+        hydra_views_destroy (&self);
+    else
+        zlistx_set_destructor (self->views, s_view_destroy);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy the view cache, closing all views
+
+void
+hydra_views_destroy (hydra_views_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        hydra_views_t *self = *self_p;
+        zhashx_destroy (&self->index);
+        zlistx_destroy (&self->views);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Fetch a chunk of content for the post, as hydra_post_fetch does, through
+//  an open view of the content. Opens a view if we don't have one, closing
+//  the least recently used view if we are at the limit. Posts that hold
+//  their content in memory are fetched directly. The chunk may point into
+//  mapped content, as hydra_post_reader_view explains, so do not modify it.
+//  Returns NULL if the content could not be read. The caller must destroy
+//  the chunk when finished with it.
+
+zchunk_t *
+hydra_views_fetch (hydra_views_t *self, hydra_post_t *post, size_t size, size_t offset)
+{
+    assert (self);
+    assert (post);
+    if (!hydra_post_content_file (post))
+        return hydra_post_fetch (post, size, offset);
+
+    const char *digest = hydra_post_digest (post);
+    void *handle = zhashx_lookup (self->index, digest);
+    if (handle) {
+        zlistx_move_start (self->views, handle);
+        self->hits++;
+    }
+    else {
+        hydra_post_reader_t *reader = hydra_post_reader_new (post, 0);
+        if (!reader)
+            return NULL;
+        if (zlistx_size (self->views) == self->limit) {
+            zlistx_last (self->views);
+            void *last = zlistx_cursor (self->views);
+            view_t *view = (view_t *) zlistx_handle_item (last);
+            zhashx_delete (self->index, view->digest);
+            zlistx_delete (self->views, last);
+        }
+        view_t *view = (view_t *) zmalloc (sizeof (view_t));
+        assert (view);
+        view->digest = strdup (digest);
+        view->reader = reader;
+        handle = zlistx_add_start (self->views, view);
+        zhashx_insert (self->index, digest, handle);
+        self->misses++;
+    }
+    view_t *view = (view_t *) zlistx_handle_item (handle);
+    zchunk_t *chunk = hydra_post_reader_view (view->reader, size, offset);
+    if (!chunk) {
+        //  Don't keep a view we can't read
+        zhashx_delete (self->index, digest);
+        zlistx_delete (self->views, handle);
+    }
+    return chunk;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of views open
+
+size_t
+hydra_views_size (hydra_views_t *self)
+{
+    assert (self);
+    return zlistx_size (self->views);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of fetches served from an open view, and the number
+//  that had to open one
+
+void
+hydra_views_stats (hydra_views_t *self, size_t *hits, size_t *misses)
+{
+    assert (self);
+    if (hits)
+        *hits = self->hits;
+    if (misses)
+        *misses = self->misses;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+hydra_views_test (bool verbose)
+{
+    printf (" * hydra_views: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zsys_dir_create (".hydra_test");
+    zsys_dir_change (".hydra_test");
+
+    hydra_views_t *views = hydra_views_new (2);
+    assert (views);
+
+    //  Pulling a post in chunks opens its content once
+    hydra_post_t *post = hydra_post_new ("Chunked post");
+    hydra_post_set_content (post, "Hello, World");
+    assert (hydra_post_save_content (post) == 0);
+    zchunk_t *chunk = hydra_views_fetch (views, post, 5, 0);
+    assert (chunk && zchunk_size (chunk) == 5);
+    assert (memcmp (zchunk_data (chunk), "Hello", 5) == 0);
+    zchunk_destroy (&chunk);
+    chunk = hydra_views_fetch (views, post, 5, 5);
+    assert (chunk && memcmp (zchunk_data (chunk), ", Wor", 5) == 0);
+    zchunk_destroy (&chunk);
+    chunk = hydra_views_fetch (views, post, 5, 10);
+    assert (chunk && zchunk_size (chunk) == 2);
+    zchunk_destroy (&chunk);
+    size_t hits, misses;
+    hydra_views_stats (views, &hits, &misses);
+    assert (hits == 2 && misses == 1);
+    assert (hydra_views_size (views) == 1);
+
+    //  The view stays good after the blob goes
+    char *location = strdup (hydra_post_location (post));
+    zsys_file_delete (location);
+    chunk = hydra_views_fetch (views, post, 0, 0);
+    assert (chunk && zchunk_size (chunk) == 12);
+    zchunk_destroy (&chunk);
+
+    //  Opening more views than the limit closes the least recently used
+    hydra_post_t *second = hydra_post_new ("Second post");
+    hydra_post_set_content (second, "Second content");
+    assert (hydra_post_save_content (second) == 0);
+    hydra_post_t *third = hydra_post_new ("Third post");
+    hydra_post_set_content (third, "Third content");
+    assert (hydra_post_save_content (third) == 0);
+    chunk = hydra_views_fetch (views, second, 0, 0);
+    zchunk_destroy (&chunk);
+    chunk = hydra_views_fetch (views, third, 0, 0);
+    zchunk_destroy (&chunk);
+    assert (hydra_views_size (views) == 2);
+    chunk = hydra_views_fetch (views, post, 0, 0);
+    assert (chunk == NULL);
+    chunk = hydra_views_fetch (views, second, 0, 0);
+    assert (chunk && zchunk_size (chunk) == 14);
+    zchunk_destroy (&chunk);
+    hydra_views_stats (views, &hits, &misses);
+    assert (hits == 4 && misses == 3);
+
+    //  Content in memory is fetched directly
+    hydra_post_t *memory = hydra_post_new ("Memory post");
+    hydra_post_set_content (memory, "In memory");
+    chunk = hydra_views_fetch (views, memory, 0, 0);
+    assert (chunk && zchunk_size (chunk) == 9);
+    zchunk_destroy (&chunk);
+    assert (hydra_views_size (views) == 2);
+
+    free (location);
+    hydra_post_destroy (&post);
+    hydra_post_destroy (&second);
+    hydra_post_destroy (&third);
+    hydra_post_destroy (&memory);
+    hydra_views_destroy (&views);
+
+    //  Delete the test directory
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (".hydra_test", NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,57 @@
+/*  =========================================================================
+    hydra_views - cache of open post content, by digest
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef HYDRA_VIEWS_H_INCLUDED
+#define HYDRA_VIEWS_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new view cache, holding at most limit views open
+HYDRA_PRIVATE hydra_views_t *
+    hydra_views_new (size_t limit);
+
+//  Destroy the view cache, closing all views
+HYDRA_PRIVATE void
+    hydra_views_destroy (hydra_views_t **self_p);
+
+//  Fetch a chunk of content for the post, as hydra_post_fetch does, through
+//  an open view of the content. Opens a view if we don't have one, closing
+//  the least recently used view if we are at the limit. Posts that hold
+//  their content in memory are fetched directly. The chunk may point into
+//  mapped content, as hydra_post_reader_view explains, so do not modify it.
+//  Returns NULL if the content could not be read. The caller must destroy
+//  the chunk when finished with it.
+HYDRA_PRIVATE zchunk_t *
+    hydra_views_fetch (hydra_views_t *self, hydra_post_t *post, size_t size, size_t offset);
+
+//  Return the number of views open
+HYDRA_PRIVATE size_t
+    hydra_views_size (hydra_views_t *self);
+
+//  Return the number of fetches served from an open view, and the number
+//  that had to open one
+HYDRA_PRIVATE void
+    hydra_views_stats (hydra_views_t *self, size_t *hits, size_t *misses);
+
+//  Self test of this class
+HYDRA_PRIVATE void
+    hydra_views_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
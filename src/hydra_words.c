@@ -0,0 +1,576 @@
+/*  =========================================================================
+    hydra_words - full-text index of post words
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The word index lets us search posts by the words in their subject and
+    text, without reading the posts. It maps each word to the posts that
+    hold it, each with a weight that counts how often the post uses it.
+@discuss
+    A word is a run of letters and digits, in lower case. Bytes over 127
+    count as letters, so words in UTF-8 survive whole, though we only fold
+    the case of ASCII letters. We skip single letters and cut words at 32
+    bytes. A word in the subject weighs four times a word in the text.
+
+    Posts are identified by a 64-bit key, which the ledger sets to the
+    post's journal offset, as that does not change when older posts are
+    evicted. Keys only go up, so each word's list of posts is sorted by
+    key, and we find the posts that hold every word in a query by walking
+    the shortest list and binary searching the others. We rank the posts
+    we find by their weights, where rarer words count for more, and give
+    newer posts first when they rank the same.
+
+    The file is a 32-byte header, then each word with its list of posts.
+    We load the whole index into the heap, add posts to it in memory, and
+    save it from time to time. The index can be rebuilt from the posts, so
+    we do not sync it to disk, and we reject a damaged file.
+@end
+*/
+
+#include "hydra_classes.h"
+
+#define WORDS_HEADER        "HYDRAW\x00\x01"
+#define WORDS_HEADER_SIZE   32
+#define WORD_MIN            2       //  Shorter words are not indexed
+#define WORD_MAX            32      //  Longer words are cut to this size
+#define SUBJECT_WEIGHT      4       //  Weight of a word in the subject
+#define QUERY_WORDS         16      //  Most words of a query we match
+#define POSTING_SIZE        12      //  Key and weight, on disk
+
+//  A post holding a word, with the weight of the word in the post
+
+typedef struct {
+    uint64_t key;               //  Post key
+    uint32_t weight;            //  Weight of word in post
+} posting_t;
+
+//  The posts holding a word, sorted by key
+
+typedef struct {
+    posting_t *postings;        //  Posts holding word
+    size_t size;                //  Number of posts
+    size_t max_size;            //  Postings allocated
+} word_t;
+
+//  A post found by a search
+
+typedef struct {
+    uint64_t key;               //  Post key
+    uint64_t score;             //  Sum of weights of query words
+} match_t;
+
+//  Structure of our class
+
+struct _hydra_words_t {
+    zhashx_t *words;            //  Posts holding each word, by word
+    uint64_t cursor;            //  Key after last post added
+};
+
+
+static void
+s_word_destroy (void **item_p)
+{
+    word_t *word = (word_t *) *item_p;
+    if (word) {
+        free (word->postings);
+        free (word);
+        *item_p = NULL;
+    }
+}
+
+static word_t *
+s_word_new (size_t max_size)
+{
+    word_t *word = (word_t *) zmalloc (sizeof (word_t));
+    word->max_size = max_size? max_size: 4;
+    word->postings = (posting_t *) malloc (sizeof (posting_t) * word->max_size);
+    return word;
+}
+
+//  Return the position of the first post in the word's list, from the
+//  specified position on, whose key is at or above the specified key
+
+static size_t
+s_word_seek (word_t *word, size_t from, uint64_t key)
+{
+    size_t low = from;
+    size_t high = word->size;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (word->postings [middle].key < key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Split text into words, and add the specified weight to the total for
+//  each word in the weights table, once per use.
+
+static void
+s_split_words (zhashx_t *weights, const char *text, size_t size, size_t weight)
+{
+    char word [WORD_MAX + 1];
+    size_t word_size = 0;
+    size_t index;
+    for (index = 0; index <= size; index++) {
+        byte next = index < size? (byte) text [index]: 0;
+        if (next > 127 || isalnum (next)) {
+            if (word_size < WORD_MAX)
+                word [word_size++] = (char) tolower (next);
+        }
+        else
+        if (word_size) {
+            if (word_size >= WORD_MIN) {
+                word [word_size] = 0;
+                size_t total = (size_t) zhashx_lookup (weights, word);
+                zhashx_update (weights, word, (void *) (total + weight));
+            }
+            word_size = 0;
+        }
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new empty word index
+
+hydra_words_t *
+hydra_words_new (void)
+{
+    hydra_words_t *self = (hydra_words_t *) zmalloc (sizeof (hydra_words_t));
+    if (self)
+        self->words = zhashx_new ();
+    if (self && self->words)
+        zhashx_set_destructor (self->words, s_word_destroy);
+    else
+        hydra_words_destroy (&self);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Load a word index from the specified file. Returns NULL if the file does
+//  not exist or is not a valid word index.
+
+hydra_words_t *
+hydra_words_load (const char *filename)
+{
+    assert (filename);
+    FILE *handle = fopen (filename, "rb");
+    if (!handle)
+        return NULL;
+    fseek (handle, 0, SEEK_END);
+    long data_size = ftell (handle);
+    fseek (handle, 0, SEEK_SET);
+    byte *data = data_size >= WORDS_HEADER_SIZE? (byte *) malloc (data_size): NULL;
+    if (data && fread (data, 1, data_size, handle) != (size_t) data_size) {
+        free (data);
+        data = NULL;
+    }
+    fclose (handle);
+
+    hydra_words_t *self = hydra_words_new ();
+    bool valid = data && memcmp (data, WORDS_HEADER, 8) == 0;
+    if (valid) {
+        self->cursor = hydra_util_get_number8 (data + 8);
+        uint64_t words = hydra_util_get_number8 (data + 16);
+        const byte *needle = data + WORDS_HEADER_SIZE;
+        const byte *ceiling = data + data_size;
+        while (valid && words--) {
+            //  Word size, word, number of posts, then the posts
+            size_t word_size = needle < ceiling? *needle++: 0;
+            if (word_size < WORD_MIN || word_size > WORD_MAX
+            ||  ceiling - needle < (long) word_size + 4) {
+                valid = false;
+                break;
+            }
+            char text [WORD_MAX + 1];
+            memcpy (text, needle, word_size);
+            text [word_size] = 0;
+            size_t size = hydra_util_get_number4 (needle + word_size);
+            needle += word_size + 4;
+            if (size == 0 || (size_t) (ceiling - needle) / POSTING_SIZE < size
+            ||  zhashx_lookup (self->words, text)) {
+                valid = false;
+                break;
+            }
+            word_t *word = s_word_new (size);
+            for (word->size = 0; word->size < size; word->size++) {
+                posting_t *posting = &word->postings [word->size];
+                posting->key = hydra_util_get_number8 (needle);
+                posting->weight = hydra_util_get_number4 (needle + 8);
+                needle += POSTING_SIZE;
+                if (posting->key >= self->cursor
+                || (word->size && posting->key <= posting [-1].key))
+                    valid = false;
+            }
+            zhashx_insert (self->words, text, word);
+        }
+        if (needle != ceiling)
+            valid = false;
+    }
+    free (data);
+    if (!valid) {
+        zsys_warning ("hydra_words: %s is not a valid word index", filename);
+        hydra_words_destroy (&self);
+    }
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy the word index
+
+void
+hydra_words_destroy (hydra_words_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        hydra_words_t *self = *self_p;
+        zhashx_destroy (&self->words);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add the words of a post to the index. The key identifies the post, and
+//  must be higher than the key of any post already added. The text may be
+//  NULL; it need not end in a null byte. Words in the subject count for
+//  more than words in the text.
+
+void
+hydra_words_add (hydra_words_t *self, uint64_t key, const char *subject,
+                 const char *text, size_t text_size)
+{
+    assert (self);
+    assert (subject);
+    assert (key >= self->cursor);
+
+    zhashx_t *weights = zhashx_new ();
+    s_split_words (weights, subject, strlen (subject), SUBJECT_WEIGHT);
+    if (text)
+        s_split_words (weights, text, text_size, 1);
+    size_t weight = (size_t) zhashx_first (weights);
+    while (weight) {
+        const char *name = (const char *) zhashx_cursor (weights);
+        word_t *word = (word_t *) zhashx_lookup (self->words, name);
+        if (!word) {
+            word = s_word_new (0);
+            zhashx_insert (self->words, name, word);
+        }
+        if (word->size == word->max_size) {
+            word->max_size *= 2;
+            word->postings = (posting_t *) realloc (word->postings,
+                sizeof (posting_t) * word->max_size);
+        }
+        posting_t *posting = &word->postings [word->size++];
+        posting->key = key;
+        posting->weight = weight < UINT32_MAX? (uint32_t) weight: UINT32_MAX;
+        weight = (size_t) zhashx_next (weights);
+    }
+    zhashx_destroy (&weights);
+    self->cursor = key + 1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the key after the key of the last post added, or 0 if the index
+//  is empty; a post with this key or higher is not in the index.
+
+uint64_t
+hydra_words_cursor (hydra_words_t *self)
+{
+    assert (self);
+    return self->cursor;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of distinct words in the index
+
+size_t
+hydra_words_size (hydra_words_t *self)
+{
+    assert (self);
+    return zhashx_size (self->words);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Compare two posts found by a search, so that the best match comes first,
+//  and the newest post of those that rank the same
+
+static int
+s_compare_matches (const void *item1, const void *item2)
+{
+    const match_t *match1 = (const match_t *) item1;
+    const match_t *match2 = (const match_t *) item2;
+    if (match1->score != match2->score)
+        return match1->score > match2->score? -1: 1;
+    if (match1->key != match2->key)
+        return match1->key > match2->key? -1: 1;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Find the posts that hold every word in the query, leaving out posts with
+//  keys below the horizon. Posts in total is the number of posts we search,
+//  which we use to weigh rare words above common ones. Skips the first
+//  offset posts found, best match first, and stores the keys of at most
+//  limit posts after that into the keys array. Returns the number of keys
+//  stored.
+
+size_t
+hydra_words_search (hydra_words_t *self, const char *query, uint64_t horizon,
+                    size_t posts, size_t offset, uint64_t *keys, size_t limit)
+{
+    assert (self);
+    assert (query);
+    assert (keys || limit == 0);
+
+    //  Look up each word of the query; if any is missing, no post matches
+    word_t *words [QUERY_WORDS];
+    size_t rarity [QUERY_WORDS];
+    size_t nbr_words = 0;
+    zhashx_t *weights = zhashx_new ();
+    s_split_words (weights, query, strlen (query), 1);
+    void *item = zhashx_first (weights);
+    while (item && nbr_words < QUERY_WORDS) {
+        words [nbr_words] = (word_t *) zhashx_lookup (self->words, zhashx_cursor (weights));
+        if (!words [nbr_words]) {
+            nbr_words = 0;
+            break;
+        }
+        nbr_words++;
+        item = zhashx_next (weights);
+    }
+    zhashx_destroy (&weights);
+    if (nbr_words == 0)
+        return 0;
+
+    //  Walk the shortest list first. A word counts for one, plus one for
+    //  each time its posts halve in number compared to all posts.
+    size_t index;
+    for (index = 0; index < nbr_words; index++) {
+        size_t slot = index;
+        while (slot && words [slot - 1]->size > words [slot]->size) {
+            word_t *word = words [slot];
+            words [slot] = words [slot - 1];
+            words [--slot] = word;
+        }
+    }
+    for (index = 0; index < nbr_words; index++) {
+        size_t ratio = posts / words [index]->size;
+        for (rarity [index] = 1; ratio > 1; ratio >>= 1)
+            rarity [index]++;
+    }
+    size_t cursors [QUERY_WORDS];
+    for (index = 0; index < nbr_words; index++)
+        cursors [index] = s_word_seek (words [index], 0, horizon);
+
+    size_t matches_max = 256;
+    match_t *matches = (match_t *) malloc (sizeof (match_t) * matches_max);
+    size_t nbr_matches = 0;
+    for (; cursors [0] < words [0]->size; cursors [0]++) {
+        posting_t *posting = &words [0]->postings [cursors [0]];
+        uint64_t score = (uint64_t) posting->weight * rarity [0];
+        for (index = 1; index < nbr_words; index++) {
+            word_t *word = words [index];
+            cursors [index] = s_word_seek (word, cursors [index], posting->key);
+            if (cursors [index] == word->size
+            ||  word->postings [cursors [index]].key != posting->key)
+                break;
+            score += (uint64_t) word->postings [cursors [index]].weight * rarity [index];
+        }
+        if (index < nbr_words)
+            continue;           //  Post does not hold every word
+        if (nbr_matches == matches_max) {
+            matches_max *= 2;
+            matches = (match_t *) realloc (matches, sizeof (match_t) * matches_max);
+        }
+        matches [nbr_matches].key = posting->key;
+        matches [nbr_matches].score = score;
+        nbr_matches++;
+    }
+    qsort (matches, nbr_matches, sizeof (match_t), s_compare_matches);
+    size_t count = 0;
+    for (index = offset; index < nbr_matches && count < limit; index++)
+        keys [count++] = matches [index].key;
+    free (matches);
+    return count;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Drop the posts with keys below the horizon, and save the index to the
+//  specified file. Writes a temporary file and then renames it. Returns 0
+//  if OK, -1 if the file could not be written.
+
+int
+hydra_words_save (hydra_words_t *self, const char *filename, uint64_t horizon)
+{
+    assert (self);
+    assert (filename);
+
+    //  Drop old posts first, and words that no post holds any longer
+    zlist_t *unused = zlist_new ();
+    word_t *word = (word_t *) zhashx_first (self->words);
+    while (word) {
+        size_t dropped = s_word_seek (word, 0, horizon);
+        memmove (word->postings, word->postings + dropped,
+                 sizeof (posting_t) * (word->size - dropped));
+        word->size -= dropped;
+        if (word->size == 0)
+            zlist_append (unused, (void *) zhashx_cursor (self->words));
+        word = (word_t *) zhashx_next (self->words);
+    }
+    const char *text = (const char *) zlist_first (unused);
+    while (text) {
+        zhashx_delete (self->words, text);
+        text = (const char *) zlist_next (unused);
+    }
+    zlist_destroy (&unused);
+
+    byte header [WORDS_HEADER_SIZE] = { 0 };
+    memcpy (header, WORDS_HEADER, 8);
+    hydra_util_put_number8 (header + 8, self->cursor);
+    hydra_util_put_number8 (header + 16, zhashx_size (self->words));
+
+    char *tempname = zsys_sprintf ("%s.tmp", filename);
+    FILE *handle = fopen (tempname, "wb");
+    int rc = handle? 0: -1;
+    if (handle && fwrite (header, 1, WORDS_HEADER_SIZE, handle) != WORDS_HEADER_SIZE)
+        rc = -1;
+    byte *buffer = NULL;
+    size_t buffer_max = 0;
+    word = (word_t *) zhashx_first (self->words);
+    while (rc == 0 && word) {
+        text = (const char *) zhashx_cursor (self->words);
+        size_t word_size = strlen (text);
+        size_t record_size = 1 + word_size + 4 + word->size * POSTING_SIZE;
+        if (record_size > buffer_max) {
+            buffer_max = record_size * 2;
+            buffer = (byte *) realloc (buffer, buffer_max);
+        }
+        byte *needle = buffer;
+        *needle++ = (byte) word_size;
+        memcpy (needle, text, word_size);
+        needle += word_size;
+        hydra_util_put_number4 (needle, (uint32_t) word->size);
+        needle += 4;
+        size_t index;
+        for (index = 0; index < word->size; index++) {
+            hydra_util_put_number8 (needle, word->postings [index].key);
+            hydra_util_put_number4 (needle + 8, word->postings [index].weight);
+            needle += POSTING_SIZE;
+        }
+        if (fwrite (buffer, 1, record_size, handle) != record_size)
+            rc = -1;
+        word = (word_t *) zhashx_next (self->words);
+    }
+    free (buffer);
+    if (handle && hydra_util_file_close (handle, false))
+        rc = -1;
+    if (rc == 0)
+        rc = hydra_util_file_publish (tempname, filename);
+    if (rc) {
+        zsys_error ("hydra_words: cannot write %s: %s", filename, strerror (errno));
+        zsys_file_delete (tempname);
+    }
+    zstr_free (&tempname);
+    return rc? -1: 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+hydra_words_test (bool verbose)
+{
+    printf (" * hydra_words: ");
+    if (verbose)
+        printf ("\n");
+
+    //  @selftest
+    zsys_dir_create (".hydra_test");
+    zsys_dir_change (".hydra_test");
+
+    hydra_words_t *words = hydra_words_new ();
+    assert (words);
+    assert (hydra_words_cursor (words) == 0);
+    hydra_words_add (words, 10, "Hello World", "hello again, HELLO!", 19);
+    hydra_words_add (words, 20, "Other", "world peace", 11);
+    hydra_words_add (words, 30, "Hello", NULL, 0);
+    hydra_words_add (words, 40, "Caf\xc3\xa9 a la carte", "x", 1);
+    assert (hydra_words_cursor (words) == 41);
+    //  hello world again other peace café la carte
+    assert (hydra_words_size (words) == 8);
+
+    uint64_t keys [10];
+    assert (hydra_words_search (words, "hello", 0, 4, 0, keys, 10) == 2);
+    assert (keys [0] == 10 && keys [1] == 30);
+    assert (hydra_words_search (words, "HELLO, world", 0, 4, 0, keys, 10) == 1);
+    assert (keys [0] == 10);
+    //  A word in the subject ranks above a word in the text
+    assert (hydra_words_search (words, "world", 0, 4, 0, keys, 10) == 2);
+    assert (keys [0] == 10 && keys [1] == 20);
+    assert (hydra_words_search (words, "caf\xc3\xa9", 0, 4, 0, keys, 10) == 1);
+    assert (keys [0] == 40);
+    assert (hydra_words_search (words, "hello", 0, 4, 1, keys, 1) == 1);
+    assert (keys [0] == 30);
+    assert (hydra_words_search (words, "hello", 15, 4, 0, keys, 10) == 1);
+    assert (keys [0] == 30);
+    assert (hydra_words_search (words, "hello missing", 0, 4, 0, keys, 10) == 0);
+    assert (hydra_words_search (words, "a", 0, 4, 0, keys, 10) == 0);
+    assert (hydra_words_search (words, "", 0, 4, 0, keys, 10) == 0);
+
+    //  Saving drops posts below the horizon, and their words
+    assert (hydra_words_save (words, "words", 15) == 0);
+    hydra_words_destroy (&words);
+    words = hydra_words_load ("words");
+    assert (words);
+    assert (hydra_words_cursor (words) == 41);
+    assert (hydra_words_size (words) == 7);
+    assert (hydra_words_search (words, "again", 0, 3, 0, keys, 10) == 0);
+    assert (hydra_words_search (words, "hello", 0, 3, 0, keys, 10) == 1);
+    assert (keys [0] == 30);
+    hydra_words_add (words, 50, "Hello again", NULL, 0);
+    assert (hydra_words_search (words, "hello", 0, 4, 0, keys, 10) == 2);
+    assert (keys [0] == 50 && keys [1] == 30);
+    hydra_words_destroy (&words);
+
+    //  A damaged index is rejected
+    FILE *handle = fopen ("words", "ab");
+    assert (handle);
+    fwrite ("x", 1, 1, handle);
+    fclose (handle);
+    assert (hydra_words_load ("words") == NULL);
+    assert (hydra_words_load ("nosuchfile") == NULL);
+
+    //  Delete the test directory
+    zsys_dir_change ("..");
+    zdir_t *dir = zdir_new (".hydra_test", NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,76 @@
+/*  =========================================================================
+    hydra_words - full-text index of post words
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of zbroker, the ZeroMQ broker project.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef HYDRA_WORDS_H_INCLUDED
+#define HYDRA_WORDS_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new empty word index
+HYDRA_PRIVATE hydra_words_t *
+    hydra_words_new (void);
+
+//  Load a word index from the specified file. Returns NULL if the file does
+//  not exist or is not a valid word index.
+HYDRA_PRIVATE hydra_words_t *
+    hydra_words_load (const char *filename);
+
+//  Destroy the word index
+HYDRA_PRIVATE void
+    hydra_words_destroy (hydra_words_t **self_p);
+
+//  Add the words of a post to the index. The key identifies the post, and
+//  must be higher than the key of any post already added. The text may be
+//  NULL; it need not end in a null byte. Words in the subject count for
+//  more than words in the text.
+HYDRA_PRIVATE void
+    hydra_words_add (hydra_words_t *self, uint64_t key, const char *subject,
+                     const char *text, size_t text_size);
+
+//  Return the key after the key of the last post added, or 0 if the index
+//  is empty; a post with this key or higher is not in the index.
+HYDRA_PRIVATE uint64_t
+    hydra_words_cursor (hydra_words_t *self);
+
+//  Return the number of distinct words in the index
+HYDRA_PRIVATE size_t
+    hydra_words_size (hydra_words_t *self);
+
+//  Find the posts that hold every word in the query, leaving out posts with
+//  keys below the horizon. Posts in total is the number of posts we search,
+//  which we use to weigh rare words above common ones. Skips the first
+//  offset posts found, best match first, and stores the keys of at most
+//  limit posts after that into the keys array. Returns the number of keys
+//  stored.
+HYDRA_PRIVATE size_t
+    hydra_words_search (hydra_words_t *self, const char *query, uint64_t horizon,
+                        size_t posts, size_t offset, uint64_t *keys, size_t limit);
+
+//  Drop the posts with keys below the horizon, and save the index to the
+//  specified file. Writes a temporary file and then renames it. Returns 0
+//  if OK, -1 if the file could not be written.
+HYDRA_PRIVATE int
+    hydra_words_save (hydra_words_t *self, const char *filename, uint64_t horizon);
+
+//  Self test of this class
+HYDRA_PRIVATE void
+    hydra_words_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,18 @@
 "This Software is provided under the MPLv2 License on an \"as is\" basis,\n" \
 "without warranty of any kind, either expressed, implied, or statutory.\n"
 
+//  hydra_new changes to the node directory, so we resolve archive paths
+//  given on the command line before that
+
+static char *
+s_absolute_path (const char *filename)
+{
+    char cwd [PATH_MAX];
+    if (*filename == '/' || !getcwd (cwd, sizeof (cwd)))
+        return strdup (filename);
+    return zsys_sprintf ("%s/%s", cwd, filename);
+}
+
 int main (int argc, char *argv [])
 {
     puts (PRODUCT);
@@ -32,23 +44,32 @@ int main (int argc, char *argv [])
 
     int argn = 1;
     if (argn < argc && streq (argv [argn], "-h")) {
-        puts ("syntax: hydrad [-v] [-z] [ [-t] [-i] [-n HOSTNAME] directory ]");
+        puts ("syntax: hydrad [-v] [-z] [ [-t] [-i] [-n HOSTNAME] [-l ARCHIVE] [-e ARCHIVE] directory ]");
         puts (" -- defaults to .hydra in current directory");
         puts (" -v = run Hydra protocol in verbose mode");
         puts (" -z = run Zyre discovery in verbose mode");
         puts (" -t = create some test posts");
         puts (" -i = run over ipc:// without networking");
         puts (" -n HOSTNAME = specify a custom hostname for hydrad to use");
+        puts (" -l ARCHIVE = load posts from an archive file before starting");
+        puts (" -e ARCHIVE = export all posts to an archive file, and exit");
         exit (0);
     }
     bool verbose = false;
     bool zverbose = false;
     bool testmode = false;
     bool localhost = false;
-    bool lookforvalue = false;
+    char **lookforvalue = NULL;
     char *directory = ".hydra";
     char *hostname = NULL;
+    char *import_file = NULL;
+    char *export_file = NULL;
     while (argn < argc && (*argv [argn] == '-' || lookforvalue)) {
+        if (lookforvalue) {
+            *lookforvalue = argv [argn];
+            lookforvalue = NULL;
+        }
+        else
         if (streq (argv [argn], "-v"))
             verbose = true;
         else
@@ -62,12 +83,13 @@ int main (int argc, char *argv [])
             localhost = true;
         else
         if (streq (argv [argn], "-n"))
-            lookforvalue = true;
+            lookforvalue = &hostname;
         else
-        if (lookforvalue) {
-            hostname = argv [argn];
-            lookforvalue = false;
-        }
+        if (streq (argv [argn], "-l"))
+            lookforvalue = &import_file;
+        else
+        if (streq (argv [argn], "-e"))
+            lookforvalue = &export_file;
         else {
             puts ("Invalid option, run hydrad -h to see options");
             exit (0);
@@ -76,30 +98,49 @@ int main (int argc, char *argv [])
     }
     if (argn < argc)
         directory = argv [argn];
-    
+    if (import_file)
+        import_file = s_absolute_path (import_file);
+    if (export_file)
+        export_file = s_absolute_path (export_file);
+
     hydra_t *hydra = hydra_new (directory);
     if (!hydra)
         exit (0);
     
     if (testmode) {
-        //  Provision the Hydra server with some test posts in a tree
-        char *post_id;
-        zactor_t *server = zactor_new (hydra_server, NULL);
-        zsock_send (server, "ssssss", "POST", "This is a string", "", "text/plain",
-                    "string", "Hello, World");
-        zsock_recv (server, "s", &post_id);
-
-        zsock_send (server, "ssssss", "POST", "This is a disk file", post_id,
-                    "text/zpl", "file", "hydra.cfg");
-        zstr_free (&post_id);
-        zsock_recv (server, "s", &post_id);
-
-        zsock_send (server, "sssssb", "POST", "This is a blob of data", post_id,
-                    "*/*", "chunk", "ABCDEFGHIJ", 10);
+        //  Provision the Hydra server with some test posts in a tree; we
+        //  go through the node, as its server owns the ledger
+        char *post_id = hydra_store_string (hydra, "This is a string", "",
+                                            "text/plain", "Hello, World");
+        char *parent_id = post_id;
+        post_id = hydra_store_file (hydra, "This is a disk file", parent_id,
+                                    "text/zpl", "hydra.cfg");
+        zstr_free (&parent_id);
+        zchunk_t *chunk = zchunk_new ("ABCDEFGHIJ", 10);
+        parent_id = post_id;
+        post_id = hydra_store_chunk (hydra, "This is a blob of data",
+                                     parent_id? parent_id: "", "*/*", chunk);
+        zchunk_destroy (&chunk);
+        zstr_free (&parent_id);
         zstr_free (&post_id);
-        zsock_recv (server, "s", &post_id);
-        zstr_free (&post_id);
-        zactor_destroy (&server);
+    }
+    if (import_file) {
+        int posts = hydra_import (hydra, import_file);
+        if (posts == -1)
+            zsys_error ("hydrad: cannot import %s", import_file);
+        else
+            zsys_info ("hydrad: imported %d posts from %s", posts, import_file);
+        zstr_free (&import_file);
+    }
+    if (export_file) {
+        int posts = hydra_export (hydra, export_file);
+        if (posts == -1)
+            zsys_error ("hydrad: cannot export to %s", export_file);
+        else
+            zsys_info ("hydrad: exported %d posts to %s", posts, export_file);
+        zstr_free (&export_file);
+        hydra_destroy (&hydra);
+        return posts == -1? 1: 0;
     }
     if (verbose)
         hydra_set_animate (hydra);